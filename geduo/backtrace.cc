@@ -0,0 +1,215 @@
+/*
+ * @file : backtrace.cc
+ * @brief: 延迟符号化的调用栈收集的实现
+ */
+#include <execinfo.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "backtrace.h"
+#include "log.h"
+#include "util.h"
+
+namespace geduo {
+
+static Logger::ptr g_logger = GEDUO_LOG_NAME("system");
+
+std::ostream& operator<<(std::ostream& os, const BacktraceRef& ref) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "stack_id=%016lx count=%lu"
+            ,(unsigned long)ref.id, (unsigned long)ref.count);
+    os << buf;
+    if (ref.count == 0) {
+        os << " (not recorded)";
+    }
+    return os;
+}
+
+BacktraceCollector* BacktraceCollector::GetInstance() {
+    static BacktraceCollector* s_instance = new BacktraceCollector;
+    return s_instance;
+}
+
+BacktraceRef __attribute__((noinline)) BacktraceCollector::capture(int skip) {
+    // 只抓取返回地址, 不分配内存
+    void* buf[kMaxFrames + 16];
+    int n = ::backtrace(buf, kMaxFrames + 16);
+    skip = std::max(0, std::min(skip, n));
+    void** frames = buf + skip;
+    int size = std::min(n - skip, kMaxFrames);
+
+    uint64_t id = 14695981039346656037ull;
+    for (int i = 0; i < size; ++i) {
+        id = (id ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ull;
+    }
+
+    // 不同调用栈哈希冲突时顺延 id
+    auto find = [&](uint64_t& key) -> Stack* {
+        for (auto it = m_stacks.find(key); it != m_stacks.end(); it = m_stacks.find(key)) {
+            Stack* stack = it->second;
+            if (stack->size == size
+                    && memcmp(stack->frames, frames, sizeof(void*) * size) == 0) {
+                return stack;
+            }
+            key += 0x9e3779b97f4a7c15ull;
+        }
+        return nullptr;
+    };
+
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        uint64_t key = id;
+        Stack* stack = find(key);
+        if (stack) {
+            return BacktraceRef{key, ++stack->count};
+        }
+    }
+
+    Stack* stack = nullptr;
+    {
+        RWMutex::WriteLock lock(m_mutex);
+        uint64_t key = id;
+        stack = find(key);
+        if (stack) {
+            return BacktraceRef{key, ++stack->count};
+        }
+        if (m_stacks.size() >= kMaxStacks) {
+            ++m_dropped;
+            return BacktraceRef{id, 0};
+        }
+        stack = new Stack;
+        stack->id = key;
+        stack->size = size;
+        memcpy(stack->frames, frames, sizeof(void*) * size);
+        stack->count = 1;
+        m_stacks[key] = stack;
+    }
+
+    {
+        Mutex::Lock lock(m_queueMutex);
+        m_queue.push_back(stack);
+        if (!m_thread) {
+            m_thread.reset(new Thread(std::bind(&BacktraceCollector::run, this), "backtrace"));
+        }
+    }
+    m_sem.notify();
+    return BacktraceRef{stack->id, 1};
+}
+
+uint64_t BacktraceCollector::getCount(uint64_t id) {
+    RWMutex::ReadLock lock(m_mutex);
+    auto it = m_stacks.find(id);
+    return it == m_stacks.end() ? 0 : it->second->count.load();
+}
+
+static void LogStack(uint64_t id, const std::vector<std::string>& symbols) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%016lx", (unsigned long)id);
+    std::stringstream ss;
+    for (auto& i : symbols) {
+        ss << "    " << i << std::endl;
+    }
+    GEDUO_LOG_ERROR(g_logger) << "backtrace stack_id=" << buf << ":\n" << ss.str();
+}
+
+bool BacktraceCollector::symbolize(Stack* stack, bool log) {
+    if (stack->symbolized) {
+        return false;
+    }
+    Mutex::Lock lock(m_symbolMutex);
+    if (stack->symbolized) {
+        return false;
+    }
+    SymbolizeBacktrace(stack->frames, stack->size, stack->symbols);
+    // 输出后才置位, 其他线程的 symbolize 返回时日志已写入
+    if (log) {
+        LogStack(stack->id, stack->symbols);
+    }
+    stack->symbolized = true;
+    return true;
+}
+
+bool BacktraceCollector::getSymbols(uint64_t id, std::string& str, const std::string& prefix) {
+    Stack* stack = nullptr;
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        auto it = m_stacks.find(id);
+        if (it == m_stacks.end()) {
+            return false;
+        }
+        stack = it->second;
+    }
+    symbolize(stack);
+    std::stringstream ss;
+    for (auto& i : stack->symbols) {
+        ss << prefix << i << std::endl;
+    }
+    str = ss.str();
+    return true;
+}
+
+void BacktraceCollector::flush() {
+    while (true) {
+        Stack* stack = nullptr;
+        {
+            Mutex::Lock lock(m_queueMutex);
+            if (m_queue.empty()) {
+                break;
+            }
+            stack = m_queue.front();
+            m_queue.pop_front();
+        }
+        symbolize(stack, true);
+    }
+}
+
+void BacktraceCollector::run() {
+    while (true) {
+        m_sem.wait();
+        Stack* stack = nullptr;
+        {
+            Mutex::Lock lock(m_queueMutex);
+            if (m_queue.empty()) {
+                // 已被 flush 取走
+                continue;
+            }
+            stack = m_queue.front();
+        }
+        // 输出后才出队, flush 总能看到正在处理的调用栈, 并在 symbolize 中等它输出完
+        symbolize(stack, true);
+        Mutex::Lock lock(m_queueMutex);
+        if (!m_queue.empty() && m_queue.front() == stack) {
+            m_queue.pop_front();
+        }
+    }
+}
+
+std::ostream& BacktraceCollector::dump(std::ostream& os, const std::string& prefix) {
+    // 其他线程仍在累加 count, 按取出时的快照排序
+    std::vector<std::pair<uint64_t, Stack*> > stacks;
+    {
+        RWMutex::ReadLock lock(m_mutex);
+        stacks.reserve(m_stacks.size());
+        for (auto& i : m_stacks) {
+            stacks.push_back(std::make_pair(i.second->count.load(), i.second));
+        }
+    }
+    std::sort(stacks.begin(), stacks.end()
+            ,[](const std::pair<uint64_t, Stack*>& a, const std::pair<uint64_t, Stack*>& b) {
+        return a.first > b.first;
+    });
+    for (auto& i : stacks) {
+        symbolize(i.second);
+        os << BacktraceRef{i.second->id, i.first} << std::endl;
+        for (auto& s : i.second->symbols) {
+            os << prefix << s << std::endl;
+        }
+    }
+    if (m_dropped) {
+        os << "dropped=" << m_dropped << std::endl;
+    }
+    return os;
+}
+
+} // namespace geduo
@@ -0,0 +1,106 @@
+/*
+ * @file : backtrace.h
+ * @brief: 延迟符号化的调用栈收集
+ * @details 异常和断言的热路径上只用 backtrace() 把返回地址抓取到定长缓冲区, 按地址哈希去重计数;
+ *          新出现的调用栈交给后台线程做 backtrace_symbols + demangle, 符号化结果写入 system 日志.
+ *          同一调用栈重复出现时只输出 stack_id 和次数, 不再分配内存和解析符号
+ */
+
+#ifndef __GEDUO_BACKTRACE_H__
+#define __GEDUO_BACKTRACE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mutex.h"
+#include "thread.h"
+
+namespace geduo {
+
+/// @brief 一次抓取的结果, 可直接输出到日志流
+struct BacktraceRef {
+    /// 调用栈 id, 由返回地址哈希得到, 对应后台线程输出的符号化日志
+    uint64_t id;
+    /// 该调用栈累计出现的次数(含本次)
+    uint64_t count;
+};
+
+std::ostream& operator<<(std::ostream& os, const BacktraceRef& ref);
+
+class BacktraceCollector : Noncopyable {
+public:
+    /// 每个调用栈最多保存的层数
+    static const int kMaxFrames = 64;
+    /// 最多保存的不同调用栈数, 超出后新调用栈只计数不保存
+    static const size_t kMaxStacks = 4096;
+
+    /// @brief 全局实例, 不析构, 进程退出时后台线程仍可安全运行
+    static BacktraceCollector* GetInstance();
+
+    /**
+     * @brief 抓取当前调用栈
+     * @param[in] skip 跳过栈顶的层数, 1 跳过 capture 自身
+     */
+    BacktraceRef capture(int skip = 1);
+
+    /// @brief 调用栈累计出现的次数, 未知 id 返回 0
+    uint64_t getCount(uint64_t id);
+
+    /**
+     * @brief 返回符号化的调用栈, 尚未符号化时在当前线程完成
+     * @return 未知 id 返回 false
+     */
+    bool getSymbols(uint64_t id, std::string& str, const std::string& prefix = "");
+
+    /**
+     * @brief 在当前线程符号化并输出所有尚未处理的调用栈(如进程即将 abort)
+     * @details 返回时后台线程正在处理的调用栈也已写入日志
+     */
+    void flush();
+
+    /// @brief 超出 kMaxStacks 而未保存的抓取次数
+    uint64_t getDropped() const { return m_dropped; }
+
+    /// @brief 按出现次数从多到少输出所有调用栈
+    std::ostream& dump(std::ostream& os, const std::string& prefix = "    ");
+private:
+    struct Stack {
+        uint64_t id;
+        int size;
+        void* frames[kMaxFrames];
+        std::atomic<uint64_t> count = {0};
+        std::atomic<bool> symbolized = {false};
+        /// 符号化结果, symbolized 为 true 后只读
+        std::vector<std::string> symbols;
+    };
+
+    BacktraceCollector() = default;
+
+    /**
+     * @brief 符号化, 多个线程同时调用时只有一个执行
+     * @param[in] log 由本次调用完成时是否写入 system 日志
+     * @return 是否由本次调用完成
+     */
+    bool symbolize(Stack* stack, bool log = false);
+    void run();
+private:
+    RWMutex m_mutex;
+    std::unordered_map<uint64_t, Stack*> m_stacks;
+    std::atomic<uint64_t> m_dropped = {0};
+
+    Mutex m_queueMutex;
+    std::deque<Stack*> m_queue;
+    Semaphore m_sem;
+    Thread::ptr m_thread;
+
+    Mutex m_symbolMutex;
+};
+
+} // namespace geduo
+
+#endif
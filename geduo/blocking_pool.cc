@@ -0,0 +1,296 @@
+/*
+ * @file : blocking_pool.cc
+ * @brief: 阻塞调用线程池的实现
+ */
+#include <algorithm>
+
+#include "blocking_pool.h"
+#include "clock.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+
+namespace geduo {
+
+static Logger::ptr g_logger = GEDUO_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_blocking_max_threads =
+    Config::Lookup<uint32_t>("blocking.max_threads", 64, "default blocking pool max threads");
+
+static ConfigVar<uint32_t>::ptr g_blocking_max_queue =
+    Config::Lookup<uint32_t>("blocking.max_queue", 0, "default blocking pool max queued jobs, 0 for unlimited");
+
+static ConfigVar<uint32_t>::ptr g_blocking_keep_alive_ms =
+    Config::Lookup<uint32_t>("blocking.keep_alive_ms", 10000, "default blocking pool idle thread keep alive ms");
+
+static thread_local BlockingPool* t_blocking_pool = nullptr;
+
+/// @brief 原子地更新历史最大值
+static void UpdateMax(std::atomic<size_t>& max, size_t v) {
+    size_t cur = max;
+    while (v > cur && !max.compare_exchange_weak(cur, v)) {
+    }
+}
+
+BlockingPool::BlockingPool(size_t max_threads, const std::string& name
+                           ,size_t max_queue, uint64_t keep_alive_ms)
+    :m_name(name)
+    ,m_maxThreads(max_threads)
+    ,m_maxQueue(max_queue)
+    ,m_keepAliveMS(keep_alive_ms) {
+    GEDUO_ASSERT(max_threads > 0);
+}
+
+BlockingPool::~BlockingPool() {
+    stop();
+}
+
+BlockingPool* BlockingPool::GetDefault() {
+    static BlockingPool* s_pool = new BlockingPool(
+            std::max(1u, g_blocking_max_threads->getValue()), "blocking"
+            ,g_blocking_max_queue->getValue(), g_blocking_keep_alive_ms->getValue());
+    return s_pool;
+}
+
+BlockingPool* BlockingPool::GetThis() {
+    return t_blocking_pool;
+}
+
+void BlockingPool::stop() {
+    std::list<Thread::ptr> thrs;
+    std::vector<Thread::ptr> exited;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        m_stopping = true;
+        thrs.swap(m_threads);
+        exited.swap(m_exited);
+        // 等待空位的提交方醒来后在自己的线程中执行
+        for (auto i : m_spaceWaiters) {
+            i->notify();
+        }
+        m_spaceWaiters.clear();
+    }
+    for (size_t i = 0; i < thrs.size(); ++i) {
+        m_sem.notify();
+    }
+    for (auto& i : thrs) {
+        i->join();
+    }
+    for (auto& i : exited) {
+        i->join();
+    }
+}
+
+bool BlockingPool::pushLocked(std::function<void()>& cb, std::string& thread_name) {
+    m_jobs.push_back(Job{std::move(cb), Clock::MonotonicNS()});
+    UpdateMax(m_maxQueueDepth, ++m_queueDepth);
+    ++m_submitted;
+    m_sem.notify();
+    // 每个空闲线程只能接走一个任务, 超出的部分需要新线程
+    if (m_jobs.size() > m_idleCount && m_threadCount < m_maxThreads) {
+        UpdateMax(m_peakThreadCount, ++m_threadCount);
+        thread_name = m_name + "_" + std::to_string(m_nextThreadId++);
+        return true;
+    }
+    return false;
+}
+
+void BlockingPool::startThread(const std::string& thread_name) {
+    // 线程启动要等 pthread_create 和新线程就绪, 不在锁内进行
+    Thread::ptr thr;
+    try {
+        thr = std::make_shared<Thread>(std::bind(&BlockingPool::work, this), thread_name);
+    } catch (std::exception& ex) {
+        GEDUO_LOG_ERROR(g_logger) << "BlockingPool " << m_name
+            << " create thread fail: " << ex.what();
+        std::deque<Job> jobs;
+        {
+            MutexType::Lock lock(m_mutex);
+            --m_threadCount;
+            if (m_threadCount == 0) {
+                // 没有线程能取走排队的任务, 在调用方执行, 避免 run 的调用方一直等待
+                jobs.swap(m_jobs);
+                m_queueDepth -= jobs.size();
+                for (auto i : m_spaceWaiters) {
+                    i->notify();
+                }
+                m_spaceWaiters.clear();
+            }
+        }
+        for (auto& i : jobs) {
+            execute(i);
+        }
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    if (!m_stopping) {
+        m_threads.push_back(thr);
+        return;
+    }
+    lock.unlock();
+    // stop 已取走线程列表, 由这里唤醒并回收
+    m_sem.notify();
+    thr->join();
+}
+
+void BlockingPool::submit(std::function<void()> cb) {
+    FiberWaiter waiter;
+    bool queued = false;
+    bool need_reap = false;
+    bool need_thread = false;
+    std::string thread_name;
+    while (true) {
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_stopping) {
+                break;
+            }
+            if (!m_maxQueue || m_jobs.size() < m_maxQueue) {
+                need_thread = pushLocked(cb, thread_name);
+                queued = true;
+                need_reap = !m_exited.empty();
+                break;
+            }
+            m_spaceWaiters.push_back(&waiter);
+            ++m_queueFullWaits;
+        }
+        waiter.wait();
+        waiter.reset();
+    }
+    if (!queued) {
+        // 已停止
+        cb();
+    }
+    if (need_thread) {
+        startThread(thread_name);
+    }
+    if (need_reap) {
+        reap();
+    }
+}
+
+bool BlockingPool::trySubmit(std::function<void()> cb) {
+    bool queued = false;
+    bool need_reap = false;
+    bool need_thread = false;
+    std::string thread_name;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!m_stopping) {
+            if (m_maxQueue && m_jobs.size() >= m_maxQueue) {
+                ++m_rejected;
+                return false;
+            }
+            need_thread = pushLocked(cb, thread_name);
+            queued = true;
+            need_reap = !m_exited.empty();
+        }
+    }
+    if (!queued) {
+        cb();
+    }
+    if (need_thread) {
+        startThread(thread_name);
+    }
+    if (need_reap) {
+        reap();
+    }
+    return true;
+}
+
+void BlockingPool::reap() {
+    std::vector<Thread::ptr> exited;
+    {
+        MutexType::Lock lock(m_mutex);
+        exited.swap(m_exited);
+    }
+    for (auto& i : exited) {
+        i->join();
+    }
+}
+
+void BlockingPool::execute(Job& job) {
+    m_queueWaitNS += Clock::MonotonicNS() - job.enqueueNS;
+    try {
+        job.cb();
+    } catch (std::exception& ex) {
+        GEDUO_LOG_ERROR(g_logger) << "BlockingPool " << m_name
+            << " job except: " << ex.what();
+    } catch (...) {
+        GEDUO_LOG_ERROR(g_logger) << "BlockingPool " << m_name
+            << " job except";
+    }
+    ++m_executed;
+}
+
+void BlockingPool::work() {
+    t_blocking_pool = this;
+    while (true) {
+        Job job;
+        {
+            MutexType::Lock lock(m_mutex);
+            ++m_idleCount;
+            lock.unlock();
+            bool notified = m_sem.waitFor(m_keepAliveMS);
+            lock.lock();
+            --m_idleCount;
+            if (m_jobs.empty()) {
+                if (m_stopping) {
+                    break;
+                }
+                if (notified) {
+                    // 任务已被其他线程取走
+                    continue;
+                }
+                // 空闲超时, 由之后的提交方或 stop 回收
+                Thread* self = Thread::GetThis();
+                auto it = m_threads.begin();
+                while (it != m_threads.end() && it->get() != self) {
+                    ++it;
+                }
+                if (it == m_threads.end()) {
+                    // 创建方尚未登记本线程, 不能退出
+                    continue;
+                }
+                m_exited.push_back(*it);
+                m_threads.erase(it);
+                --m_threadCount;
+                break;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            --m_queueDepth;
+            if (!m_spaceWaiters.empty()) {
+                m_spaceWaiters.front()->notify();
+                m_spaceWaiters.pop_front();
+            }
+        }
+        execute(job);
+    }
+    t_blocking_pool = nullptr;
+}
+
+std::ostream& BlockingPool::dump(std::ostream& os) {
+    os << "[BlockingPool name=" << m_name
+       << " threads=" << m_threadCount
+       << " idle=" << m_idleCount
+       << " peak_threads=" << m_peakThreadCount
+       << " max_threads=" << m_maxThreads
+       << " max_queue=" << m_maxQueue
+       << " keep_alive_ms=" << m_keepAliveMS
+       << " queue_depth=" << m_queueDepth
+       << " max_queue_depth=" << m_maxQueueDepth
+       << " submitted=" << m_submitted
+       << " executed=" << m_executed
+       << " rejected=" << m_rejected
+       << " queue_full_waits=" << m_queueFullWaits
+       << " queue_wait_ns=" << m_queueWaitNS
+       << " stopping=" << m_stopping
+       << " ]";
+    return os;
+}
+
+} // namespace geduo
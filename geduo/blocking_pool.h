@@ -0,0 +1,158 @@
+/*
+ * @file : blocking_pool.h
+ * @brief: 阻塞调用线程池
+ * @details 普通文件读写、getaddrinfo、同步客户端库等无法 hook 的阻塞调用放在协程调度器的工作线程上执行,
+ *          会卡住该线程上的所有协程. BlockingPool 按需创建线程(不超过上限), 线程空闲超过 keep_alive_ms
+ *          后退出; 队列有长度上限, 满时提交方等待. run 让出调用协程, 完成后回到原协程调度器继续执行.
+ *          与 OffloadPool 的区别: OffloadPool 线程数固定, 面向占满 CPU 的计算; 本池的线程大多在等待,
+ *          线程数随并发的阻塞调用数伸缩
+ */
+
+#ifndef __GEDUO_BLOCKING_POOL_H__
+#define __GEDUO_BLOCKING_POOL_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "fiber.h"
+#include "thread.h"
+
+namespace geduo {
+
+class BlockingPool : Noncopyable {
+public:
+    typedef std::shared_ptr<BlockingPool> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @param[in] max_threads 最多线程数
+     * @param[in] max_queue 排队任务数上限, 0 表示不限
+     * @param[in] keep_alive_ms 空闲线程的存活时间
+     */
+    BlockingPool(size_t max_threads = 64, const std::string& name = "blocking"
+                 ,size_t max_queue = 0, uint64_t keep_alive_ms = 10000);
+    ~BlockingPool();
+
+    /// @brief 默认阻塞线程池, 由 blocking.max_threads / blocking.max_queue / blocking.keep_alive_ms 配置
+    static BlockingPool* GetDefault();
+
+    /// @brief 当前线程所属的阻塞线程池, 非本池线程返回 nullptr
+    static BlockingPool* GetThis();
+
+    const std::string& getName() const { return m_name; }
+
+    /// @brief 执行完队列中的任务后停止, 之后提交的任务在调用方直接执行
+    void stop();
+
+    /// @brief 提交任务, 队列满时等待(协程中让出协程)
+    void submit(std::function<void()> cb);
+
+    /// @brief 提交任务, 队列满返回 false
+    bool trySubmit(std::function<void()> cb);
+
+    /**
+     * @brief 在线程池中执行 cb 并等待结果
+     * @details 协程中调用时让出协程, 完成后回到原协程调度器; 普通线程中阻塞等待.
+     *          cb 抛出的异常在调用方重新抛出. 在本池的线程中调用或池已停止时直接执行
+     */
+    template <class F>
+    auto run(F cb) -> decltype(cb()) {
+        std::packaged_task<decltype(cb())()> task(std::move(cb));
+        auto future = task.get_future();
+        if (GetThis() == this || m_stopping) {
+            task();
+            return future.get();
+        }
+        FiberWaiter waiter;
+        submit([&task, &waiter]() {
+            task();
+            waiter.notify();
+        });
+        waiter.wait();
+        return future.get();
+    }
+
+    /// @brief 当前线程数
+    size_t getThreadCount() const { return m_threadCount; }
+    /// @brief 当前空闲线程数
+    size_t getIdleCount() const { return m_idleCount; }
+    /// @brief 线程数的历史最大值
+    size_t getPeakThreadCount() const { return m_peakThreadCount; }
+    /// @brief 当前排队的任务数
+    size_t getQueueDepth() const { return m_queueDepth; }
+    /// @brief 排队任务数的历史最大值
+    size_t getMaxQueueDepth() const { return m_maxQueueDepth; }
+    /// @brief 已提交的任务总数
+    uint64_t getSubmitted() const { return m_submitted; }
+    /// @brief 已完成的任务总数
+    uint64_t getExecuted() const { return m_executed; }
+    /// @brief trySubmit 因队列满被拒绝的次数
+    uint64_t getRejected() const { return m_rejected; }
+    /// @brief submit 因队列满而等待的次数
+    uint64_t getQueueFullWaits() const { return m_queueFullWaits; }
+    /// @brief 任务在队列中等待的总时间(纳秒)
+    uint64_t getQueueWaitNS() const { return m_queueWaitNS; }
+
+    std::ostream& dump(std::ostream& os);
+private:
+    struct Job {
+        std::function<void()> cb;
+        uint64_t enqueueNS;
+    };
+
+    /**
+     * @brief 入队, 持锁调用
+     * @param[out] thread_name 需要新线程时的线程名, 线程数已计入 m_threadCount
+     * @return 是否需要在解锁后调用 startThread
+     */
+    bool pushLocked(std::function<void()>& cb, std::string& thread_name);
+    /// @brief 创建线程, 不能持锁调用. 失败且池中没有线程时在调用方执行排队的任务
+    void startThread(const std::string& thread_name);
+    /// @brief 回收已退出的线程, 不能持锁调用
+    void reap();
+    void execute(Job& job);
+    void work();
+private:
+    MutexType m_mutex;
+    std::deque<Job> m_jobs;
+    Semaphore m_sem;
+    std::list<Thread::ptr> m_threads;
+    /// 空闲超时退出、尚未 join 的线程
+    std::vector<Thread::ptr> m_exited;
+    /// 等待队列空位的提交方
+    std::list<FiberWaiter*> m_spaceWaiters;
+    std::string m_name;
+    size_t m_maxThreads;
+    size_t m_maxQueue;
+    uint64_t m_keepAliveMS;
+    uint64_t m_nextThreadId = 0;
+    /// run 在锁外读取
+    std::atomic<bool> m_stopping = {false};
+
+    std::atomic<size_t> m_threadCount = {0};
+    std::atomic<size_t> m_idleCount = {0};
+    std::atomic<size_t> m_peakThreadCount = {0};
+    std::atomic<size_t> m_queueDepth = {0};
+    std::atomic<size_t> m_maxQueueDepth = {0};
+    std::atomic<uint64_t> m_submitted = {0};
+    std::atomic<uint64_t> m_executed = {0};
+    std::atomic<uint64_t> m_rejected = {0};
+    std::atomic<uint64_t> m_queueFullWaits = {0};
+    std::atomic<uint64_t> m_queueWaitNS = {0};
+};
+
+/// @brief 在默认阻塞线程池中执行 cb 并等待结果
+template <class F>
+auto run_blocking(F cb) -> decltype(cb()) {
+    return BlockingPool::GetDefault()->run(std::move(cb));
+}
+
+} // namespace geduo
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * @file : cancel.cc
+ * @brief: 协作式取消的实现
+ */
+#include "cancel.h"
+#include "fiber.h"
+
+namespace geduo {
+
+static FiberLocal<CancelToken::ptr> s_current_token;
+
+CancelToken::CancelToken(ptr parent)
+    :m_parent(parent) {
+    if (m_parent) {
+        // 本对象析构时先注销, 回调中访问 this 是安全的
+        m_parentCallback = m_parent->addCallback([this]() {
+            cancel();
+        });
+    }
+}
+
+CancelToken::~CancelToken() {
+    if (m_parentCallback) {
+        m_parent->removeCallback(m_parentCallback);
+    }
+}
+
+void CancelToken::cancel() {
+    if (m_cancelled.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+    // 持锁执行回调, 保证 removeCallback 返回后回调不再访问等待方栈上的对象
+    MutexType::Lock lock(m_mutex);
+    for (auto& i : m_callbacks) {
+        i.second();
+    }
+    m_callbacks.clear();
+}
+
+uint64_t CancelToken::addCallback(std::function<void()> cb) {
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!isCancelled()) {
+            uint64_t id = m_nextId++;
+            m_callbacks[id] = std::move(cb);
+            return id;
+        }
+    }
+    cb();
+    return 0;
+}
+
+void CancelToken::removeCallback(uint64_t id) {
+    if (!id) {
+        return;
+    }
+    MutexType::Lock lock(m_mutex);
+    m_callbacks.erase(id);
+}
+
+CancelToken::ptr CancelToken::GetThis() {
+    CancelToken::ptr* token = s_current_token.tryGet();
+    return token ? *token : nullptr;
+}
+
+CancelToken::ptr CancelToken::SetThis(ptr token) {
+    CancelToken::ptr* cur = s_current_token.tryGet();
+    if (!cur) {
+        if (token) {
+            s_current_token.set(std::move(token));
+        }
+        return nullptr;
+    }
+    cur->swap(token);
+    return token;
+}
+
+bool CancelToken::IsCancelled() {
+    CancelToken::ptr* token = s_current_token.tryGet();
+    return token && *token && (*token)->isCancelled();
+}
+
+} // namespace geduo
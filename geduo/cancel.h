@@ -0,0 +1,68 @@
+/*
+ * @file : cancel.h
+ * @brief: 协作式取消
+ * @details CancelToken 可组成树, 父节点取消时子节点一并取消. 协程当前的 token 存放在协程局部变量中,
+ *          TaskGroup 启动的子任务自动继承; 通道的阻塞收发、WaitGroup::wait 等阻塞点登记回调,
+ *          取消时立即唤醒并以 ECANCELED 失败, 计算密集的任务可轮询 CancelToken::IsCancelled
+ */
+
+#ifndef __GEDUO_CANCEL_H__
+#define __GEDUO_CANCEL_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include "mutex.h"
+
+namespace geduo {
+
+class CancelToken : Noncopyable {
+public:
+    typedef std::shared_ptr<CancelToken> ptr;
+    typedef Mutex MutexType;
+
+    /// @param[in] parent 父节点, 已取消时新节点立即取消
+    explicit CancelToken(ptr parent = nullptr);
+    ~CancelToken();
+
+    /// @brief 取消, 执行所有已登记的回调, 只有第一次调用生效
+    void cancel();
+
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+    const ptr& getParent() const { return m_parent; }
+
+    /**
+     * @brief 登记取消时执行的回调
+     * @details 回调在取消方的线程中持锁执行, 应只做唤醒之类的轻量操作, 不能再操作本 token.
+     *          已取消时立即执行并返回 0
+     * @return 回调 id, 用于 removeCallback
+     */
+    uint64_t addCallback(std::function<void()> cb);
+
+    /// @brief 注销回调, 返回后回调不会再执行(正在执行时等待其结束)
+    void removeCallback(uint64_t id);
+
+    /// @brief 当前协程的 token, 没有时返回 nullptr
+    static ptr GetThis();
+
+    /// @brief 设置当前协程的 token, 返回原来的 token
+    static ptr SetThis(ptr token);
+
+    /// @brief 当前协程是否已被取消
+    static bool IsCancelled();
+private:
+    ptr m_parent;
+    uint64_t m_parentCallback = 0;
+    std::atomic<bool> m_cancelled = {false};
+    MutexType m_mutex;
+    std::map<uint64_t, std::function<void()>> m_callbacks;
+    uint64_t m_nextId = 1;
+};
+
+} // namespace geduo
+
+#endif
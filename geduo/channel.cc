@@ -0,0 +1,140 @@
+/*
+ * @file : channel.cc
+ * @brief: 协程通道的实现
+ */
+#include "channel.h"
+
+namespace geduo {
+
+ChannelBase::ChannelBase() {
+    for (int i = 0; i < 2; ++i) {
+        m_head[i] = nullptr;
+        m_tail[i] = nullptr;
+        m_waiting[i] = 0;
+    }
+}
+
+void ChannelBase::addWaiter(WaitNode* node) {
+    Spinlock::Lock lock(m_mutex);
+    Direction dir = node->dir;
+    node->prev = m_tail[dir];
+    node->next = nullptr;
+    if (m_tail[dir]) {
+        m_tail[dir]->next = node;
+    } else {
+        m_head[dir] = node;
+    }
+    m_tail[dir] = node;
+    node->linked = true;
+    m_waiting[dir].fetch_add(1, std::memory_order_seq_cst);
+}
+
+void ChannelBase::unlink(WaitNode* node) {
+    Direction dir = node->dir;
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        m_head[dir] = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        m_tail[dir] = node->prev;
+    }
+    node->prev = node->next = nullptr;
+    node->linked = false;
+    m_waiting[dir].fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ChannelBase::removeWaiter(WaitNode* node) {
+    Spinlock::Lock lock(m_mutex);
+    if (node->linked) {
+        unlink(node);
+    }
+}
+
+bool ChannelBase::wakeOne(Direction dir) {
+    Waiter* waiter = nullptr;
+    {
+        Spinlock::Lock lock(m_mutex);
+        while (m_head[dir]) {
+            WaitNode* node = m_head[dir];
+            unlink(node);
+            int expect = -1;
+            // select 同时挂在多个通道上, 只有第一个唤醒者生效
+            if (node->waiter->fired.compare_exchange_strong(expect, node->index)) {
+                waiter = node->waiter;
+                break;
+            }
+        }
+    }
+    if (!waiter) {
+        return false;
+    }
+    // 在锁外唤醒, 避免被唤醒方立即运行时在自旋锁上空转; 等待方见到 fired 后会等本次 notify
+    waiter->waiter.notify();
+    return true;
+}
+
+void ChannelBase::forward(Direction dir) {
+    if (dir == RECV ? readable() || isClosed() : writable() || isClosed()) {
+        notifyWaiters(dir);
+    }
+}
+
+void ChannelBase::close() {
+    if (m_closed.exchange(true)) {
+        return;
+    }
+    while (wakeOne(RECV)) {
+    }
+    while (wakeOne(SEND)) {
+    }
+}
+
+int ChannelSelect::tryAll() {
+    size_t n = m_cases.size();
+    if (n == 0) {
+        return kClosed;
+    }
+    size_t start = m_start++ % n;
+    size_t closed = 0;
+    for (size_t k = 0; k < n; ++k) {
+        size_t i = (start + k) % n;
+        Case& c = m_cases[i];
+        if (c.op()) {
+            return i;
+        }
+        if (c.channel->isClosed()
+                && (c.dir == ChannelBase::SEND || !c.channel->readable())) {
+            ++closed;
+        }
+    }
+    return closed == n ? kClosed : kNone;
+}
+
+int ChannelSelect::tryWait() {
+    return tryAll();
+}
+
+int ChannelSelect::wait() {
+    return waitUntil(0);
+}
+
+int ChannelSelect::waitFor(uint64_t timeout_ms) {
+    return waitUntil(Clock::MonotonicNS() + timeout_ms * 1000000ull);
+}
+
+int ChannelSelect::waitUntil(uint64_t deadline_ns) {
+    std::vector<ChannelBase::WaitNode> nodes(m_cases.size());
+    for (size_t i = 0; i < m_cases.size(); ++i) {
+        nodes[i].channel = m_cases[i].channel;
+        nodes[i].dir = m_cases[i].dir;
+        nodes[i].index = i;
+    }
+    return ChannelBase::Wait(nodes.data(), nodes.size(), [this]() {
+        return tryAll();
+    }, deadline_ns);
+}
+
+} // namespace geduo
@@ -0,0 +1,453 @@
+/*
+ * @file : channel.h
+ * @brief: 协程通道
+ * @details 有界环形队列(Vyukov MPMC, 每个槽位带序号), 收发不阻塞时只有一次 CAS, 不加锁;
+ *          队列满/空时发送方/接收方挂到通道的等待链表上, 协程中让出协程, 普通线程中阻塞.
+ *          对端只有在存在等待者时才加锁唤醒. 支持 close 与多通道 select.
+ *          当前协程的 CancelToken 被取消时, 阻塞中的收发立即失败, errno 为 ECANCELED
+ */
+
+#ifndef __GEDUO_CHANNEL_H__
+#define __GEDUO_CHANNEL_H__
+
+#include <errno.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "cancel.h"
+#include "clock.h"
+#include "fiber.h"
+#include "mutex.h"
+
+namespace geduo {
+
+class ChannelSelect;
+
+/// @brief 通道的非模板部分: 等待者管理与关闭
+class ChannelBase : Noncopyable {
+friend class ChannelSelect;
+public:
+    /// @brief 等待的方向
+    enum Direction { RECV = 0, SEND = 1 };
+
+    /// Wait 因当前协程被取消而返回
+    static const int kCancelled = -3;
+
+    virtual ~ChannelBase() {}
+
+    /**
+     * @brief 关闭通道, 唤醒所有等待者
+     * @details 关闭后发送失败, 接收方仍可取完剩余数据, 取完后接收失败
+     */
+    void close();
+    bool isClosed() const { return m_closed; }
+
+    /// @brief 是否有可接收的数据
+    virtual bool readable() const = 0;
+    /// @brief 是否有空位可发送
+    virtual bool writable() const = 0;
+protected:
+    /// @brief 一次阻塞操作(可能同时等待多个通道)的等待者
+    struct Waiter {
+        FiberWaiter waiter;
+        /// 唤醒者对应的 WaitNode::index, -1 表示未被唤醒, kCancelled / kTimeout 表示被取消/超时唤醒
+        std::atomic<int> fired = {-1};
+    };
+
+    /// @brief 等待者挂在某个通道上的节点, 由等待方在栈上分配
+    struct WaitNode {
+        ChannelBase* channel = nullptr;
+        Direction dir = RECV;
+        int index = 0;
+        Waiter* waiter = nullptr;
+        WaitNode* prev = nullptr;
+        WaitNode* next = nullptr;
+        bool linked = false;
+    };
+
+    ChannelBase();
+
+    /// @brief 有 dir 方向的等待者时唤醒一个, 在成功收发之后调用
+    void notifyWaiters(Direction dir) {
+        // 与等待方 "登记等待 -> 重试" 配对, 保证不会错过唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting[dir].load(std::memory_order_relaxed)) {
+            wakeOne(dir);
+        }
+    }
+
+    /**
+     * @brief 阻塞直到 try_all 完成某个操作、所有通道都已关闭或超时
+     * @param[in] try_all 尝试所有操作, 返回完成的下标, -1 表示都未就绪, -2 表示都已关闭
+     * @param[in] deadline_ns 截止时间(Clock::MonotonicNS), 0 表示不超时
+     * @return try_all 的结果, 超时返回 -1, 当前协程被取消时返回 kCancelled
+     */
+    template<class TryAll>
+    static int Wait(WaitNode* nodes, size_t n, TryAll try_all, uint64_t deadline_ns = 0) {
+        Waiter waiter;
+        for (size_t i = 0; i < n; ++i) {
+            nodes[i].waiter = &waiter;
+        }
+        int rt = -1;
+        int fired = -1;
+        CancelToken::ptr token = CancelToken::GetThis();
+        uint64_t cancel_id = 0;
+        DeadlineTimer::Handle timer;
+        bool has_timer = false;
+        while (true) {
+            rt = try_all();
+            if (rt != -1) {
+                break;
+            }
+            if (deadline_ns) {
+                // 超时回调只在到期后触发, 被它唤醒后在这里退出
+                if (Clock::MonotonicNS() >= deadline_ns) {
+                    break;
+                }
+                if (!has_timer) {
+                    timer = DeadlineTimer::Add(deadline_ns, [&waiter]() {
+                        int expect = -1;
+                        if (waiter.fired.compare_exchange_strong(expect, kTimeout)) {
+                            waiter.waiter.notify();
+                        }
+                    });
+                    has_timer = true;
+                }
+            }
+            if (token) {
+                // 取消标志先于回调设置, 回调写入的 fired 被下面的重置覆盖时在这里发现
+                if (token->isCancelled()) {
+                    rt = kCancelled;
+                    break;
+                }
+                if (!cancel_id) {
+                    cancel_id = token->addCallback([&waiter]() {
+                        int expect = -1;
+                        if (waiter.fired.compare_exchange_strong(expect, kCancelled)) {
+                            waiter.waiter.notify();
+                        }
+                    });
+                }
+            }
+            for (size_t i = 0; i < n; ++i) {
+                nodes[i].channel->addWaiter(&nodes[i]);
+            }
+            rt = try_all();
+            if (rt == -1) {
+                waiter.waiter.wait();
+            }
+            for (size_t i = 0; i < n; ++i) {
+                nodes[i].channel->removeWaiter(&nodes[i]);
+            }
+            fired = waiter.fired;
+            if (fired >= 0 && rt != -1) {
+                // 重试已成功但被唤醒者选中, 等唤醒者的 notify 完成后才能复用或析构 waiter
+                waiter.waiter.wait();
+            }
+            waiter.fired = -1;
+            waiter.waiter.reset();
+            if (rt != -1) {
+                break;
+            }
+        }
+        if (cancel_id) {
+            // 返回后取消回调不会再访问 waiter
+            token->removeCallback(cancel_id);
+        }
+        if (has_timer) {
+            DeadlineTimer::Remove(timer);
+        }
+        if (rt == kCancelled) {
+            errno = ECANCELED;
+        }
+        if (fired >= 0) {
+            // 收到的唤醒可能对应另一份数据, 转交给同一通道上的其他等待者
+            nodes[fired].channel->forward(nodes[fired].dir);
+        }
+        return rt;
+    }
+
+private:
+    void addWaiter(WaitNode* node);
+    void removeWaiter(WaitNode* node);
+    void unlink(WaitNode* node);
+    bool wakeOne(Direction dir);
+    /// @brief dir 方向仍就绪时唤醒一个等待者
+    void forward(Direction dir);
+private:
+    /// Waiter::fired 的超时唤醒
+    static const int kTimeout = -4;
+
+    Spinlock m_mutex;
+    WaitNode* m_head[2];
+    WaitNode* m_tail[2];
+    std::atomic<size_t> m_waiting[2];
+    std::atomic<bool> m_closed = {false};
+};
+
+/**
+ * @brief 有界通道
+ * @details 容量向上取整为 2 的幂, 最小为 2(不支持无缓冲的同步交接)
+ */
+template<class T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    explicit Channel(size_t capacity = 2) {
+        // 槽位序号区分空/满至少需要 2 个槽位
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells = new Cell[size];
+        for (size_t i = 0; i < size; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~Channel() {
+        size_t end = m_enqueuePos.load(std::memory_order_relaxed);
+        for (size_t pos = m_dequeuePos.load(std::memory_order_relaxed); pos != end; ++pos) {
+            reinterpret_cast<T*>(&m_cells[pos & m_mask].storage)->~T();
+        }
+        delete[] m_cells;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    /// @brief 当前数据个数, 并发收发时为近似值
+    size_t size() const {
+        size_t enq = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t deq = m_dequeuePos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+    bool readable() const override {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        return m_cells[pos & m_mask].seq.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    bool writable() const override {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        return m_cells[pos & m_mask].seq.load(std::memory_order_acquire) == pos;
+    }
+
+    /// @brief 不等待地发送, 失败(满或已关闭)时 v 不被移动
+    bool trySend(T&& v) {
+        if (isClosed() || !push(std::move(v))) {
+            return false;
+        }
+        notifyWaiters(RECV);
+        return true;
+    }
+
+    bool trySend(const T& v) {
+        if (isClosed() || !push(v)) {
+            return false;
+        }
+        notifyWaiters(RECV);
+        return true;
+    }
+
+    /// @brief 不等待地接收, 没有数据时返回 false
+    bool tryRecv(T& v) {
+        if (!pop(v)) {
+            return false;
+        }
+        notifyWaiters(SEND);
+        return true;
+    }
+
+    /// @brief 发送, 满时等待; 通道已关闭或当前协程被取消(errno 为 ECANCELED)返回 false
+    bool send(T v) {
+        if (trySend(std::move(v))) {
+            return true;
+        }
+        WaitNode node;
+        node.channel = this;
+        node.dir = SEND;
+        return Wait(&node, 1, [this, &v]() {
+            return trySendStep(v);
+        }) == 0;
+    }
+
+    /// @brief 接收, 空时等待; 通道已关闭且数据已取完或当前协程被取消返回 false
+    bool recv(T& v) {
+        if (tryRecv(v)) {
+            return true;
+        }
+        WaitNode node;
+        node.channel = this;
+        node.dir = RECV;
+        return Wait(&node, 1, [this, &v]() {
+            return tryRecvStep(v);
+        }) == 0;
+    }
+
+    /// @brief 最多等待 timeout_ms 毫秒的发送, 超时、已关闭或被取消返回 false(isClosed 区分)
+    bool sendFor(T&& v, uint64_t timeout_ms) {
+        if (trySend(std::move(v))) {
+            return true;
+        }
+        WaitNode node;
+        node.channel = this;
+        node.dir = SEND;
+        return Wait(&node, 1, [this, &v]() {
+            return trySendStep(v);
+        }, Clock::MonotonicNS() + timeout_ms * 1000000ull) == 0;
+    }
+
+    /// @brief 最多等待 timeout_ms 毫秒的接收, 超时、已关闭且取完或被取消返回 false
+    bool recvFor(T& v, uint64_t timeout_ms) {
+        if (tryRecv(v)) {
+            return true;
+        }
+        WaitNode node;
+        node.channel = this;
+        node.dir = RECV;
+        return Wait(&node, 1, [this, &v]() {
+            return tryRecvStep(v);
+        }, Clock::MonotonicNS() + timeout_ms * 1000000ull) == 0;
+    }
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    int trySendStep(T& v) {
+        if (isClosed()) {
+            return -2;
+        }
+        return trySend(std::move(v)) ? 0 : -1;
+    }
+
+    int tryRecvStep(T& v) {
+        if (tryRecv(v)) {
+            return 0;
+        }
+        return isClosed() && !readable() ? -2 : -1;
+    }
+
+    template<class U>
+    bool push(U&& v) {
+        Cell* cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1
+                            ,std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        new (&cell->storage) T(std::forward<U>(v));
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& v) {
+        Cell* cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1
+                            ,std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        T* p = reinterpret_cast<T*>(&cell->storage);
+        v = std::move(*p);
+        p->~T();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+private:
+    Cell* m_cells;
+    size_t m_mask;
+    /// 生产者与消费者的位置放在不同的缓存行
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueuePos = {0};
+    char m_pad1[64];
+    std::atomic<size_t> m_dequeuePos = {0};
+    char m_pad2[64];
+};
+
+/**
+ * @brief 多通道选择
+ * @details 依次添加分支后调用 wait, 完成其中一个分支; 多个分支同时就绪时轮流选择
+ */
+class ChannelSelect : Noncopyable {
+public:
+    /// 超时或没有就绪的分支
+    static const int kNone = -1;
+    /// 所有分支的通道都已关闭(接收分支要求数据已取完)
+    static const int kClosed = -2;
+    /// 当前协程被取消, errno 为 ECANCELED
+    static const int kCancelled = ChannelBase::kCancelled;
+
+    template<class T>
+    ChannelSelect& recv(Channel<T>& ch, T& out) {
+        Channel<T>* p = &ch;
+        T* o = &out;
+        m_cases.push_back(Case{&ch, ChannelBase::RECV, [p, o]() {
+            return p->tryRecv(*o);
+        }});
+        return *this;
+    }
+
+    template<class T>
+    ChannelSelect& send(Channel<T>& ch, T v) {
+        Channel<T>* p = &ch;
+        std::shared_ptr<T> holder = std::make_shared<T>(std::move(v));
+        m_cases.push_back(Case{&ch, ChannelBase::SEND, [p, holder]() {
+            return p->trySend(std::move(*holder));
+        }});
+        return *this;
+    }
+
+    /// @brief 等待直到完成一个分支, 返回分支下标(添加顺序), kClosed 或 kCancelled
+    int wait();
+    /// @brief 不等待, 返回完成的分支下标, kNone 或 kClosed
+    int tryWait();
+    /// @brief 最多等待 timeout_ms 毫秒, 返回完成的分支下标, kNone, kClosed 或 kCancelled
+    int waitFor(uint64_t timeout_ms);
+private:
+    struct Case {
+        ChannelBase* channel;
+        ChannelBase::Direction dir;
+        std::function<bool()> op;
+    };
+
+    int tryAll();
+    /// @brief 挂到所有分支的通道上等待, deadline_ns 为 0 表示不超时
+    int waitUntil(uint64_t deadline_ns);
+private:
+    std::vector<Case> m_cases;
+    size_t m_start = 0;
+};
+
+} // namespace geduo
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * @Author: Choubin
+ * @Date: 2026-10-19 10:12:40
+ * @LastEditors: Choubin
+ * @LastEditTime: 2026-10-19 10:12:40
+ * @FilePath: /geduo/geduo/clock.cc
+ * @Description:  时钟的具体实现
+ */
+
+#include "clock.h"
+
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace geduo {
+
+uint64_t Clock::NowMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+uint64_t Clock::NowUS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000 * 1000ul + ts.tv_nsec / 1000;
+}
+
+uint64_t Clock::CoarseMS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+uint64_t Clock::MonotonicNS() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+
+/// TSC 校准结果, 发布后不再修改
+struct TscParams {
+    bool available;
+    double ticks_per_ns;
+    double ns_per_tick;
+    uint64_t base_tick;
+    uint64_t base_ns;
+};
+
+static const TscParams s_tsc_unavailable = {false, 0, 0, 0, 0};
+/// 读取方一次加载得到完整的一组参数; 重新校准时旧参数可能仍在被读取, 不释放
+static std::atomic<const TscParams*> s_tsc_params = {nullptr};
+static std::once_flag s_tsc_once;
+
+/// 检查 CPU 是否支持 invariant TSC(频率恒定, 各核同步)
+static bool HasInvariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return edx & (1u << 8);
+#else
+    return false;
+#endif
+}
+
+/// 首次使用时校准, 避免在静态初始化阶段忙等
+static const TscParams* GetTscParams() {
+    const TscParams* params = s_tsc_params.load(std::memory_order_acquire);
+    if (params) {
+        return params;
+    }
+    std::call_once(s_tsc_once, []() {
+        if (!s_tsc_params.load(std::memory_order_acquire)) {
+            TscClock::Calibrate();
+        }
+    });
+    return s_tsc_params.load(std::memory_order_acquire);
+}
+
+bool TscClock::IsAvailable() {
+    return GetTscParams()->available;
+}
+
+uint64_t TscClock::NowNS() {
+    const TscParams* params = GetTscParams();
+    if (!params->available) {
+        return Clock::MonotonicNS();
+    }
+    return params->base_ns + (uint64_t)((Rdtsc() - params->base_tick) * params->ns_per_tick);
+}
+
+double TscClock::GetTicksPerNS() {
+    return GetTscParams()->ticks_per_ns;
+}
+
+void TscClock::Calibrate(uint64_t duration_us) {
+    if (!HasInvariantTsc()) {
+        s_tsc_params.store(&s_tsc_unavailable, std::memory_order_release);
+        return;
+    }
+    uint64_t begin_ns = Clock::MonotonicNS();
+    uint64_t begin_tick = Rdtsc();
+    uint64_t end_ns = 0;
+    do {
+        end_ns = Clock::MonotonicNS();
+    } while (end_ns - begin_ns < duration_us * 1000);
+    uint64_t end_tick = Rdtsc();
+    if (end_tick <= begin_tick) {
+        s_tsc_params.store(&s_tsc_unavailable, std::memory_order_release);
+        return;
+    }
+
+    TscParams* params = new TscParams;
+    params->available = true;
+    params->ticks_per_ns = (double)(end_tick - begin_tick) / (end_ns - begin_ns);
+    params->ns_per_tick = 1.0 / params->ticks_per_ns;
+    params->base_tick = end_tick;
+    params->base_ns = end_ns;
+    s_tsc_params.store(params, std::memory_order_release);
+}
+
+static thread_local uint64_t t_tick_us = 0;
+
+void TickClock::Update() {
+    t_tick_us = Clock::NowUS();
+}
+
+uint64_t TickClock::NowMS() {
+    return NowUS() / 1000;
+}
+
+uint64_t TickClock::NowUS() {
+    if (t_tick_us == 0) {
+        Update();
+    }
+    return t_tick_us;
+}
+
+} // namespace geduo
@@ -0,0 +1,88 @@
+/*
+ * @Author: Choubin
+ * @Date: 2026-10-19 10:12:40
+ * @LastEditors: Choubin
+ * @LastEditTime: 2026-10-19 10:12:40
+ * @FilePath: /geduo/geduo/clock.h
+ * @Description:  时钟封装, 提供vDSO时钟、校准后的TSC时钟和调度周期缓存时钟
+ */
+
+#ifndef __GEDUO_CLOCK_H__
+#define __GEDUO_CLOCK_H__
+
+#include <stdint.h>
+
+namespace geduo {
+
+/// @brief 系统时钟, 基于 clock_gettime, 走 vDSO 不陷入内核
+class Clock {
+public:
+    /// @brief 返回当前时间的毫秒
+    static uint64_t NowMS();
+
+    /// @brief 返回当前时间的微秒
+    static uint64_t NowUS();
+
+    /// @brief 返回粗粒度的当前时间毫秒, 精度为一个内核 tick(一般 1~4ms)
+    static uint64_t CoarseMS();
+
+    /// @brief 返回单调时钟的纳秒
+    static uint64_t MonotonicNS();
+};
+
+/**
+ * @brief TSC 时钟
+ * @details 首次使用时以 CLOCK_MONOTONIC 为基准校准 rdtsc 的频率(约 5ms), 之后读取只需一条 rdtsc 指令,
+ *          CPU 不支持 invariant TSC 时退化为 Clock::MonotonicNS()
+ */
+class TscClock {
+public:
+    /// @brief 是否可以使用 TSC
+    static bool IsAvailable();
+
+    /// @brief 读取 TSC 计数
+    static uint64_t Rdtsc()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        uint32_t lo, hi;
+        __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+        return ((uint64_t)hi << 32) | lo;
+#else
+        return 0;
+#endif
+    }
+
+    /// @brief 返回单调时钟的纳秒
+    static uint64_t NowNS();
+
+    /// @brief 返回每纳秒的 TSC 计数
+    static double GetTicksPerNS();
+
+    /**
+     * @brief 重新校准 TSC 频率
+     * @details 新参数整体发布, 可与 NowNS 并发调用
+     * @param[in] duration_us 校准时长(微秒)
+     */
+    static void Calibrate(uint64_t duration_us = 5000);
+};
+
+/**
+ * @brief 调度周期缓存时钟
+ * @details 每个线程缓存一个时间值, 由协程调度器每轮调度调用 Update 刷新,
+ *          读取只是一次线程本地变量访问, 适合对精度要求不高的热路径
+ */
+class TickClock {
+public:
+    /// @brief 刷新当前线程缓存的时间
+    static void Update();
+
+    /// @brief 返回当前线程缓存的时间毫秒
+    static uint64_t NowMS();
+
+    /// @brief 返回当前线程缓存的时间微秒
+    static uint64_t NowUS();
+};
+
+} // namespace geduo
+
+#endif
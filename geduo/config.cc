@@ -9,7 +9,15 @@
 
 #include "config.h"
 #include "env.h"
+#include "scheduler.h"
 #include "util.h"
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -18,11 +26,242 @@ namespace geduo {
 
 static geduo::Logger::ptr g_logger = GEDUO_LOG_NAME("system");
 
+/// 检查数值字符串不能为空且不能以空白开头(strto* 会跳过前导空白)
+static void CheckNumber(const std::string& v)
+{
+    if (v.empty() || isspace((unsigned char)v[0])) {
+        throw std::invalid_argument("ScalarCast invalid number: " + v);
+    }
+}
+
+/// 检查 strto* 是否消费了整个字符串以及是否溢出
+static void CheckParsed(const std::string& v, const char* end)
+{
+    if (end != v.c_str() + v.size()) {
+        throw std::invalid_argument("ScalarCast invalid number: " + v);
+    }
+    if (errno == ERANGE) {
+        throw std::out_of_range("ScalarCast out of range: " + v);
+    }
+}
+
+int64_t ScalarCast::ParseInt64(const std::string& v)
+{
+    CheckNumber(v);
+    char* end = nullptr;
+    errno = 0;
+    long long rt = strtoll(v.c_str(), &end, 10);
+    CheckParsed(v, end);
+    return rt;
+}
+
+uint64_t ScalarCast::ParseUint64(const std::string& v)
+{
+    CheckNumber(v);
+    // strtoull 会把负数回绕成很大的正数
+    if (v[0] == '-') {
+        throw std::out_of_range("ScalarCast out of range: " + v);
+    }
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long rt = strtoull(v.c_str(), &end, 10);
+    CheckParsed(v, end);
+    return rt;
+}
+
+double ScalarCast::ParseDouble(const std::string& v)
+{
+    CheckNumber(v);
+    char* end = nullptr;
+    errno = 0;
+    double rt = strtod(v.c_str(), &end);
+    CheckParsed(v, end);
+    return rt;
+}
+
+float ScalarCast::ParseFloat(const std::string& v)
+{
+    CheckNumber(v);
+    char* end = nullptr;
+    errno = 0;
+    float rt = strtof(v.c_str(), &end);
+    CheckParsed(v, end);
+    return rt;
+}
+
+bool ScalarCast::ParseBool(const std::string& v)
+{
+    switch (v.size()) {
+    case 1:
+        if (v[0] == '1') {
+            return true;
+        } else if (v[0] == '0') {
+            return false;
+        }
+        break;
+    case 2:
+        if (!strcasecmp(v.c_str(), "on")) {
+            return true;
+        } else if (!strcasecmp(v.c_str(), "no")) {
+            return false;
+        }
+        break;
+    case 3:
+        if (!strcasecmp(v.c_str(), "yes")) {
+            return true;
+        } else if (!strcasecmp(v.c_str(), "off")) {
+            return false;
+        }
+        break;
+    case 4:
+        if (!strcasecmp(v.c_str(), "true")) {
+            return true;
+        }
+        break;
+    case 5:
+        if (!strcasecmp(v.c_str(), "false")) {
+            return false;
+        }
+        break;
+    }
+    throw std::invalid_argument("ScalarCast invalid bool: " + v);
+}
+
+std::string ScalarCast::FormatUint64(uint64_t v)
+{
+    char buf[24];
+    char* ptr = buf + sizeof(buf);
+    do {
+        *--ptr = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    return std::string(ptr, buf + sizeof(buf) - ptr);
+}
+
+std::string ScalarCast::FormatInt64(int64_t v)
+{
+    if (v >= 0) {
+        return FormatUint64(v);
+    }
+    // 先转成无符号再取反, 避免 INT64_MIN 取反溢出
+    std::string rt = FormatUint64(0 - (uint64_t)v);
+    rt.insert(rt.begin(), '-');
+    return rt;
+}
+
+std::string ScalarCast::FormatDouble(double v)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.17g", v);
+    return std::string(buf, len);
+}
+
+std::string ScalarCast::FormatFloat(float v)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.9g", v);
+    return std::string(buf, len);
+}
+
+constexpr uint32_t ConfigVarRegistry::npos;
+
+uint64_t ConfigKeyHash(const char* str, size_t len)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (uint8_t)str[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+ConfigVarRegistry::ConfigVarRegistry()
+    : m_table(nullptr)
+    , m_size(0)
+{
+    for (uint32_t i = 0; i < kMaxChunks; ++i) {
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+    m_tables.emplace_back(new Table(1024));
+    m_table.store(m_tables.back().get(), std::memory_order_release);
+}
+
+ConfigVarRegistry::~ConfigVarRegistry()
+{
+    for (uint32_t i = 0; i < kMaxChunks; ++i) {
+        delete[] m_chunks[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint32_t ConfigVarRegistry::find(const char* name, size_t len, uint64_t hash) const
+{
+    const Table* table = m_table.load(std::memory_order_acquire);
+    for (uint32_t pos = (uint32_t)hash & table->mask;; pos = (pos + 1) & table->mask) {
+        const Slot& slot = table->slots[pos];
+        uint32_t index = slot.index.load(std::memory_order_acquire);
+        if (index == 0) {
+            return npos;
+        }
+        if (slot.hash != hash) {
+            continue;
+        }
+        const std::string& var_name = at(index - 1)->getName();
+        if (var_name.size() == len && memcmp(var_name.c_str(), name, len) == 0) {
+            return index - 1;
+        }
+    }
+}
+
+void ConfigVarRegistry::place(Table* table, uint64_t hash, uint32_t index)
+{
+    uint32_t pos = (uint32_t)hash & table->mask;
+    while (table->slots[pos].index.load(std::memory_order_relaxed)) {
+        pos = (pos + 1) & table->mask;
+    }
+    table->slots[pos].hash = hash;
+    table->slots[pos].index.store(index + 1, std::memory_order_release);
+}
+
+uint32_t ConfigVarRegistry::insert(ConfigVarBase::ptr var, uint64_t hash)
+{
+    uint32_t index = m_size.load(std::memory_order_relaxed);
+    if ((index >> kChunkShift) >= kMaxChunks) {
+        throw std::length_error("too many config vars");
+    }
+    ConfigVarBase::ptr* chunk = m_chunks[index >> kChunkShift].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new ConfigVarBase::ptr[kChunkSize];
+        m_chunks[index >> kChunkShift].store(chunk, std::memory_order_release);
+    }
+    chunk[index & kChunkMask] = var;
+
+    Table* table = m_table.load(std::memory_order_relaxed);
+    if ((index + 1) * 2 > table->mask + 1) {
+        // 负载超过一半时扩容, 旧表仍可能被并发读取, 保留到析构
+        Table* bigger = new Table((table->mask + 1) * 2);
+        m_tables.emplace_back(bigger);
+        for (uint32_t i = 0; i < index; ++i) {
+            const ConfigVarBase::ptr& v = at(i);
+            place(bigger, ConfigKeyHash(v->getName().c_str(), v->getName().size()), i);
+        }
+        table = bigger;
+    }
+    place(table, hash, index);
+    m_table.store(table, std::memory_order_release);
+    m_size.store(index + 1, std::memory_order_release);
+    return index;
+}
+
 ConfigVarBase::ptr Config::LookupBase(const std::string& name)
 {
-    RWMutexType::ReadLock lock(GetMutex());
-    auto it = GetDatas().find(name);
-    return it == GetDatas().end() ? nullptr : it->second;
+    ConfigVarRegistry& registry = GetRegistry();
+    uint32_t index = registry.find(name.c_str(), name.size(),
+        ConfigKeyHash(name.c_str(), name.size()));
+    return index == ConfigVarRegistry::npos ? nullptr : registry.at(index);
+}
+
+uint32_t Config::Resolve(const ConfigKey& key)
+{
+    return GetRegistry().find(key.name, strlen(key.name), key.hash);
 }
 
 //"A.B", 10
@@ -30,55 +269,124 @@ ConfigVarBase::ptr Config::LookupBase(const std::string& name)
 //  B: 10
 //  C: str
 
-static void ListAllMember(const std::string& prefix,
+/// 比较两个YAML节点的内容是否相同
+static bool YamlEqual(const YAML::Node& lhs, const YAML::Node& rhs)
+{
+    if (!lhs.IsDefined() || !rhs.IsDefined()) {
+        return lhs.IsDefined() == rhs.IsDefined();
+    }
+    if (lhs.Type() != rhs.Type()) {
+        return false;
+    }
+    switch (lhs.Type()) {
+    case YAML::NodeType::Scalar:
+        return lhs.Scalar() == rhs.Scalar();
+    case YAML::NodeType::Sequence:
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            if (!YamlEqual(lhs[i], rhs[i])) {
+                return false;
+            }
+        }
+        return true;
+    case YAML::NodeType::Map:
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (auto it = lhs.begin();
+             it != lhs.end(); ++it) {
+            if (!YamlEqual(it->second, rhs[it->first.Scalar()])) {
+                return false;
+            }
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+/**
+ * @brief 遍历node, 把与old取值不同的配置项直接用节点更新到对应的配置参数
+ * @param[in,out] prefix 当前节点的配置名称, 遍历子节点时原地追加并在返回前恢复
+ * @details old未定义时更新全部配置项
+ */
+static void LoadChangedMember(std::string& prefix,
     const YAML::Node& node,
-    std::list<std::pair<std::string, const YAML::Node>>& output)
+    const YAML::Node& old)
 {
     if (prefix.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._012345678")
         != std::string::npos) {
         GEDUO_LOG_ERROR(g_logger) << "Config invalid name: " << prefix << " : " << node;
         return;
     }
-    output.push_back(std::make_pair(prefix, node));
+    if (YamlEqual(node, old)) {
+        return;
+    }
+    if (!prefix.empty()) {
+        ConfigVarBase::ptr var = Config::LookupBase(prefix);
+        if (var) {
+            var->fromNode(node);
+        }
+    }
     if (node.IsMap()) {
+        bool old_is_map = old.IsDefined() && old.IsMap();
+        size_t prefix_len = prefix.size();
         for (auto it = node.begin();
              it != node.end(); ++it) {
-            ListAllMember(prefix.empty() ? it->first.Scalar()
-                                         : prefix + "." + it->first.Scalar(),
-                it->second, output);
+            const std::string& key = it->first.Scalar();
+            if (!prefix.empty()) {
+                prefix.append(1, '.');
+            }
+            prefix.append(key);
+            LoadChangedMember(prefix, it->second,
+                old_is_map ? old[key] : YAML::Node(YAML::NodeType::Undefined));
+            prefix.resize(prefix_len);
         }
     }
 }
 
 void Config::LoadFromYaml(const YAML::Node& root)
 {
-    std::list<std::pair<std::string, const YAML::Node>> all_nodes;
-    ListAllMember("", root, all_nodes);
+    LoadFromYaml(root, YAML::Node(YAML::NodeType::Undefined));
+}
 
-    for (auto& i : all_nodes) {
-        std::string key = i.first;
-        if (key.empty()) {
-            continue;
-        }
+void Config::LoadFromYaml(const YAML::Node& root, const YAML::Node& old)
+{
+    std::string prefix;
+    prefix.reserve(128);
+    LoadChangedMember(prefix, root, old);
+}
 
-        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
-        ConfigVarBase::ptr var = LookupBase(key);
+static std::map<std::string, uint64_t> s_file2modifytime;
+/// 每个配置文件上一次加载的内容, 用于增量更新
+static std::map<std::string, YAML::Node> s_file2node;
+static geduo::Mutex s_mutex;
 
-        if (var) {
-            if (i.second.IsScalar()) {
-                var->fromString(i.second.Scalar());
-            } else {
-                std::stringstream ss;
-                ss << i.second;
-                var->fromString(ss.str());
+/// 加载单个配置文件, force为false时只更新与上次加载不同的配置项
+static void LoadConfFile(const std::string& file, bool force)
+{
+    try {
+        YAML::Node root = YAML::LoadFile(file);
+        YAML::Node old(YAML::NodeType::Undefined);
+        {
+            geduo::Mutex::Lock lock(s_mutex);
+            auto it = s_file2node.find(file);
+            if (!force && it != s_file2node.end()) {
+                old = it->second;
             }
+            s_file2node[file] = root;
         }
+        Config::LoadFromYaml(root, old);
+        GEDUO_LOG_INFO(g_logger) << "LoadConfFile file="
+                                 << file << " ok";
+    } catch (...) {
+        GEDUO_LOG_ERROR(g_logger) << "LoadConfFile file="
+                                  << file << " failed";
     }
 }
 
-static std::map<std::string, uint64_t> s_file2modifytime;
-static geduo::Mutex s_mutex;
-
 void Config::LoadFromConfDir(const std::string& path, bool force) {
     std::string absoulte_path = geduo::EnvMgr::GetInstance()->getAbsolutePath(path);
     std::vector<std::string> files;
@@ -94,24 +402,239 @@ void Config::LoadFromConfDir(const std::string& path, bool force) {
             }
             s_file2modifytime[i] = st.st_mtime;
         }
-        try {
-            YAML::Node root = YAML::LoadFile(i);
-            LoadFromYaml(root);
-            GEDUO_LOG_INFO(g_logger) << "LoadConfFile file="
-                                     << i << " ok";
-        } catch (...) {
-            GEDUO_LOG_ERROR(g_logger) << "LoadConfFile file="
-                                      << i << " failed";
+        LoadConfFile(i, force);
+    }
+}
+
+/**
+ * @brief 配置文件夹监听器
+ * @details 在独立线程中读取inotify事件, 合并debounce_ms内的连续变化,
+ *          然后把变化的文件交给协程调度器(或直接在监听线程中)增量加载
+ */
+class ConfDirWatcher {
+public:
+    typedef std::shared_ptr<ConfDirWatcher> ptr;
+
+    ConfDirWatcher(const std::string& path, Scheduler* scheduler, uint64_t debounce_ms)
+        : m_path(path)
+        , m_scheduler(scheduler)
+        , m_debounceMs(debounce_ms)
+    {
+    }
+
+    ~ConfDirWatcher()
+    {
+        stop();
+        if (m_inotifyFd >= 0) {
+            close(m_inotifyFd);
+        }
+        if (m_wakeFd >= 0) {
+            close(m_wakeFd);
+        }
+    }
+
+    bool start()
+    {
+        m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_inotifyFd < 0 || m_wakeFd < 0) {
+            GEDUO_LOG_ERROR(g_logger) << "ConfDirWatcher init fail errno=" << errno
+                                      << " errstr=" << strerror(errno);
+            return false;
+        }
+        if (!addWatch(m_path)) {
+            return false;
+        }
+        m_thread.reset(new Thread(std::bind(&ConfDirWatcher::run, this), "conf_watcher"));
+        return true;
+    }
+
+    void stop()
+    {
+        if (!m_thread) {
+            return;
+        }
+        m_stopping = true;
+        uint64_t one = 1;
+        if (write(m_wakeFd, &one, sizeof(one)) < 0) {
+            GEDUO_LOG_ERROR(g_logger) << "ConfDirWatcher wake fail errno=" << errno;
+        }
+        m_thread->join();
+        m_thread.reset();
+    }
+
+private:
+    /// 递归监听path及其子目录
+    bool addWatch(const std::string& path)
+    {
+        int wd = inotify_add_watch(m_inotifyFd, path.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF);
+        if (wd < 0) {
+            GEDUO_LOG_ERROR(g_logger) << "inotify_add_watch " << path << " fail errno="
+                                      << errno << " errstr=" << strerror(errno);
+            return false;
+        }
+        m_wd2dir[wd] = path;
+
+        DIR* dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return true;
+        }
+        struct dirent* dp = nullptr;
+        while ((dp = readdir(dir)) != nullptr) {
+            if (dp->d_type == DT_DIR
+                && strcmp(dp->d_name, ".")
+                && strcmp(dp->d_name, "..")) {
+                addWatch(path + "/" + dp->d_name);
+            }
+        }
+        closedir(dir);
+        return true;
+    }
+
+    /// 读取所有就绪的inotify事件, 记录变化的配置文件
+    void readEvents()
+    {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        while (true) {
+            ssize_t len = read(m_inotifyFd, buf, sizeof(buf));
+            if (len <= 0) {
+                break;
+            }
+            for (char* ptr = buf; ptr < buf + len;) {
+                const struct inotify_event* event = (const struct inotify_event*)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                auto it = m_wd2dir.find(event->wd);
+                if (it == m_wd2dir.end()) {
+                    continue;
+                }
+                if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                    m_wd2dir.erase(it);
+                    continue;
+                }
+                if (!event->len) {
+                    continue;
+                }
+                std::string file = it->second + "/" + event->name;
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        addWatch(file);
+                    }
+                    continue;
+                }
+                if (file.size() < 4 || file.compare(file.size() - 4, 4, ".yml") != 0) {
+                    continue;
+                }
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    if (m_pending.empty()) {
+                        m_deadline = GetCurrentMS() + m_debounceMs;
+                    }
+                    m_pending.insert(file);
+                }
+            }
+        }
+    }
+
+    /// 加载合并后的变化文件
+    void flush()
+    {
+        std::set<std::string> files;
+        files.swap(m_pending);
+        for (auto& i : files) {
+            struct stat st;
+            if (lstat(i.c_str(), &st)) {
+                continue;
+            }
+            {
+                geduo::Mutex::Lock lock(s_mutex);
+                s_file2modifytime[i] = st.st_mtime;
+            }
+            if (m_scheduler) {
+                m_scheduler->schedule(std::bind(&LoadConfFile, i, false));
+            } else {
+                LoadConfFile(i, false);
+            }
+        }
+    }
+
+    void run()
+    {
+        struct pollfd fds[2];
+        fds[0].fd = m_inotifyFd;
+        fds[0].events = POLLIN;
+        fds[1].fd = m_wakeFd;
+        fds[1].events = POLLIN;
+        while (!m_stopping) {
+            int timeout = -1;
+            if (!m_pending.empty()) {
+                uint64_t now = GetCurrentMS();
+                timeout = m_deadline > now ? (int)(m_deadline - now) : 0;
+            }
+            int rt = poll(fds, 2, timeout);
+            if (rt < 0 && errno != EINTR) {
+                GEDUO_LOG_ERROR(g_logger) << "ConfDirWatcher poll fail errno=" << errno
+                                          << " errstr=" << strerror(errno);
+                break;
+            }
+            if (rt > 0 && (fds[0].revents & POLLIN)) {
+                readEvents();
+            }
+            if (!m_pending.empty() && GetCurrentMS() >= m_deadline) {
+                flush();
+            }
         }
     }
+
+private:
+    /// 监听的配置文件夹
+    std::string m_path;
+    /// 执行重新加载的协程调度器
+    Scheduler* m_scheduler;
+    /// 合并连续变化的时间窗口(毫秒)
+    uint64_t m_debounceMs;
+    int m_inotifyFd = -1;
+    /// 用于唤醒监听线程退出
+    int m_wakeFd = -1;
+    /// inotify watch 描述符到目录的映射
+    std::map<int, std::string> m_wd2dir;
+    /// 等待加载的变化文件
+    std::set<std::string> m_pending;
+    /// 等待加载的截止时间(毫秒)
+    uint64_t m_deadline = 0;
+    std::atomic<bool> m_stopping { false };
+    Thread::ptr m_thread;
+};
+
+static ConfDirWatcher::ptr s_watcher;
+static geduo::Mutex s_watcher_mutex;
+
+bool Config::WatchConfDir(const std::string& path, Scheduler* scheduler, uint64_t debounce_ms)
+{
+    std::string absoulte_path = geduo::EnvMgr::GetInstance()->getAbsolutePath(path);
+    ConfDirWatcher::ptr watcher(new ConfDirWatcher(absoulte_path, scheduler, debounce_ms));
+    if (!watcher->start()) {
+        return false;
+    }
+    geduo::Mutex::Lock lock(s_watcher_mutex);
+    s_watcher.swap(watcher);
+    return true;
+}
+
+void Config::UnwatchConfDir()
+{
+    ConfDirWatcher::ptr watcher;
+    {
+        geduo::Mutex::Lock lock(s_watcher_mutex);
+        watcher.swap(s_watcher);
+    }
 }
 
 void Config::Visit(std::function<void(ConfigVarBase::ptr)> cb) {
-    RWMutexType::ReadLock lock(GetMutex());
-    ConfigVarMap& m = GetDatas();
-    for (auto it = m.begin();
-         it != m.end(); ++it) {
-        cb(it->second);
+    ConfigVarRegistry& registry = GetRegistry();
+    uint32_t size = registry.size();
+    for (uint32_t i = 0; i < size; ++i) {
+        cb(registry.at(i));
     }
 }
 
@@ -10,14 +10,18 @@
 #ifndef __GEDUO_CONFIG_H__
 #define __GEDUO_CONFIG_H__
 
+#include <atomic>
 #include <boost/lexical_cast.hpp>
 #include <functional>
+#include <limits>
 #include <list>
 #include <map>
 #include <memory>
 #include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -29,6 +33,8 @@
 
 namespace geduo {
 
+class Scheduler;
+
 /**
  * @brief 配置变量的基类
  */
@@ -60,9 +66,32 @@ public:
     /// @brief 从字符串初始化值
     virtual bool fromString(const std::string& val) = 0;
 
+    /// @brief 从YAML节点初始化值
+    virtual bool fromNode(const YAML::Node& node) = 0;
+
     /// @brief 返回配置参数值的类型名称
     virtual std::string getTypeName() const = 0;
 
+    /// @brief 返回全局配置版本号, 任一配置参数的值发生变化时递增
+    static uint64_t GetGlobalVersion()
+    {
+        return GetVersion().load(std::memory_order_acquire);
+    }
+
+protected:
+    /// @brief 递增全局配置版本号, 在新值发布之后调用
+    static void IncGlobalVersion()
+    {
+        GetVersion().fetch_add(1, std::memory_order_release);
+    }
+
+private:
+    static std::atomic<uint64_t>& GetVersion()
+    {
+        static std::atomic<uint64_t> s_version { 0 };
+        return s_version;
+    }
+
 protected:
     /// 配置参数的名称
     std::string m_name;
@@ -86,24 +115,135 @@ public:
     }
 };
 
-/// @brief 类型转换模板类片特化(YAML String 转换成 std::vector<T>)
+/**
+ * @brief 标量与字符串之间的快速转换, 基于 strto* / 手写整数格式化, 不经过 iostream
+ * @details 解析要求整个字符串都是合法数值(不允许前后空白), 否则抛出 std::invalid_argument,
+ *          超出范围抛出 std::out_of_range
+ */
+class ScalarCast {
+public:
+    static int64_t ParseInt64(const std::string& v);
+    static uint64_t ParseUint64(const std::string& v);
+    static double ParseDouble(const std::string& v);
+    static float ParseFloat(const std::string& v);
+    /// @brief 支持 1/0, true/false, yes/no, on/off(不区分大小写)
+    static bool ParseBool(const std::string& v);
+
+    static std::string FormatInt64(int64_t v);
+    static std::string FormatUint64(uint64_t v);
+    /// @brief 保留 17 位有效数字, 与 boost::lexical_cast 一致, 可无损往返
+    static std::string FormatDouble(double v);
+    /// @brief 保留 9 位有效数字, 与 boost::lexical_cast 一致, 可无损往返
+    static std::string FormatFloat(float v);
+
+    /// @brief 解析有符号整数并检查目标类型的范围
+    template <class T>
+    static T ParseSigned(const std::string& v)
+    {
+        int64_t rt = ParseInt64(v);
+        if (rt < (int64_t)std::numeric_limits<T>::min()
+            || rt > (int64_t)std::numeric_limits<T>::max()) {
+            throw std::out_of_range("ScalarCast out of range: " + v);
+        }
+        return (T)rt;
+    }
+
+    /// @brief 解析无符号整数并检查目标类型的范围
+    template <class T>
+    static T ParseUnsigned(const std::string& v)
+    {
+        uint64_t rt = ParseUint64(v);
+        if (rt > (uint64_t)std::numeric_limits<T>::max()) {
+            throw std::out_of_range("ScalarCast out of range: " + v);
+        }
+        return (T)rt;
+    }
+};
+
+/// @brief 类型转换模板类特化(std::string 转换成 std::string), 直接拷贝
+template <>
+class LexicalCast<std::string, std::string> {
+public:
+    std::string operator()(const std::string& v)
+    {
+        return v;
+    }
+};
+
+#define XX(type, parse, format)                                 \
+    template <>                                                 \
+    class LexicalCast<std::string, type> {                      \
+    public:                                                     \
+        type operator()(const std::string& v)                   \
+        {                                                       \
+            return parse;                                       \
+        }                                                       \
+    };                                                          \
+    template <>                                                 \
+    class LexicalCast<type, std::string> {                      \
+    public:                                                     \
+        std::string operator()(const type& v)                   \
+        {                                                       \
+            return format;                                      \
+        }                                                       \
+    };
+
+XX(short, ScalarCast::ParseSigned<short>(v), ScalarCast::FormatInt64(v))
+XX(int, ScalarCast::ParseSigned<int>(v), ScalarCast::FormatInt64(v))
+XX(long, ScalarCast::ParseSigned<long>(v), ScalarCast::FormatInt64(v))
+XX(long long, ScalarCast::ParseSigned<long long>(v), ScalarCast::FormatInt64(v))
+XX(unsigned short, ScalarCast::ParseUnsigned<unsigned short>(v), ScalarCast::FormatUint64(v))
+XX(unsigned int, ScalarCast::ParseUnsigned<unsigned int>(v), ScalarCast::FormatUint64(v))
+XX(unsigned long, ScalarCast::ParseUnsigned<unsigned long>(v), ScalarCast::FormatUint64(v))
+XX(unsigned long long, ScalarCast::ParseUnsigned<unsigned long long>(v), ScalarCast::FormatUint64(v))
+XX(float, ScalarCast::ParseFloat(v), ScalarCast::FormatFloat(v))
+XX(double, ScalarCast::ParseDouble(v), ScalarCast::FormatDouble(v))
+XX(bool, ScalarCast::ParseBool(v), std::string(v ? "1" : "0"))
+#undef XX
+
+/**
+ * @brief 类型转换模板类片特化(YAML::Node 转换成 T)
+ * @details 标量直接转换, 其余节点序列化成 YAML String 后交给 LexicalCast<std::string, T>
+ */
 template <class T>
-class LexicalCast<std::string, std::vector<T>> {
+class LexicalCast<YAML::Node, T> {
 public:
-    std::vector<T> operator()(const std::string& v)
+    T operator()(const YAML::Node& v)
     {
-        YAML::Node node = YAML::Load(v);
-        typename std::vector<T> vec;
+        if (v.IsScalar()) {
+            return LexicalCast<std::string, T>()(v.Scalar());
+        }
         std::stringstream ss;
+        ss << v;
+        return LexicalCast<std::string, T>()(ss.str());
+    }
+};
+
+/// @brief 类型转换模板类片特化(YAML::Node 转换成 std::vector<T>)
+template <class T>
+class LexicalCast<YAML::Node, std::vector<T>> {
+public:
+    std::vector<T> operator()(const YAML::Node& node)
+    {
+        typename std::vector<T> vec;
+        vec.reserve(node.size());
         for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.push_back(LexicalCast<std::string, T>()(ss.str()));
+            vec.push_back(LexicalCast<YAML::Node, T>()(node[i]));
         }
         return vec;
     }
 };
 
+/// @brief 类型转换模板类片特化(YAML String 转换成 std::vector<T>)
+template <class T>
+class LexicalCast<std::string, std::vector<T>> {
+public:
+    std::vector<T> operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, std::vector<T>>()(YAML::Load(v));
+    }
+};
+
 /// @brief 类型转换模板类片特化(std::vector<T> 转换成 YAML String)
 template <class T>
 class LexicalCast<std::vector<T>, std::string> {
@@ -120,24 +260,30 @@ public:
     }
 };
 
-/// @brief 类型转换模板类片特化(YAML String 转换成 std::list<T>)
+/// @brief 类型转换模板类片特化(YAML::Node 转换成 std::list<T>)
 template <class T>
-class LexicalCast<std::string, std::list<T>> {
+class LexicalCast<YAML::Node, std::list<T>> {
 public:
-    std::list<T> operator()(const std::string& v)
+    std::list<T> operator()(const YAML::Node& node)
     {
-        YAML::Node node = YAML::Load(v);
         typename std::list<T> vec;
-        std::stringstream ss;
         for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.push_back(LexicalCast<std::string, T>()(ss.str()));
+            vec.push_back(LexicalCast<YAML::Node, T>()(node[i]));
         }
         return vec;
     }
 };
 
+/// @brief 类型转换模板类片特化(YAML String 转换成 std::list<T>)
+template <class T>
+class LexicalCast<std::string, std::list<T>> {
+public:
+    std::list<T> operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, std::list<T>>()(YAML::Load(v));
+    }
+};
+
 /// @brief 类型转换模板类片特化(std::list<T> 转换成 YAML String)
 template <class T>
 class LexicalCast<std::list<T>, std::string> {
@@ -154,24 +300,30 @@ public:
     }
 };
 
-/// @brief 类型转换模板类片特化(YAML String 转换成 std::set<T>)
+/// @brief 类型转换模板类片特化(YAML::Node 转换成 std::set<T>)
 template <class T>
-class LexicalCast<std::string, std::set<T>> {
+class LexicalCast<YAML::Node, std::set<T>> {
 public:
-    std::set<T> operator()(const std::string& v)
+    std::set<T> operator()(const YAML::Node& node)
     {
-        YAML::Node node = YAML::Load(v);
         typename std::set<T> vec;
-        std::stringstream ss;
         for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.insert(LexicalCast<std::string, T>()(ss.str()));
+            vec.insert(LexicalCast<YAML::Node, T>()(node[i]));
         }
         return vec;
     }
 };
 
+/// @brief 类型转换模板类片特化(YAML String 转换成 std::set<T>)
+template <class T>
+class LexicalCast<std::string, std::set<T>> {
+public:
+    std::set<T> operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, std::set<T>>()(YAML::Load(v));
+    }
+};
+
 /// @brief 类型转换模板类片特化(std::set<T> 转换成 YAML String)
 template <class T>
 class LexicalCast<std::set<T>, std::string> {
@@ -188,24 +340,30 @@ public:
     }
 };
 
-/// @brief 类型转换模板类片特化(YAML String 转换成 std::unordered_set<T>)
+/// @brief 类型转换模板类片特化(YAML::Node 转换成 std::unordered_set<T>)
 template <class T>
-class LexicalCast<std::string, std::unordered_set<T>> {
+class LexicalCast<YAML::Node, std::unordered_set<T>> {
 public:
-    std::unordered_set<T> operator()(const std::string& v)
+    std::unordered_set<T> operator()(const YAML::Node& node)
     {
-        YAML::Node node = YAML::Load(v);
         typename std::unordered_set<T> vec;
-        std::stringstream ss;
         for (size_t i = 0; i < node.size(); ++i) {
-            ss.str("");
-            ss << node[i];
-            vec.insert(LexicalCast<std::string, T>()(ss.str()));
+            vec.insert(LexicalCast<YAML::Node, T>()(node[i]));
         }
         return vec;
     }
 };
 
+/// @brief 类型转换模板类片特化(YAML String 转换成 std::unordered_set<T>)
+template <class T>
+class LexicalCast<std::string, std::unordered_set<T>> {
+public:
+    std::unordered_set<T> operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, std::unordered_set<T>>()(YAML::Load(v));
+    }
+};
+
 /// @brief 类型转换模板类片特化(std::unordered_set<T> 转换成 YAML String)
 template <class T>
 class LexicalCast<std::unordered_set<T>, std::string> {
@@ -222,26 +380,32 @@ public:
     }
 };
 
-/// @brief 类型转换模板类片特化(YAML String 转换成 std::map<std::string, T>)
+/// @brief 类型转换模板类片特化(YAML::Node 转换成 std::map<std::string, T>)
 template <class T>
-class LexicalCast<std::string, std::map<std::string, T>> {
+class LexicalCast<YAML::Node, std::map<std::string, T>> {
 public:
-    std::map<std::string, T> operator()(const std::string& v)
+    std::map<std::string, T> operator()(const YAML::Node& node)
     {
-        YAML::Node node = YAML::Load(v);
         typename std::map<std::string, T> vec;
-        std::stringstream ss;
         for (auto it = node.begin();
              it != node.end(); ++it) {
-            ss.str("");
-            ss << it->second;
             vec.insert(std::make_pair(it->first.Scalar(),
-                LexicalCast<std::string, T>()(ss.str())));
+                LexicalCast<YAML::Node, T>()(it->second)));
         }
         return vec;
     }
 };
 
+/// @brief 类型转换模板类片特化(YAML String 转换成 std::map<std::string, T>)
+template <class T>
+class LexicalCast<std::string, std::map<std::string, T>> {
+public:
+    std::map<std::string, T> operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, std::map<std::string, T>>()(YAML::Load(v));
+    }
+};
+
 /// @brief 类型转换模板类片特化(std::map<std::string, T> 转换成 YAML String)
 template <class T>
 class LexicalCast<std::map<std::string, T>, std::string> {
@@ -258,26 +422,32 @@ public:
     }
 };
 
-/// @brief 类型转换模板类片特化(YAML String 转换成 std::unordered_map<std::string, T>)
+/// @brief 类型转换模板类片特化(YAML::Node 转换成 std::unordered_map<std::string, T>)
 template <class T>
-class LexicalCast<std::string, std::unordered_map<std::string, T>> {
+class LexicalCast<YAML::Node, std::unordered_map<std::string, T>> {
 public:
-    std::unordered_map<std::string, T> operator()(const std::string& v)
+    std::unordered_map<std::string, T> operator()(const YAML::Node& node)
     {
-        YAML::Node node = YAML::Load(v);
         typename std::unordered_map<std::string, T> vec;
-        std::stringstream ss;
         for (auto it = node.begin();
              it != node.end(); ++it) {
-            ss.str("");
-            ss << it->second;
             vec.insert(std::make_pair(it->first.Scalar(),
-                LexicalCast<std::string, T>()(ss.str())));
+                LexicalCast<YAML::Node, T>()(it->second)));
         }
         return vec;
     }
 };
 
+/// @brief 类型转换模板类片特化(YAML String 转换成 std::unordered_map<std::string, T>)
+template <class T>
+class LexicalCast<std::string, std::unordered_map<std::string, T>> {
+public:
+    std::unordered_map<std::string, T> operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, std::unordered_map<std::string, T>>()(YAML::Load(v));
+    }
+};
+
 /// @brief 类型转换模板类片特化(std::unordered_map<std::string, T> 转换成 YAML String)
 template <class T>
 class LexicalCast<std::unordered_map<std::string, T>, std::string> {
@@ -294,19 +464,53 @@ public:
     }
 };
 
+/**
+ * @brief 参数值的原子副本
+ * @details 可平凡复制且不超过 8 字节的类型(整数、浮点、bool、枚举等)保存一份 std::atomic<T>,
+ *          读取不加锁也不碰引用计数; 其他类型不保存, load 调用 fallback
+ */
+template <class T, bool = std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(uint64_t)>
+class ConfigAtomicValue {
+public:
+    explicit ConfigAtomicValue(const T&) {}
+    void store(const T&) {}
+    /// @brief 没有原子副本, 由 fallback 读取
+    template <class F>
+    T load(const F& fallback) const { return fallback(); }
+};
+
+template <class T>
+class ConfigAtomicValue<T, true> {
+public:
+    explicit ConfigAtomicValue(const T& v)
+        : m_val(v)
+    {
+    }
+    void store(const T& v) { m_val.store(v, std::memory_order_release); }
+    template <class F>
+    T load(const F&) const { return m_val.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<T> m_val;
+};
+
 /**
  * @brief 配置参数模板子类,保存对应类型的参数值
  * @details T 参数的具体类型
  *          FromStr 从std::string转换成T类型的仿函数
  *          ToStr 从T转换成std::string的仿函数
+ *          FromNode 从YAML::Node转换成T类型的仿函数
  *          std::string 为YAML格式的字符串
  */
-template <class T, class FromStr = LexicalCast<std::string, T>, class ToStr = LexicalCast<T, std::string>>
+template <class T, class FromStr = LexicalCast<std::string, T>, class ToStr = LexicalCast<T, std::string>,
+    class FromNode = LexicalCast<YAML::Node, T>>
 class ConfigVar : public ConfigVarBase {
 public:
 
     typedef RWMutex RWMutexType;
     typedef std::shared_ptr<ConfigVar> ptr;
+    /// 参数值的不可变快照
+    typedef std::shared_ptr<const T> snapshot_ptr;
     typedef std::function<void(const T& old_value, const T& new_value)> on_change_cb;
 
     /**
@@ -317,7 +521,8 @@ public:
      */
     ConfigVar(const std::string& name, const T& default_value, const std::string& description = "")
         : ConfigVarBase(name, description)
-        , m_val(default_value)
+        , m_val(std::make_shared<const T>(default_value))
+        , m_atomicVal(default_value)
     {
     }
 
@@ -329,8 +534,7 @@ public:
     {
         try {
             //return boost::lexical_cast<std::string>(m_val);
-            RWMutexType::ReadLock lock(m_mutex);
-            return ToStr()(m_val);
+            return ToStr()(*getSnapshot());
         } catch (std::exception& e) {
             GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "ConfigVar::toString exception "
                                               << e.what() << " convert: " << TypeToName<T>() << " to string"
@@ -347,6 +551,7 @@ public:
     {
         try {
             setValue(FromStr()(val));
+            return true;
         } catch (std::exception& e) {
             GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "ConfigVar::fromString exception "
                                               << e.what() << " convert: string to " << TypeToName<T>()
@@ -356,32 +561,69 @@ public:
         return false;
     }
 
+    /**
+     * @brief 从YAML节点直接转成参数的值, 不经过 YAML String
+     * @exception 当转换失败抛出异常
+     */
+    bool fromNode(const YAML::Node& node) override
+    {
+        try {
+            setValue(FromNode()(node));
+            return true;
+        } catch (std::exception& e) {
+            GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "ConfigVar::fromNode exception "
+                                              << e.what() << " convert: node to " << TypeToName<T>()
+                                              << " name=" << m_name
+                                              << " - " << node;
+        }
+        return false;
+    }
+
     /**
      * @brief 获取当前参数的值
+     * @details 小的标量类型读原子副本, 不加锁; 其他类型经 getSnapshot 复制一份,
+     *          热路径上应使用 ConfigVarCache
      */
-    const T getValue()
+    T getValue() const
     {
-        RWMutexType::ReadLock lock(m_mutex);
-        return m_val;
+        return m_atomicVal.load([this]() { return *getSnapshot(); });
+    }
+
+    /**
+     * @brief 获取当前参数值的快照
+     * @details 快照发布后不再修改, 可长期持有. libstdc++ 的 shared_ptr 原子读写
+     *          借助全局互斥锁池实现, 每次调用仍有加锁和引用计数的开销,
+     *          热路径上应使用 ConfigVarCache
+     */
+    snapshot_ptr getSnapshot() const
+    {
+        return std::atomic_load_explicit(&m_val, std::memory_order_acquire);
     }
 
     /**
      * @brief 设置当前参数的值
-     * @details 如果参数的值有发生变化,则通知对应的注册回调函数
+     * @details 如果参数的值有发生变化,则通知对应的注册回调函数,
+     *          然后发布新的快照并递增全局配置版本号
      */
     void setValue(const T& v)
     {
+        Mutex::Lock write_lock(m_writeMutex);
+        snapshot_ptr old_val = getSnapshot();
+        if (v == *old_val) {
+            return;
+        }
+        std::map<uint64_t, on_change_cb> cbs;
         {
             RWMutexType::ReadLock lock(m_mutex);
-            if (v == m_val) {
-                return;
-            }
-            for (auto& i : m_cbs) {
-                i.second(m_val, v);
-            }
+            cbs = m_cbs;
         }
-        RWMutexType::WriteLock lock(m_mutex);
-        m_val = v;
+        for (auto& i : cbs) {
+            i.second(*old_val, v);
+        }
+        std::atomic_store_explicit(&m_val, snapshot_ptr(std::make_shared<const T>(v)),
+            std::memory_order_release);
+        m_atomicVal.store(v);
+        IncGlobalVersion();
     }
 
     /**
@@ -434,19 +676,180 @@ public:
     }
 
 private:
+    /// 保护回调函数组
     RWMutexType m_mutex;
-    T m_val;
+    /// 串行化写入, 保证比较与发布的原子性
+    Mutex m_writeMutex;
+    /// 当前值的快照, 通过 atomic_load/atomic_store 访问
+    snapshot_ptr m_val;
+    /// 小的标量类型的原子副本, 供 getValue 无锁读取
+    ConfigAtomicValue<T> m_atomicVal;
     //变更回调函数组, uint64_t key,要求唯一，一般可以用hash
     std::map<uint64_t, on_change_cb> m_cbs;
 };
 
+/**
+ * @brief 配置参数值的本地缓存
+ * @details 缓存配置参数的快照, 只有全局配置版本号变化时才重新加载,
+ *          读路径只有一次原子读, 一般声明为 thread_local 在热路径使用
+ */
+template <class T>
+class ConfigVarCache {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] var 被缓存的配置参数
+     */
+    ConfigVarCache(typename ConfigVar<T>::ptr var)
+        : m_var(var)
+    {
+    }
+
+    /**
+     * @brief 获取缓存的参数值
+     */
+    const T& get()
+    {
+        uint64_t version = ConfigVarBase::GetGlobalVersion();
+        if (!m_snapshot || version != m_version) {
+            m_version = version;
+            m_snapshot = m_var->getSnapshot();
+        }
+        return *m_snapshot;
+    }
+
+private:
+    /// 被缓存的配置参数
+    typename ConfigVar<T>::ptr m_var;
+    /// 缓存的快照
+    typename ConfigVar<T>::snapshot_ptr m_snapshot;
+    /// 缓存快照对应的全局配置版本号
+    uint64_t m_version = 0;
+};
+
+/// @brief FNV-1a 64位哈希的递归实现
+constexpr uint64_t ConfigKeyHashImpl(const char* str, uint64_t hash)
+{
+    return *str ? ConfigKeyHashImpl(str + 1, (hash ^ (uint8_t)*str) * 1099511628211ull) : hash;
+}
+
+/**
+ * @brief 计算配置参数名称的哈希值(FNV-1a 64位)
+ * @details constexpr 实现, 字面量名称在编译期完成计算
+ */
+constexpr uint64_t ConfigKeyHash(const char* str)
+{
+    return ConfigKeyHashImpl(str, 14695981039346656037ull);
+}
+
+/**
+ * @brief 计算配置参数名称的哈希值, 与 ConfigKeyHash(const char*) 结果相同
+ */
+uint64_t ConfigKeyHash(const char* str, size_t len);
+
+/**
+ * @brief 配置参数名称, 保存名称及其编译期哈希值
+ */
+struct ConfigKey {
+    constexpr ConfigKey(const char* n)
+        : name(n)
+        , hash(ConfigKeyHash(n))
+    {
+    }
+
+    /// 配置参数名称
+    const char* name;
+    /// 配置参数名称的哈希值
+    uint64_t hash;
+};
+
+/**
+ * @brief 配置参数注册表
+ * @details 配置参数保存在分块数组中, 下标一经分配便不再变化;
+ *          名称到下标的映射为开放寻址哈希表, 扩容时发布新表, 旧表保留不释放,
+ *          因此查找无锁, 插入需要调用者串行化
+ */
+class ConfigVarRegistry : Noncopyable {
+public:
+    /// 无效下标
+    static constexpr uint32_t npos = 0xffffffff;
+
+    ConfigVarRegistry();
+    ~ConfigVarRegistry();
+
+    /**
+     * @brief 查找配置参数的下标(无锁)
+     * @param[in] name 配置参数名称
+     * @param[in] len 名称长度
+     * @param[in] hash 名称的哈希值
+     * @return 不存在返回 npos
+     */
+    uint32_t find(const char* name, size_t len, uint64_t hash) const;
+
+    /**
+     * @brief 返回下标对应的配置参数(无锁)
+     * @pre index 由 find 或 insert 返回
+     */
+    const ConfigVarBase::ptr& at(uint32_t index) const
+    {
+        return m_chunks[index >> kChunkShift].load(std::memory_order_acquire)[index & kChunkMask];
+    }
+
+    /**
+     * @brief 插入配置参数, 调用者需持有写锁且保证名称不存在
+     * @return 返回分配的下标
+     * @exception 超过最大容量时抛出 std::length_error
+     */
+    uint32_t insert(ConfigVarBase::ptr var, uint64_t hash);
+
+    /// @brief 返回配置参数数量
+    uint32_t size() const { return m_size.load(std::memory_order_acquire); }
+
+private:
+    /// 哈希表槽位
+    struct Slot {
+        /// 配置参数下标 + 1, 0 表示空槽
+        std::atomic<uint32_t> index { 0 };
+        /// 名称的哈希值, 在发布 index 之前写入
+        uint64_t hash = 0;
+    };
+
+    /// 开放寻址哈希表
+    struct Table {
+        Table(uint32_t capacity)
+            : mask(capacity - 1)
+            , slots(new Slot[capacity])
+        {
+        }
+        uint32_t mask;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    /// 把下标放入哈希表
+    static void place(Table* table, uint64_t hash, uint32_t index);
+
+private:
+    static const uint32_t kChunkShift = 8;
+    static const uint32_t kChunkSize = 1u << kChunkShift;
+    static const uint32_t kChunkMask = kChunkSize - 1;
+    static const uint32_t kMaxChunks = 1024;
+
+    /// 配置参数分块数组
+    std::atomic<ConfigVarBase::ptr*> m_chunks[kMaxChunks];
+    /// 当前哈希表
+    std::atomic<Table*> m_table;
+    /// 所有哈希表(包括已替换的旧表), 析构时释放
+    std::vector<std::unique_ptr<Table>> m_tables;
+    /// 配置参数数量
+    std::atomic<uint32_t> m_size;
+};
+
 /**
  * @brief ConfigVar的管理类
  * @details 提供便捷的方法创建/访问ConfigVar
  */
 class Config {
 public:
-    typedef std::unordered_map<std::string, ConfigVarBase::ptr> ConfigVarMap;
     typedef RWMutex RWMutexType;
 
     /**
@@ -463,60 +866,90 @@ public:
     static typename ConfigVar<T>::ptr Lookup(const std::string& name,
         const T& default_value, const std::string& description = "")
     {
-        RWMutexType::WriteLock lock(GetMutex());
-        auto it = GetDatas().find(name);
-        if (it != GetDatas().end()) {
-            auto tmp = std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
-            if (tmp) {
-                GEDUO_LOG_INFO(GEDUO_LOG_ROOT()) << "Lookup name=" << name << " exists";
-                return tmp;
-            } else {
-                GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "Lookup name=" << name << " exists but type not "
-                                                  << TypeToName<T>() << " real_type=" << it->second->getTypeName()
-                                                  << " " << it->second->toString();
-                return nullptr;
+        uint64_t hash = ConfigKeyHash(name.c_str(), name.size());
+        uint32_t index = GetRegistry().find(name.c_str(), name.size(), hash);
+        if (index == ConfigVarRegistry::npos) {
+            RWMutexType::WriteLock lock(GetMutex());
+            index = GetRegistry().find(name.c_str(), name.size(), hash);
+            if (index == ConfigVarRegistry::npos) {
+                if (name.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._012345678")
+                    != std::string::npos) {
+                    GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "Lookup name invalid " << name;
+                    throw std::invalid_argument(name);
+                }
+
+                typename ConfigVar<T>::ptr v(new ConfigVar<T>(name, default_value, description));
+                GetRegistry().insert(v, hash);
+                return v;
             }
         }
 
-        if (name.find_first_not_of("abcdefghikjlmnopqrstuvwxyz._012345678")
-            != std::string::npos) {
-            GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "Lookup name invalid " << name;
-            throw std::invalid_argument(name);
+        const ConfigVarBase::ptr& var = GetRegistry().at(index);
+        auto tmp = std::dynamic_pointer_cast<ConfigVar<T>>(var);
+        if (tmp) {
+            GEDUO_LOG_INFO(GEDUO_LOG_ROOT()) << "Lookup name=" << name << " exists";
+            return tmp;
         }
-
-        typename ConfigVar<T>::ptr v(new ConfigVar<T>(name, default_value, description));
-        GetDatas()[name] = v;
-        return v;
+        GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "Lookup name=" << name << " exists but type not "
+                                          << TypeToName<T>() << " real_type=" << var->getTypeName()
+                                          << " " << var->toString();
+        return nullptr;
     }
 
     /**
-     * @brief 查找配置参数
+     * @brief 查找配置参数(无锁)
      * @param[in] name 配置参数名称
      * @return 返回配置参数名为name的配置参数
      */
     template <class T>
     static typename ConfigVar<T>::ptr Lookup(const std::string& name)
     {
-        RWMutexType::ReadLock lock(GetMutex());
-        auto it = GetDatas().find(name);
-        if (it == GetDatas().end()) {
-            return nullptr;
-        }
-        return std::dynamic_pointer_cast<ConfigVar<T>>(it->second);
+        return std::dynamic_pointer_cast<ConfigVar<T>>(LookupBase(name));
     }
 
+    /**
+     * @brief 查找配置参数的稳定下标(无锁)
+     * @param[in] key 配置参数名称
+     * @return 不存在返回 ConfigVarRegistry::npos
+     */
+    static uint32_t Resolve(const ConfigKey& key);
+
     /**
      * @brief 使用YAML::Node初始化配置模块
      */
     static void LoadFromYaml(const YAML::Node& root);
 
+    /**
+     * @brief 使用YAML::Node增量更新配置模块
+     * @param[in] root 新的配置
+     * @param[in] old 上一次加载的配置
+     * @details 只有与old中取值不同的配置项才会调用fromNode
+     */
+    static void LoadFromYaml(const YAML::Node& root, const YAML::Node& old);
+
     /**
      * @brief 加载path文件夹里面的配置文件
+     * @details 只重新解析修改过的文件, force为true时全部重新加载
      */
     static void LoadFromConfDir(const std::string& path, bool force = false);
 
     /**
-     * @brief 查找配置参数,返回配置参数的基类
+     * @brief 使用inotify监听path文件夹里面的配置文件, 变化时自动增量加载
+     * @param[in] path 配置文件夹
+     * @param[in] scheduler 执行重新加载的协程调度器, 为nullptr时在监听线程中执行
+     * @param[in] debounce_ms 合并连续变化的时间窗口(毫秒)
+     * @return 是否监听成功, 已存在的监听会被替换
+     */
+    static bool WatchConfDir(const std::string& path, Scheduler* scheduler = nullptr,
+        uint64_t debounce_ms = 200);
+
+    /**
+     * @brief 停止监听配置文件夹
+     */
+    static void UnwatchConfDir();
+
+    /**
+     * @brief 查找配置参数,返回配置参数的基类(无锁)
      * @param[in] name 配置参数名称
      */
     static ConfigVarBase::ptr LookupBase(const std::string& name);
@@ -528,17 +961,20 @@ public:
     static void Visit(std::function<void(ConfigVarBase::ptr)> cb);
 
 private:
+    template <class T>
+    friend class ConfigVarHandle;
+
     /**
      * @brief 返回所有的配置项
      */
-    static ConfigVarMap& GetDatas()
+    static ConfigVarRegistry& GetRegistry()
     {
-        static ConfigVarMap s_datas;
-        return s_datas;
+        static ConfigVarRegistry s_registry;
+        return s_registry;
     }
 
     /**
-     * @brief 配置项的RWMutex
+     * @brief 配置项的RWMutex, 串行化配置项的插入
      */
     static RWMutexType& GetMutex()
     {
@@ -547,6 +983,54 @@ private:
     }
 };
 
+/**
+ * @brief 配置参数句柄
+ * @details 首次访问时把名称解析为注册表中的稳定下标, 之后每次访问只是一次下标读取,
+ *          一般以字面量名称声明为静态变量, 名称哈希在编译期完成
+ */
+template <class T>
+class ConfigVarHandle {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] name 配置参数名称
+     */
+    constexpr ConfigVarHandle(const char* name)
+        : m_key(name)
+        , m_index(ConfigVarRegistry::npos)
+    {
+    }
+
+    /**
+     * @brief 返回配置参数
+     * @return 配置参数不存在或类型不匹配时返回nullptr
+     */
+    ConfigVar<T>* get()
+    {
+        uint32_t index = m_index.load(std::memory_order_acquire);
+        if (index == ConfigVarRegistry::npos) {
+            index = Config::Resolve(m_key);
+            if (index == ConfigVarRegistry::npos
+                || !dynamic_cast<ConfigVar<T>*>(Config::GetRegistry().at(index).get())) {
+                return nullptr;
+            }
+            m_index.store(index, std::memory_order_release);
+        }
+        return static_cast<ConfigVar<T>*>(Config::GetRegistry().at(index).get());
+    }
+
+    ConfigVar<T>* operator->() { return get(); }
+
+    /// @brief 返回配置参数名称
+    const char* getName() const { return m_key.name; }
+
+private:
+    /// 配置参数名称
+    ConfigKey m_key;
+    /// 解析后的下标
+    std::atomic<uint32_t> m_index;
+};
+
 }
 
 #endif
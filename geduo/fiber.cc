@@ -5,9 +5,17 @@
  * @LastEditTime: 2020-06-26 00:56:03
  * @Description: file content
  */ 
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
 
 #include "fiber.h"
+#include "clock.h"
 #include "config.h"
 #include "macro.h"
 #include "log.h"
@@ -26,6 +34,9 @@ static thread_local Fiber::ptr t_threadFiber = nullptr;
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size = 
     Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack size");
 
+/// 协程栈大小的线程本地缓存, 避免每次构造协程都读取配置
+static thread_local ConfigVarCache<uint32_t> t_fiber_stack_size(g_fiber_stack_size);
+
 class MallocStackAllocator {
 public:
     static void* Alloc(size_t size) {
@@ -44,6 +55,66 @@ uint64_t Fiber::GetFiberId() {
     return 0;
 }
 
+bool Fiber::CanYield() {
+    // use_caller 时调用线程的主协程不是调度协程, 让出后不会被切回, 同样只能阻塞线程
+    return Scheduler::GetThis() && t_fiber && t_fiber != Scheduler::GetMainFiber()
+        && t_fiber != t_threadFiber.get();
+}
+
+static std::atomic<uint32_t> s_local_key_count {0};
+static void (*s_local_dtors[Fiber::kMaxLocalKeys])(void*);
+
+uint32_t Fiber::AllocLocalKey(void (*dtor)(void*)) {
+    uint32_t key = s_local_key_count++;
+    GEDUO_ASSERT2(key < kMaxLocalKeys, "too many FiberLocal keys");
+    s_local_dtors[key] = dtor;
+    return key;
+}
+
+void* Fiber::GetLocal(uint32_t key) {
+    Fiber* cur = t_fiber;
+    if (cur && key < cur->m_localSize) {
+        return cur->m_locals[key];
+    }
+    return nullptr;
+}
+
+void*& Fiber::GetLocalSlot(uint32_t key) {
+    Fiber* cur = t_fiber;
+    if (GEDUO_UNLIKELY(!cur)) {
+        cur = GetThis().get();
+    }
+    if (GEDUO_LIKELY(key < cur->m_localSize)) {
+        return cur->m_locals[key];
+    }
+    // 按当前已分配的 key 数扩容, 之后分配的 key 很少
+    uint32_t size = std::max(std::max(key + 1, s_local_key_count.load()), 8u);
+    void** locals = (void**)realloc(cur->m_locals, sizeof(void*) * size);
+    GEDUO_ASSERT(locals);
+    memset(locals + cur->m_localSize, 0, sizeof(void*) * (size - cur->m_localSize));
+    cur->m_locals = locals;
+    cur->m_localSize = size;
+    return locals[key];
+}
+
+void Fiber::clearLocals() {
+    // 析构函数中可能再次设置协程局部变量, 最多重复几轮
+    for (int round = 0; round < 4; ++round) {
+        bool found = false;
+        for (uint32_t i = 0; i < m_localSize; ++i) {
+            void* v = m_locals[i];
+            if (v) {
+                m_locals[i] = nullptr;
+                s_local_dtors[i](v);
+                found = true;
+            }
+        }
+        if (!found) {
+            break;
+        }
+    }
+}
+
 Fiber::Fiber() {
     m_state = EXEC;
     SetThis(this);
@@ -58,7 +129,7 @@ Fiber::Fiber() {
 Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller)
     :m_id(++s_fiber_id), m_cb(cb) {
     ++s_fiber_count;
-    m_stacksize = stacksize ? stacksize : g_fiber_stack_size->getValue();
+    m_stacksize = stacksize ? stacksize : t_fiber_stack_size.get();
 
     m_stack = StackAllocator::Alloc(m_stacksize);
     if(getcontext(&m_ctx)) GEDUO_ASSERT2(false, "getcontext");
@@ -77,6 +148,11 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool use_caller)
 
 Fiber::~Fiber() {
     --s_fiber_count;
+    if (m_locals) {
+        // 析构函数运行时 t_fiber 可能不是本协程, 值的析构不能依赖协程局部变量
+        clearLocals();
+        free(m_locals);
+    }
     if(m_stack) {
         GEDUO_ASSERT(m_state == TERM || m_state == EXCEPT || m_state == INIT);
         StackAllocator::Dealloc(m_stack, m_stacksize);
@@ -178,16 +254,19 @@ void Fiber::MainFunc() {
         cur->m_state = EXCEPT;
         GEDUO_LOG_ERROR(g_logger) << "Fiber Except: " << ex.what()
             << " fiber_id = " << cur->getId()
-            << std::endl
-            << geduo::BacktraceToString();
+            << " backtrace: "
+            << GEDUO_BACKTRACE();
     } catch(...) {
         cur->m_state = EXCEPT;
         GEDUO_LOG_ERROR(g_logger) << "Fiber Except: "
             << " fiber_id=" << cur->getId()
-            << std::endl
-            << geduo::BacktraceToString();
+            << " backtrace: "
+            << GEDUO_BACKTRACE();
     }
 
+    // 在协程上下文中析构协程局部变量, 槽位数组留给 reset 后复用
+    cur->clearLocals();
+
     auto raw_ptr = cur.get();
     cur.reset();
     raw_ptr->swapOut();
@@ -206,16 +285,19 @@ void Fiber::CallerMainFunc() {
         cur->m_state = EXCEPT;
         GEDUO_LOG_ERROR(g_logger) << "Fiber Except: " << ex.what()
             << " fiber_id = " << cur->getId()
-            << std::endl
-            << geduo::BacktraceToString();
+            << " backtrace: "
+            << GEDUO_BACKTRACE();
     } catch (...) {
         cur->m_state = EXCEPT;
         GEDUO_LOG_ERROR(g_logger) << "Fiber Except"
             << " fiber_id = " << cur->getId()
-            << std::endl
-            << geduo::BacktraceToString();
+            << " backtrace: "
+            << GEDUO_BACKTRACE();
     }
 
+    // 在协程上下文中析构协程局部变量, 槽位数组留给 reset 后复用
+    cur->clearLocals();
+
     auto raw_ptr = cur.get();
     cur.reset();
     raw_ptr->back();
@@ -265,5 +347,153 @@ void FiberSemaphore::notify(){
         ++m_concurrency;
     }
 }
+
+FiberWaiter::FiberWaiter() {}
+
+void FiberWaiter::wait() {
+    Scheduler* scheduler = Scheduler::GetThis();
+    Fiber::ptr fiber;
+    // 调度协程自身不能让出, 只能阻塞线程
+    if (Fiber::CanYield()) {
+        fiber = t_fiber->shared_from_this();
+    }
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_notified) {
+            return;
+        }
+        GEDUO_ASSERT(!m_fiber && !m_threadWaiting);
+        if (fiber) {
+            m_scheduler = scheduler;
+            m_fiber = fiber;
+        } else {
+            m_threadWaiting = true;
+        }
+    }
+    if (fiber) {
+        fiber.reset();
+        Fiber::YieldToHold();
+    } else {
+        m_sem.wait();
+    }
 }
 
+bool FiberWaiter::notify() {
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    bool thread_waiting = false;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_notified) {
+            return false;
+        }
+        m_notified = true;
+        scheduler = m_scheduler;
+        fiber.swap(m_fiber);
+        thread_waiting = m_threadWaiting;
+    }
+    // 唤醒之后等待者可能立即析构本对象, 不能再访问成员
+    if (fiber) {
+        scheduler->schedule(fiber);
+    } else if (thread_waiting) {
+        m_sem.notify();
+    }
+    return true;
+}
+
+bool FiberWaiter::waitUntil(uint64_t deadline_ns) {
+    if (m_notified) {
+        return true;
+    }
+    if (Clock::MonotonicNS() >= deadline_ns) {
+        return false;
+    }
+    DeadlineTimer::Handle handle = DeadlineTimer::Add(deadline_ns, [this]() {
+        if (notify()) {
+            m_timedOut = true;
+        }
+    });
+    wait();
+    // 回调持定时器的锁执行, 取消之后 m_timedOut 不会再变
+    DeadlineTimer::Remove(handle);
+    return !m_timedOut;
+}
+
+void FiberWaiter::reset() {
+    MutexType::Lock lock(m_mutex);
+    GEDUO_ASSERT(!m_fiber);
+    m_scheduler = nullptr;
+    m_threadWaiting = false;
+    m_notified = false;
+    m_timedOut = false;
+}
+
+namespace {
+
+/// @brief 截止时间回调线程, 首次使用时启动, 不随进程退出析构
+class DeadlineThread {
+public:
+    static DeadlineThread* Get() {
+        static DeadlineThread* s_thread = new DeadlineThread;
+        return s_thread;
+    }
+
+    DeadlineTimer::Handle add(uint64_t deadline_ns, std::function<void()>& cb) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        DeadlineTimer::Handle handle(deadline_ns, ++m_seq);
+        bool front = m_timers.empty() || handle < m_timers.begin()->first;
+        m_timers.emplace(handle, std::move(cb));
+        if (front) {
+            m_cond.notify_one();
+        }
+        return handle;
+    }
+
+    bool remove(const DeadlineTimer::Handle& handle) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_timers.erase(handle) > 0;
+    }
+private:
+    DeadlineThread()
+        :m_thread(std::bind(&DeadlineThread::run, this), "deadline") {
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            if (m_timers.empty()) {
+                m_cond.wait(lock);
+                continue;
+            }
+            uint64_t now = Clock::MonotonicNS();
+            auto it = m_timers.begin();
+            if (it->first.first > now) {
+                m_cond.wait_for(lock, std::chrono::nanoseconds(it->first.first - now));
+                continue;
+            }
+            std::function<void()> cb;
+            cb.swap(it->second);
+            m_timers.erase(it);
+            cb();
+        }
+    }
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    /// 按截止时间排序, 相同时按添加顺序
+    std::map<DeadlineTimer::Handle, std::function<void()> > m_timers;
+    uint64_t m_seq = 0;
+    Thread m_thread;
+};
+
+}
+
+DeadlineTimer::Handle DeadlineTimer::Add(uint64_t deadline_ns, std::function<void()> cb) {
+    return DeadlineThread::Get()->add(deadline_ns, cb);
+}
+
+bool DeadlineTimer::Remove(const Handle& handle) {
+    return DeadlineThread::Get()->remove(handle);
+}
+
+}
@@ -13,8 +13,10 @@
 
 #include <ucontext.h>
 
+#include <stdint.h>
 #include <functional>
 #include <memory>
+#include <utility>
 
 #include "mutex.h"
 
@@ -24,7 +26,7 @@ class Scheduler;
 
 /// @brief 协程类
 class Fiber : public std::enable_shared_from_this<Fiber> {
-friend class scheduler;
+friend class Scheduler;
 public:
     typedef std::shared_ptr<Fiber> ptr;
 
@@ -68,6 +70,24 @@ public:
     static void CallerMainFunc();
     /// @brief 获取当前协程的 id
     static uint64_t GetFiberId();
+    /// @brief 当前是否运行在调度器中可让出的协程里(不是线程主协程, 也不是调度协程)
+    static bool CanYield();
+
+    /// @brief 协程局部存储最多的 key 数
+    static const uint32_t kMaxLocalKeys = 256;
+    /**
+     * @brief 分配协程局部存储的 key, 进程内不回收
+     * @param[in] dtor 协程结束、reset 或析构时对非空的值调用
+     */
+    static uint32_t AllocLocalKey(void (*dtor)(void*));
+    /// @brief 当前协程 key 对应的值, 未设置返回 nullptr
+    static void* GetLocal(uint32_t key);
+    /// @brief 当前协程 key 对应的槽位, 不在协程中时使用线程主协程的槽位
+    static void*& GetLocalSlot(uint32_t key);
+
+private:
+    /// @brief 对所有非空槽位调用析构函数并置空, 槽位数组保留给 reset 后复用
+    void clearLocals();
 
 private:
     uint64_t m_id = 0; /// 协程 id
@@ -76,6 +96,69 @@ private:
     ucontext_t m_ctx; /// 协程上下文
     void* m_stack = nullptr; /// 协程运行栈指针
     std::function<void()> m_cb; /// 协程运行函数
+    void** m_locals = nullptr; /// 协程局部存储槽位, 以 key 为下标
+    uint32_t m_localSize = 0; /// 槽位数
+};
+
+/**
+ * @brief 协程局部变量
+ * @details 每个协程一份, 协程在调度器线程间迁移时跟随协程, 不同于 thread_local.
+ *          构造时分配 key, 访问为一次数组下标读取; 值在协程执行结束、reset 或析构时析构.
+ *          应定义为全局或静态变量, key 不回收
+ */
+template<class T>
+class FiberLocal : Noncopyable {
+public:
+    FiberLocal()
+        :m_key(Fiber::AllocLocalKey(&FiberLocal::Destroy)) {
+    }
+
+    /// @brief 当前协程的值, 不存在时默认构造
+    T& get() {
+        T* v = static_cast<T*>(Fiber::GetLocal(m_key));
+        if (v) {
+            return *v;
+        }
+        // T 的构造函数可能用到其他 FiberLocal 而扩容槽位数组, 构造完成后再取槽位
+        v = new T();
+        Fiber::GetLocalSlot(m_key) = v;
+        return *v;
+    }
+
+    /// @brief 当前协程的值, 不存在时返回 nullptr
+    T* tryGet() const {
+        return static_cast<T*>(Fiber::GetLocal(m_key));
+    }
+
+    void set(T v) {
+        T* cur = static_cast<T*>(Fiber::GetLocal(m_key));
+        if (cur) {
+            *cur = std::move(v);
+            return;
+        }
+        T* p = new T(std::move(v));
+        Fiber::GetLocalSlot(m_key) = p;
+    }
+
+    /// @brief 析构当前协程的值
+    void reset() {
+        if (!Fiber::GetLocal(m_key)) {
+            return;
+        }
+        void*& slot = Fiber::GetLocalSlot(m_key);
+        T* v = static_cast<T*>(slot);
+        slot = nullptr;
+        delete v;
+    }
+
+    T& operator*() { return get(); }
+    T* operator->() { return &get(); }
+private:
+    static void Destroy(void* v) {
+        delete static_cast<T*>(v);
+    }
+private:
+    uint32_t m_key;
 };
 
 class FiberSemaphore : Noncopyable {
@@ -98,6 +181,70 @@ private:
     size_t m_concurrency;
 };
 
+/**
+ * @brief 一次性的等待/唤醒器
+ * @details 在协程中 wait 会让出当前协程, notify 时重新调度回原来的协程调度器;
+ *          不在协程中(如普通线程)时退化为信号量阻塞.
+ *          notify 可先于 wait 调用, 此时 wait 直接返回. reset 后可复用
+ */
+class FiberWaiter : Noncopyable {
+public:
+    typedef Spinlock MutexType;
+
+    FiberWaiter();
+
+    /// @brief 等待 notify, 已通知过则立即返回
+    void wait();
+
+    /// @brief 唤醒等待者, 多次调用只有第一次生效, 返回是否是第一次调用
+    bool notify();
+
+    bool isNotified() const { return m_notified; }
+
+    /**
+     * @brief 等待 notify 或到达截止时间
+     * @param[in] deadline_ns 截止时间, Clock::MonotonicNS() 的时间点
+     * @return 被 notify 唤醒返回 true, 超时返回 false
+     */
+    bool waitUntil(uint64_t deadline_ns);
+
+    /// @brief 重置为未通知状态, 要求当前没有等待者
+    void reset();
+
+private:
+    MutexType m_mutex;
+    Scheduler* m_scheduler = nullptr;
+    Fiber::ptr m_fiber;
+    Semaphore m_sem;
+    bool m_threadWaiting = false;
+    std::atomic<bool> m_notified = {false};
+    /// 由 waitUntil 的超时回调唤醒
+    bool m_timedOut = false;
+};
+
+/**
+ * @brief 截止时间回调
+ * @details 调度器没有定时器, 协程的超时等待由一个后台线程按截止时间执行回调来唤醒,
+ *          回调在该线程中持锁执行, 应当只做唤醒之类的轻量操作
+ */
+class DeadlineTimer {
+public:
+    /// @brief 截止时间与序号, 用于取消
+    typedef std::pair<uint64_t, uint64_t> Handle;
+
+    /**
+     * @brief 添加回调
+     * @param[in] deadline_ns 截止时间, Clock::MonotonicNS() 的时间点
+     */
+    static Handle Add(uint64_t deadline_ns, std::function<void()> cb);
+
+    /**
+     * @brief 取消回调, 返回后回调不会再执行, 正在执行时等待其结束
+     * @return 回调已经执行过返回 false
+     */
+    static bool Remove(const Handle& handle);
+};
+
 } // namespace geduo
 
 #endif
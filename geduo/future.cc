@@ -0,0 +1,81 @@
+/*
+ * @file : future.cc
+ * @brief: Future/Promise 共享状态的实现
+ */
+#include "future.h"
+#include "clock.h"
+#include "macro.h"
+
+namespace geduo {
+
+namespace detail {
+
+bool FutureStateBase::setException(std::exception_ptr e) {
+    if (!claim()) {
+        return false;
+    }
+    m_exception = e;
+    publish();
+    return true;
+}
+
+void FutureStateBase::publish() {
+    std::function<void()> cb;
+    {
+        MutexType::Lock lock(m_mutex);
+        m_ready.store(true, std::memory_order_release);
+        cb.swap(m_callback);
+    }
+    // 回调中可能释放最后一个引用, 之后不能再访问成员
+    if (cb) {
+        cb();
+    }
+}
+
+void FutureStateBase::setCallback(std::function<void()> cb) {
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!m_ready) {
+            GEDUO_ASSERT2(!m_callback, "future callback already set");
+            m_callback = std::move(cb);
+            return;
+        }
+    }
+    cb();
+}
+
+void FutureStateBase::wait() {
+    if (isReady()) {
+        return;
+    }
+    FiberWaiter waiter;
+    setCallback([&waiter]() {
+        waiter.notify();
+    });
+    waiter.wait();
+}
+
+bool FutureStateBase::waitFor(uint64_t timeout_ms) {
+    if (isReady()) {
+        return true;
+    }
+    // 超时返回后完成方仍可能在执行回调, waiter 由回调共同持有
+    std::shared_ptr<FiberWaiter> waiter = std::make_shared<FiberWaiter>();
+    setCallback([waiter]() {
+        waiter->notify();
+    });
+    if (waiter->waitUntil(Clock::MonotonicNS() + timeout_ms * 1000000ull)) {
+        return true;
+    }
+    MutexType::Lock lock(m_mutex);
+    if (m_ready) {
+        return true;
+    }
+    // 撤销回调, 之后仍可以再次等待或注册回调
+    m_callback = nullptr;
+    return false;
+}
+
+} // namespace detail
+
+} // namespace geduo
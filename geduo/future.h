@@ -0,0 +1,505 @@
+/*
+ * @file : future.h
+ * @brief: 协程感知的 Future/Promise
+ * @details 共享状态(完成标志、异常、一个完成回调)与结果值的存储放在同一个对象中,
+ *          由 std::make_shared 一次分配. Future::get 在协程中让出协程, 普通线程中阻塞;
+ *          then 注册的后续任务可指定在某个协程调度器上执行, 未指定时由完成方直接执行.
+ *          schedule_async 把任务投递到调度器并返回 Future, when_all / when_any 组合多个 Future
+ */
+
+#ifndef __GEDUO_FUTURE_H__
+#define __GEDUO_FUTURE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mutex.h"
+#include "scheduler.h"
+
+namespace geduo {
+
+template<class T> class Future;
+template<class T> class Promise;
+
+namespace detail {
+
+/// @brief 共享状态的非模板部分
+class FutureStateBase : Noncopyable {
+public:
+    typedef Spinlock MutexType;
+
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    /// @brief 完成且结果为异常, 只能在 isReady 之后调用
+    bool hasException() const { return (bool)m_exception; }
+    const std::exception_ptr& getException() const { return m_exception; }
+
+    /// @brief 设置异常, 已设置过结果返回 false
+    bool setException(std::exception_ptr e);
+
+    /**
+     * @brief 注册完成回调, 已完成时在当前线程立即执行
+     * @details 回调在完成方的线程中执行, 只能注册一次
+     */
+    void setCallback(std::function<void()> cb);
+
+    /// @brief 等待完成
+    void wait();
+
+    /// @brief 等待完成, 超时返回 false, 超时后撤销等待用的回调
+    bool waitFor(uint64_t timeout_ms);
+protected:
+    /// @brief 抢占设置结果的权利, 只有第一次返回 true
+    bool claim() { return !m_claimed.exchange(true, std::memory_order_acq_rel); }
+
+    /// @brief 结果写入后置为完成并执行回调
+    void publish();
+private:
+    MutexType m_mutex;
+    std::atomic<bool> m_claimed = {false};
+    std::atomic<bool> m_ready = {false};
+    std::exception_ptr m_exception;
+    std::function<void()> m_callback;
+};
+
+template<class T>
+class FutureState : public FutureStateBase {
+public:
+    ~FutureState() {
+        if (m_hasValue) {
+            value().~T();
+        }
+    }
+
+    /// @brief 设置结果, 已设置过返回 false
+    template<class... Args>
+    bool setValue(Args&&... args) {
+        if (!claim()) {
+            return false;
+        }
+        new (&m_storage) T(std::forward<Args>(args)...);
+        m_hasValue = true;
+        publish();
+        return true;
+    }
+
+    /// @brief 取走结果, 结果为异常时重新抛出
+    T take() {
+        if (hasException()) {
+            std::rethrow_exception(getException());
+        }
+        return std::move(value());
+    }
+private:
+    T& value() { return *reinterpret_cast<T*>(&m_storage); }
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+    bool m_hasValue = false;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+public:
+    bool setValue() {
+        if (!claim()) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    void take() {
+        if (hasException()) {
+            std::rethrow_exception(getException());
+        }
+    }
+};
+
+/// @brief then 的回调 f 的返回类型, Future<void> 的回调不带参数
+template<class F, class T>
+struct FutureThenResult {
+    typedef decltype(std::declval<F&>()(std::declval<T>())) type;
+};
+
+template<class F>
+struct FutureThenResult<F, void> {
+    typedef decltype(std::declval<F&>()()) type;
+};
+
+/// @brief 执行 f 并把返回值或异常写入 out
+template<class R>
+struct FutureInvoker {
+    template<class F, class... Args>
+    static void Apply(FutureState<R>& out, F& f, Args&&... args) {
+        try {
+            out.setValue(f(std::forward<Args>(args)...));
+        } catch (...) {
+            out.setException(std::current_exception());
+        }
+    }
+};
+
+template<>
+struct FutureInvoker<void> {
+    template<class F, class... Args>
+    static void Apply(FutureState<void>& out, F& f, Args&&... args) {
+        try {
+            f(std::forward<Args>(args)...);
+            out.setValue();
+        } catch (...) {
+            out.setException(std::current_exception());
+        }
+    }
+};
+
+/// @brief 以 in 的结果执行 then 的回调, in 为异常时直接传递给 out
+template<class T>
+struct FutureContinuation {
+    template<class R, class F>
+    static void Run(FutureState<T>& in, FutureState<R>& out, F& f) {
+        if (in.hasException()) {
+            out.setException(in.getException());
+            return;
+        }
+        FutureInvoker<R>::Apply(out, f, in.take());
+    }
+};
+
+template<>
+struct FutureContinuation<void> {
+    template<class R, class F>
+    static void Run(FutureState<void>& in, FutureState<R>& out, F& f) {
+        if (in.hasException()) {
+            out.setException(in.getException());
+            return;
+        }
+        FutureInvoker<R>::Apply(out, f);
+    }
+};
+
+/// @brief when_all / when_any 的结果类型与取值
+template<class T>
+struct FutureCombine {
+    typedef std::vector<T> AllType;
+    typedef std::pair<size_t, T> AnyType;
+
+    static void SetAll(FutureState<AllType>& out
+                       ,std::vector<std::shared_ptr<FutureState<T>>>& states) {
+        AllType values;
+        values.reserve(states.size());
+        for (auto& i : states) {
+            values.push_back(i->take());
+        }
+        out.setValue(std::move(values));
+    }
+
+    static void SetAny(FutureState<AnyType>& out, size_t index, FutureState<T>& in) {
+        out.setValue(index, in.take());
+    }
+};
+
+template<>
+struct FutureCombine<void> {
+    typedef void AllType;
+    typedef size_t AnyType;
+
+    static void SetAll(FutureState<void>& out
+                       ,std::vector<std::shared_ptr<FutureState<void>>>&) {
+        out.setValue();
+    }
+
+    static void SetAny(FutureState<size_t>& out, size_t index, FutureState<void>&) {
+        out.setValue(index);
+    }
+};
+
+/// @brief 访问 Future/Promise 的共享状态
+struct FutureAccess {
+    template<class T>
+    static std::shared_ptr<FutureState<T>> Release(Future<T>& f) {
+        if (!f.m_state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        return std::move(f.m_state);
+    }
+
+    template<class T>
+    static Future<T> Make(std::shared_ptr<FutureState<T>> state) {
+        return Future<T>(std::move(state));
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief 异步结果, 只能移动, 结果只能取一次
+ */
+template<class T>
+class Future {
+friend struct detail::FutureAccess;
+public:
+    typedef detail::FutureState<T> State;
+
+    Future() {}
+    Future(Future&&) = default;
+    Future& operator=(Future&&) = default;
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    /// @brief 是否持有共享状态, get / then 之后为 false
+    bool valid() const { return (bool)m_state; }
+
+    bool isReady() const { return state().isReady(); }
+
+    /// @brief 是否以异常完成, 未完成返回 false
+    bool hasException() const { return isReady() && state().hasException(); }
+
+    /// @brief 等待完成, 协程中让出协程
+    void wait() const { state().wait(); }
+
+    /// @brief 等待完成, 超时返回 false
+    bool waitFor(uint64_t timeout_ms) const { return state().waitFor(timeout_ms); }
+
+    /// @brief 等待并取走结果, 结果为异常时重新抛出
+    T get() {
+        std::shared_ptr<State> state = detail::FutureAccess::Release(*this);
+        state->wait();
+        return state->take();
+    }
+
+    /**
+     * @brief 注册后续任务, 返回后续任务结果的 Future
+     * @details 本 Future 以值完成时执行 f(value) (Future<void> 执行 f()), 以异常完成时
+     *          跳过 f, 异常传递给返回的 Future; f 抛出的异常同样传递.
+     *          scheduler 非空时 f 投递到该调度器执行, 否则由完成方(或已完成时由调用方)直接执行
+     */
+    template<class F>
+    Future<typename detail::FutureThenResult<F, T>::type> then(F f, Scheduler* scheduler = nullptr) {
+        typedef typename detail::FutureThenResult<F, T>::type R;
+        std::shared_ptr<State> in = detail::FutureAccess::Release(*this);
+        std::shared_ptr<detail::FutureState<R>> out = std::make_shared<detail::FutureState<R>>();
+        in->setCallback([in, out, f, scheduler]() mutable {
+            if (!scheduler) {
+                detail::FutureContinuation<T>::Run(*in, *out, f);
+                return;
+            }
+            scheduler->schedule(std::function<void()>([in, out, f]() mutable {
+                detail::FutureContinuation<T>::Run(*in, *out, f);
+            }));
+        });
+        return detail::FutureAccess::Make(std::move(out));
+    }
+private:
+    explicit Future(std::shared_ptr<State> state)
+        :m_state(std::move(state)) {
+    }
+
+    State& state() const {
+        if (!m_state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        return *m_state;
+    }
+private:
+    std::shared_ptr<State> m_state;
+};
+
+/**
+ * @brief 设置 Future 的结果
+ * @details 未设置结果就析构时, Future 以 std::future_errc::broken_promise 异常完成
+ */
+template<class T>
+class Promise {
+public:
+    typedef detail::FutureState<T> State;
+
+    Promise()
+        :m_state(std::make_shared<State>()) {
+    }
+
+    Promise(Promise&&) = default;
+    Promise& operator=(Promise&& rhs) {
+        if (this != &rhs) {
+            abandon();
+            m_state = std::move(rhs.m_state);
+            m_retrieved = rhs.m_retrieved;
+        }
+        return *this;
+    }
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise() { abandon(); }
+
+    /// @brief 取得对应的 Future, 只能调用一次
+    Future<T> getFuture() {
+        if (!m_state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        if (m_retrieved) {
+            throw std::future_error(std::future_errc::future_already_retrieved);
+        }
+        m_retrieved = true;
+        return detail::FutureAccess::Make(m_state);
+    }
+
+    /// @brief 设置结果, 已设置过返回 false
+    template<class... Args>
+    bool setValue(Args&&... args) {
+        return m_state && m_state->setValue(std::forward<Args>(args)...);
+    }
+
+    /// @brief 设置异常, 已设置过返回 false
+    bool setException(std::exception_ptr e) {
+        return m_state && m_state->setException(e);
+    }
+private:
+    void abandon() {
+        if (m_state && !m_state->isReady()) {
+            m_state->setException(std::make_exception_ptr(
+                    std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+private:
+    std::shared_ptr<State> m_state;
+    bool m_retrieved = false;
+};
+
+/// @brief 已完成的 Future
+template<class T>
+Future<typename std::decay<T>::type> make_ready_future(T&& v) {
+    typedef typename std::decay<T>::type R;
+    auto state = std::make_shared<detail::FutureState<R>>();
+    state->setValue(std::forward<T>(v));
+    return detail::FutureAccess::Make(std::move(state));
+}
+
+inline Future<void> make_ready_future() {
+    auto state = std::make_shared<detail::FutureState<void>>();
+    state->setValue();
+    return detail::FutureAccess::Make(std::move(state));
+}
+
+/// @brief 以异常完成的 Future
+template<class T>
+Future<T> make_exception_future(std::exception_ptr e) {
+    auto state = std::make_shared<detail::FutureState<T>>();
+    state->setException(e);
+    return detail::FutureAccess::Make(std::move(state));
+}
+
+/**
+ * @brief 在协程调度器上执行 f, 返回其结果的 Future
+ * @param[in] scheduler 为 nullptr 时使用当前线程的调度器, 都没有时直接执行
+ */
+template<class F>
+Future<decltype(std::declval<F&>()())> schedule_async(Scheduler* scheduler, F f) {
+    typedef decltype(std::declval<F&>()()) R;
+    auto state = std::make_shared<detail::FutureState<R>>();
+    if (!scheduler) {
+        scheduler = Scheduler::GetThis();
+    }
+    if (!scheduler) {
+        detail::FutureInvoker<R>::Apply(*state, f);
+    } else {
+        scheduler->schedule(std::function<void()>([state, f]() mutable {
+            detail::FutureInvoker<R>::Apply(*state, f);
+        }));
+    }
+    return detail::FutureAccess::Make(std::move(state));
+}
+
+/**
+ * @brief 所有 Future 完成后完成, 结果按输入顺序排列(Future<void> 的结果为 void)
+ * @details 任一 Future 以异常完成时, 等全部完成后以下标最小的异常完成
+ */
+template<class T>
+Future<typename detail::FutureCombine<T>::AllType> when_all(std::vector<Future<T>> futures) {
+    typedef detail::FutureCombine<T> Combine;
+    typedef typename Combine::AllType R;
+    struct Context {
+        std::vector<std::shared_ptr<detail::FutureState<T>>> states;
+        std::atomic<size_t> remaining;
+        std::shared_ptr<detail::FutureState<R>> out;
+    };
+    auto ctx = std::make_shared<Context>();
+    ctx->out = std::make_shared<detail::FutureState<R>>();
+    ctx->states.reserve(futures.size());
+    for (auto& i : futures) {
+        ctx->states.push_back(detail::FutureAccess::Release(i));
+    }
+    ctx->remaining = ctx->states.size() + 1;
+    auto done = [ctx]() {
+        if (ctx->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        for (auto& i : ctx->states) {
+            if (i->hasException()) {
+                ctx->out->setException(i->getException());
+                return;
+            }
+        }
+        Combine::SetAll(*ctx->out, ctx->states);
+    };
+    for (auto& i : ctx->states) {
+        i->setCallback(done);
+    }
+    // 最后一个计数由注册方持有, 注册期间完成的 Future 不会提前触发
+    auto out = ctx->out;
+    done();
+    return detail::FutureAccess::Make(std::move(out));
+}
+
+/**
+ * @brief 任一 Future 以值完成时完成, 结果为 (下标, 值)(Future<void> 的结果为下标)
+ * @details 全部以异常完成时以最后一个异常完成; 输入为空时以 std::invalid_argument 完成
+ */
+template<class T>
+Future<typename detail::FutureCombine<T>::AnyType> when_any(std::vector<Future<T>> futures) {
+    typedef detail::FutureCombine<T> Combine;
+    typedef typename Combine::AnyType R;
+    if (futures.empty()) {
+        return make_exception_future<R>(std::make_exception_ptr(
+                std::invalid_argument("when_any with no futures")));
+    }
+    struct Context {
+        size_t count;
+        std::atomic<size_t> failed = {0};
+        std::shared_ptr<detail::FutureState<R>> out;
+    };
+    auto ctx = std::make_shared<Context>();
+    ctx->count = futures.size();
+    ctx->out = std::make_shared<detail::FutureState<R>>();
+    std::vector<std::shared_ptr<detail::FutureState<T>>> states;
+    states.reserve(futures.size());
+    for (auto& i : futures) {
+        states.push_back(detail::FutureAccess::Release(i));
+    }
+    for (size_t i = 0; i < states.size(); ++i) {
+        std::shared_ptr<detail::FutureState<T>> state = states[i];
+        state->setCallback([ctx, state, i]() {
+            if (state->hasException()) {
+                if (ctx->failed.fetch_add(1, std::memory_order_acq_rel) + 1 == ctx->count) {
+                    ctx->out->setException(state->getException());
+                }
+                return;
+            }
+            if (!ctx->out->isReady()) {
+                Combine::SetAny(*ctx->out, i, *state);
+            }
+        });
+    }
+    return detail::FutureAccess::Make(ctx->out);
+}
+
+} // namespace geduo
+
+#endif
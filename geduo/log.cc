@@ -665,11 +665,10 @@ struct LogDefine {
 };
 
 template <>
-class LexicalCast<std::string, LogDefine> {
+class LexicalCast<YAML::Node, LogDefine> {
 public:
-    LogDefine operator()(const std::string& v)
+    LogDefine operator()(const YAML::Node& n)
     {
-        YAML::Node n = YAML::Load(v);
         LogDefine ld;
         if (!n["name"].IsDefined()) {
             std::cout << "log config error: name is null, " << n
@@ -722,6 +721,15 @@ public:
     }
 };
 
+template <>
+class LexicalCast<std::string, LogDefine> {
+public:
+    LogDefine operator()(const std::string& v)
+    {
+        return LexicalCast<YAML::Node, LogDefine>()(YAML::Load(v));
+    }
+};
+
 template <>
 class LexicalCast<LogDefine, std::string> {
 public:
@@ -14,6 +14,7 @@
 
 #include "util.h"
 #include "log.h"
+#include "backtrace.h"
 
 #if defined __GNUC__ || defined __llvm__
 /// LIKCLY 宏的封装, 告诉编译器优化,条件大概率成立
@@ -25,13 +26,25 @@
 #   define GEDUO_UNLIKELY(x) (x)
 #endif
 
-/// 断言宏封装
+/// 抓取当前调用栈, 返回可输出到日志的 BacktraceRef
+#define GEDUO_BACKTRACE() geduo::BacktraceCollector::GetInstance()->capture()
+
+#ifdef NDEBUG
+#   define GEDUO_ASSERT_FAIL(x)
+#else
+/// assert 会终止进程, 先在当前线程输出尚未符号化的调用栈
+#   define GEDUO_ASSERT_FAIL(x)                                                        \
+        geduo::BacktraceCollector::GetInstance()->flush();                             \
+        assert(x)
+#endif
+
+/// 断言宏封装, 调用栈只记录 stack_id, 符号化结果由后台线程写入 system 日志
 #define GEDUO_ASSERT(x)                                                                \
     if (GEDUO_UNLIKELY(!(x))) {                                                        \
         GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "ASSERTION: " #x                          \
-                                          << "\nbacktrace:\n"                          \
-                                          << geduo::BacktraceToString(100, 2, "    "); \
-        assert(x);                                                                     \
+                                          << "\nbacktrace: "                           \
+                                          << GEDUO_BACKTRACE();                        \
+        GEDUO_ASSERT_FAIL(x);                                                          \
     }
 
 /// 断言宏封装
@@ -40,9 +53,9 @@
         GEDUO_LOG_ERROR(GEDUO_LOG_ROOT()) << "ASSERTION: " #x                          \
                                           << "\n"                                      \
                                           << w                                         \
-                                          << "\nbacktrace:\n"                          \
-                                          << geduo::BacktraceToString(100, 2, "    "); \
-        assert(x);                                                                     \
+                                          << "\nbacktrace: "                           \
+                                          << GEDUO_BACKTRACE();                        \
+        GEDUO_ASSERT_FAIL(x);                                                          \
     }
 
 #endif
\ No newline at end of file
@@ -15,11 +15,20 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdint.h>
+#include <errno.h>
+#include <time.h>
 #include <atomic>
 #include <list>
 
 #include "noncopyable.h"
 
+/// glibc 2.30 起提供按指定时钟超时的 sem_clockwait
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 30)
+#define GEDUO_HAVE_SEM_CLOCKWAIT 1
+#endif
+#endif
+
 namespace geduo {
 
 /// @brief 信号量
@@ -43,6 +52,38 @@ public:
         }
     }
 
+    /**
+     * @brief 最多等待 timeout_ms 毫秒获取信号量
+     * @details glibc 2.30 起使用 sem_clockwait 按 CLOCK_MONOTONIC 计时;
+     *          更早的版本只有 sem_timedwait(CLOCK_REALTIME), 等待期间调整系统时间会使超时提前或推迟
+     * @return 超时返回 false
+     */
+    bool waitFor(uint64_t timeout_ms) {
+#ifdef GEDUO_HAVE_SEM_CLOCKWAIT
+        clockid_t clock = CLOCK_MONOTONIC;
+#else
+        clockid_t clock = CLOCK_REALTIME;
+#endif
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        uint64_t ns = ts.tv_nsec + (timeout_ms % 1000) * 1000000ull;
+        ts.tv_sec += timeout_ms / 1000 + ns / 1000000000ull;
+        ts.tv_nsec = ns % 1000000000ull;
+#ifdef GEDUO_HAVE_SEM_CLOCKWAIT
+        while (sem_clockwait(&m_semaphore, clock, &ts)) {
+#else
+        while (sem_timedwait(&m_semaphore, &ts)) {
+#endif
+            if (errno == ETIMEDOUT) {
+                return false;
+            }
+            if (errno != EINTR) {
+                throw std::logic_error("sem_clockwait/sem_timedwait error");
+            }
+        }
+        return true;
+    }
+
     /// @brief 释放信号量
     void notify() {
         if(sem_post(&m_semaphore)) {
@@ -0,0 +1,166 @@
+/*
+ * @file : offload.cc
+ * @brief: CPU 密集任务卸载线程池的实现
+ */
+#include <algorithm>
+
+#include "offload.h"
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+
+namespace geduo {
+
+static Logger::ptr g_logger = GEDUO_LOG_NAME("system");
+
+static ConfigVar<uint32_t>::ptr g_offload_threads =
+    Config::Lookup<uint32_t>("offload.threads", 2, "default offload pool threads");
+
+static ConfigVar<uint32_t>::ptr g_offload_batch_size =
+    Config::Lookup<uint32_t>("offload.batch_size", 16, "default offload pool batch size");
+
+static thread_local OffloadPool* t_offload_pool = nullptr;
+
+OffloadPool::OffloadPool(size_t threads, const std::string& name, size_t batch_size)
+    :m_name(name)
+    ,m_threadCount(threads)
+    ,m_batchSize(batch_size ? batch_size : 1) {
+    GEDUO_ASSERT(threads > 0);
+}
+
+OffloadPool::~OffloadPool() {
+    stop();
+}
+
+OffloadPool* OffloadPool::GetDefault() {
+    static OffloadPool* s_pool = []() {
+        OffloadPool* pool = new OffloadPool(std::max(1u, g_offload_threads->getValue())
+                                            ,"offload", g_offload_batch_size->getValue());
+        pool->start();
+        return pool;
+    }();
+    return s_pool;
+}
+
+OffloadPool* OffloadPool::GetThis() {
+    return t_offload_pool;
+}
+
+void OffloadPool::start() {
+    MutexType::Lock lock(m_mutex);
+    if (!m_stopping) {
+        return;
+    }
+    m_stopping = false;
+    GEDUO_ASSERT(m_threads.empty());
+    m_threads.resize(m_threadCount);
+    for (size_t i = 0; i < m_threadCount; ++i) {
+        m_threads[i].reset(new Thread(std::bind(&OffloadPool::work, this)
+                            ,m_name + "_" + std::to_string(i)));
+    }
+}
+
+void OffloadPool::stop() {
+    std::vector<Thread::ptr> thrs;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            return;
+        }
+        m_stopping = true;
+        thrs.swap(m_threads);
+    }
+    for (size_t i = 0; i < thrs.size(); ++i) {
+        m_sem.notify();
+    }
+    for (auto& i : thrs) {
+        i->join();
+    }
+}
+
+void OffloadPool::submit(std::function<void()> cb, uint64_t batch_key) {
+    size_t depth = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_stopping) {
+            lock.unlock();
+            cb();
+            return;
+        }
+        m_jobs.push_back(Job{std::move(cb), batch_key});
+        depth = ++m_queueDepth;
+    }
+    ++m_submitted;
+    size_t max_depth = m_maxQueueDepth;
+    while (depth > max_depth
+            && !m_maxQueueDepth.compare_exchange_weak(max_depth, depth)) {
+    }
+    m_sem.notify();
+}
+
+void OffloadPool::work() {
+    t_offload_pool = this;
+    std::list<Job> batch;
+    while (true) {
+        m_sem.wait();
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_jobs.empty()) {
+                if (m_stopping) {
+                    break;
+                }
+                // 任务已被其他线程批量取走
+                continue;
+            }
+            batch.splice(batch.end(), m_jobs, m_jobs.begin());
+            uint64_t key = batch.front().batchKey;
+            if (key) {
+                // 只在队首附近查找, 避免长队列时持锁过久
+                size_t scan = m_batchSize * 4;
+                auto it = m_jobs.begin();
+                while (it != m_jobs.end() && scan-- && batch.size() < m_batchSize) {
+                    if (it->batchKey == key) {
+                        batch.splice(batch.end(), m_jobs, it++);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            m_queueDepth -= batch.size();
+        }
+        size_t count = batch.size();
+        if (count > 1) {
+            ++m_batches;
+        }
+        for (auto& job : batch) {
+            try {
+                job.cb();
+            } catch (std::exception& ex) {
+                GEDUO_LOG_ERROR(g_logger) << "OffloadPool " << m_name
+                    << " job except: " << ex.what();
+            } catch (...) {
+                GEDUO_LOG_ERROR(g_logger) << "OffloadPool " << m_name
+                    << " job except";
+            }
+        }
+        batch.clear();
+        m_executed += count;
+    }
+    t_offload_pool = nullptr;
+}
+
+std::ostream& OffloadPool::dump(std::ostream& os) {
+    os << "[OffloadPool name=" << m_name
+       << " threads=" << m_threadCount
+       << " batch_size=" << m_batchSize
+       << " queue_depth=" << m_queueDepth
+       << " max_queue_depth=" << m_maxQueueDepth
+       << " submitted=" << m_submitted
+       << " executed=" << m_executed
+       << " batches=" << m_batches
+       << " stopping=" << m_stopping
+       << " ]";
+    return os;
+}
+
+} // namespace geduo
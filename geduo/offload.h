@@ -0,0 +1,117 @@
+/*
+ * @file : offload.h
+ * @brief: CPU 密集任务卸载线程池
+ * @details 协程调度器的工作线程上执行耗时的计算(RSA 私钥运算、压缩、大 JSON 编码等)
+ *          会阻塞该线程上的所有协程. OffloadPool 用独立的线程执行这些任务,
+ *          提交任务的协程让出, 任务完成后回到原来的协程调度器继续执行
+ */
+
+#ifndef __GEDUO_OFFLOAD_H__
+#define __GEDUO_OFFLOAD_H__
+
+#include <future>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "fiber.h"
+#include "thread.h"
+
+namespace geduo {
+
+class OffloadPool : Noncopyable {
+public:
+    typedef std::shared_ptr<OffloadPool> ptr;
+    typedef Mutex MutexType;
+
+    /**
+     * @param[in] threads 工作线程数
+     * @param[in] batch_size 一次最多取出多少个相同 batch_key 的任务连续执行
+     */
+    OffloadPool(size_t threads = 1, const std::string& name = "offload"
+                ,size_t batch_size = 16);
+    ~OffloadPool();
+
+    /// @brief 默认卸载线程池, 线程数与批量大小由 offload.threads / offload.batch_size 配置
+    static OffloadPool* GetDefault();
+
+    /// @brief 当前线程所属的卸载线程池, 非卸载线程返回 nullptr
+    static OffloadPool* GetThis();
+
+    const std::string& getName() const { return m_name; }
+
+    void start();
+
+    /// @brief 执行完队列中的任务后停止
+    void stop();
+
+    /**
+     * @brief 异步提交任务, 不等待完成
+     * @param[in] batch_key 非 0 时, 队列中 batch_key 相同的任务会被同一线程连续取出执行
+     *            (如同一把 RSA 密钥的运算), 减少唤醒和缓存失效
+     */
+    void submit(std::function<void()> cb, uint64_t batch_key = 0);
+
+    /**
+     * @brief 在线程池中执行 cb 并等待结果
+     * @details 协程中调用时让出协程, 完成后回到原协程调度器; 普通线程中阻塞等待.
+     *          cb 抛出的异常在调用方重新抛出. 在本池的工作线程中调用或池未启动时直接执行
+     */
+    template <class F>
+    auto run(F cb, uint64_t batch_key = 0) -> decltype(cb()) {
+        std::packaged_task<decltype(cb())()> task(std::move(cb));
+        auto future = task.get_future();
+        if (GetThis() == this || m_stopping) {
+            task();
+            return future.get();
+        }
+        FiberWaiter waiter;
+        submit([&task, &waiter]() {
+            task();
+            waiter.notify();
+        }, batch_key);
+        waiter.wait();
+        return future.get();
+    }
+
+    /// @brief 当前排队的任务数
+    size_t getQueueDepth() const { return m_queueDepth; }
+    /// @brief 排队任务数的历史最大值
+    size_t getMaxQueueDepth() const { return m_maxQueueDepth; }
+    /// @brief 已提交的任务总数
+    uint64_t getSubmitted() const { return m_submitted; }
+    /// @brief 已完成的任务总数
+    uint64_t getExecuted() const { return m_executed; }
+    /// @brief 合并执行(一次取出多于1个任务)的批次数
+    uint64_t getBatches() const { return m_batches; }
+
+    std::ostream& dump(std::ostream& os);
+private:
+    struct Job {
+        std::function<void()> cb;
+        uint64_t batchKey;
+    };
+
+    void work();
+private:
+    MutexType m_mutex;
+    std::list<Job> m_jobs;
+    Semaphore m_sem;
+    std::vector<Thread::ptr> m_threads;
+    std::string m_name;
+    size_t m_threadCount;
+    size_t m_batchSize;
+    /// run 在锁外读取
+    std::atomic<bool> m_stopping = {true};
+
+    std::atomic<size_t> m_queueDepth = {0};
+    std::atomic<size_t> m_maxQueueDepth = {0};
+    std::atomic<uint64_t> m_submitted = {0};
+    std::atomic<uint64_t> m_executed = {0};
+    std::atomic<uint64_t> m_batches = {0};
+};
+
+} // namespace geduo
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * @file : parallel.cc
+ * @brief: 数据并行算法的实现
+ */
+#include "parallel.h"
+#include "scheduler.h"
+
+namespace geduo {
+
+namespace detail {
+
+size_t ParallelConcurrency(Scheduler* scheduler) {
+    if (!scheduler) {
+        scheduler = Scheduler::GetThis();
+    }
+    return scheduler ? std::max<size_t>(1, scheduler->getThreadCount()) : 1;
+}
+
+} // namespace detail
+
+ParallelGroup::ParallelGroup(Scheduler* scheduler)
+    :m_scheduler(scheduler ? scheduler : Scheduler::GetThis()) {
+}
+
+ParallelGroup::~ParallelGroup() {
+    // 未调用 wait 时仍要等任务结束, 任务持有本对象的指针; 异常被丢弃
+    if (!m_waited) {
+        m_waited = true;
+        done();
+        m_waiter.wait();
+    }
+}
+
+size_t ParallelGroup::getConcurrency() const {
+    return detail::ParallelConcurrency(m_scheduler);
+}
+
+void ParallelGroup::run(const std::function<void()>& cb) {
+    if (m_cancelled) {
+        return;
+    }
+    try {
+        cb();
+    } catch (...) {
+        MutexType::Lock lock(m_mutex);
+        if (!m_exception) {
+            m_exception = std::current_exception();
+        }
+        m_cancelled = true;
+    }
+}
+
+void ParallelGroup::spawn(std::function<void()> cb) {
+    if (!m_scheduler) {
+        run(cb);
+        return;
+    }
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    m_scheduler->schedule(std::function<void()>([this, cb]() {
+        run(cb);
+        done();
+    }));
+}
+
+void ParallelGroup::done() {
+    if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_waiter.notify();
+    }
+}
+
+void ParallelGroup::wait() {
+    if (m_waited) {
+        return;
+    }
+    m_waited = true;
+    done();
+    m_waiter.wait();
+    std::exception_ptr e;
+    {
+        MutexType::Lock lock(m_mutex);
+        e.swap(m_exception);
+    }
+    if (e) {
+        std::rethrow_exception(e);
+    }
+}
+
+} // namespace geduo
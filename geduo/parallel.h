@@ -0,0 +1,208 @@
+/*
+ * @file : parallel.h
+ * @brief: 基于协程调度器的数据并行算法
+ * @details parallel_for / parallel_reduce / parallel_transform / parallel_sort 把区间递归二分,
+ *          拆出的右半部分作为任务投递到调度器, 空闲的工作线程取走执行, 左半部分继续在当前任务中拆分,
+ *          直到不超过块大小. 未指定块大小时按 元素数 / (线程数 * 8) 自适应.
+ *          调用方在调度器的协程中时让出等待, 否则阻塞等待; 调用方自身也执行第一块.
+ *          scheduler 为 nullptr 时使用当前线程的调度器, 都没有时串行执行
+ */
+
+#ifndef __GEDUO_PARALLEL_H__
+#define __GEDUO_PARALLEL_H__
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "fiber.h"
+#include "mutex.h"
+
+namespace geduo {
+
+class Scheduler;
+
+/**
+ * @brief 一组并行任务的汇合点
+ * @details 任务抛出的第一个异常在 wait 中重新抛出, 之后尚未开始的任务被跳过
+ */
+class ParallelGroup : Noncopyable {
+public:
+    typedef Spinlock MutexType;
+
+    /// @param[in] scheduler 为 nullptr 时使用当前线程的调度器, 都没有时 spawn 直接执行
+    explicit ParallelGroup(Scheduler* scheduler = nullptr);
+    ~ParallelGroup();
+
+    /// @brief 投递任务到调度器
+    void spawn(std::function<void()> cb);
+
+    /// @brief 在当前协程中执行任务, 异常记录到组中
+    void run(const std::function<void()>& cb);
+
+    /// @brief 等待所有任务结束, 重新抛出任务中的第一个异常
+    void wait();
+
+    /// @brief 是否已有任务抛出异常
+    bool isCancelled() const { return m_cancelled; }
+
+    /// @brief 调度器的线程数, 串行执行时为 1
+    size_t getConcurrency() const;
+private:
+    void done();
+private:
+    Scheduler* m_scheduler;
+    /// 未结束的任务数, 包括 wait 的调用方
+    std::atomic<size_t> m_pending = {1};
+    std::atomic<bool> m_cancelled = {false};
+    bool m_waited = false;
+    FiberWaiter m_waiter;
+    MutexType m_mutex;
+    std::exception_ptr m_exception;
+};
+
+namespace detail {
+
+/// @brief 调度器的线程数, scheduler 为 nullptr 时取当前线程的调度器, 都没有时为 1
+size_t ParallelConcurrency(Scheduler* scheduler);
+
+/// @brief 每块的元素数, grain 为 0 时自适应
+inline size_t ParallelChunk(size_t n, size_t grain, size_t concurrency) {
+    if (grain) {
+        return grain;
+    }
+    return std::max<size_t>(1, n / (concurrency * 8));
+}
+
+template<class Index, class F>
+void ParallelSplit(ParallelGroup& group, Index begin, Index end, size_t chunk, const F& f) {
+    while ((size_t)(end - begin) > chunk && !group.isCancelled()) {
+        Index mid = begin + (end - begin) / 2;
+        Index right = end;
+        group.spawn([&group, mid, right, chunk, &f]() {
+            ParallelSplit(group, mid, right, chunk, f);
+        });
+        end = mid;
+    }
+    if (!group.isCancelled()) {
+        f(begin, end);
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief 对 [begin, end) 的每个子区间调用 f(sub_begin, sub_end)
+ * @param[in] grain 每块最多的元素数, 0 表示自适应
+ */
+template<class Index, class F>
+void parallel_for_range(Scheduler* scheduler, Index begin, Index end, F f, size_t grain = 0) {
+    if (!(begin < end)) {
+        return;
+    }
+    ParallelGroup group(scheduler);
+    size_t chunk = detail::ParallelChunk(end - begin, grain, group.getConcurrency());
+    group.run([&]() {
+        detail::ParallelSplit(group, begin, end, chunk, f);
+    });
+    group.wait();
+}
+
+/// @brief 对 [begin, end) 的每个下标(或随机访问迭代器)调用 f(i)
+template<class Index, class F>
+void parallel_for(Scheduler* scheduler, Index begin, Index end, F f, size_t grain = 0) {
+    parallel_for_range(scheduler, begin, end, [&f](Index b, Index e) {
+        for (; b != e; ++b) {
+            f(b);
+        }
+    }, grain);
+}
+
+/**
+ * @brief 并行归约
+ * @param[in] map 对子区间求值 map(sub_begin, sub_end, identity) -> T
+ * @param[in] combine 合并两个结果, 要求满足结合律; 按子区间的先后顺序合并, 不要求交换律
+ */
+template<class T, class Index, class Map, class Combine>
+T parallel_reduce(Scheduler* scheduler, Index begin, Index end, T identity
+                  ,Map map, Combine combine, size_t grain = 0) {
+    if (!(begin < end)) {
+        return identity;
+    }
+    typedef std::pair<Index, T> Partial;
+    std::vector<Partial> partials;
+    Spinlock mutex;
+    parallel_for_range(scheduler, begin, end, [&](Index b, Index e) {
+        T v = map(b, e, identity);
+        Spinlock::Lock lock(mutex);
+        partials.emplace_back(b, std::move(v));
+    }, grain);
+    std::sort(partials.begin(), partials.end(), [](const Partial& a, const Partial& b) {
+        return a.first < b.first;
+    });
+    T result = identity;
+    for (auto& i : partials) {
+        result = combine(std::move(result), std::move(i.second));
+    }
+    return result;
+}
+
+/// @brief 并行 std::transform, 迭代器要求随机访问
+template<class InputIt, class OutputIt, class F>
+OutputIt parallel_transform(Scheduler* scheduler, InputIt first, InputIt last
+                            ,OutputIt out, F f, size_t grain = 0) {
+    parallel_for_range(scheduler, first, last, [&](InputIt b, InputIt e) {
+        std::transform(b, e, out + (b - first), f);
+    }, grain);
+    return out + (last - first);
+}
+
+/**
+ * @brief 并行排序(不稳定)
+ * @details 分块并行 std::sort, 再按轮次两两并行 std::inplace_merge
+ */
+template<class RandomIt, class Compare>
+void parallel_sort(Scheduler* scheduler, RandomIt first, RandomIt last
+                   ,Compare comp, size_t grain = 0) {
+    size_t n = last - first;
+    if (n < 2) {
+        return;
+    }
+    // 块数取线程数的若干倍, 合并轮数为 log2(块数)
+    size_t chunk = grain ? grain
+            : std::max<size_t>(1024, n / (detail::ParallelConcurrency(scheduler) * 4));
+    size_t count = (n + chunk - 1) / chunk;
+    if (count < 2) {
+        std::sort(first, last, comp);
+        return;
+    }
+    parallel_for(scheduler, (size_t)0, count, [&](size_t i) {
+        std::sort(first + i * chunk, first + std::min(n, (i + 1) * chunk), comp);
+    }, 1);
+    for (size_t width = chunk; width < n; width *= 2) {
+        size_t pairs = (n + 2 * width - 1) / (2 * width);
+        parallel_for(scheduler, (size_t)0, pairs, [&](size_t i) {
+            size_t lo = i * 2 * width;
+            size_t mid = std::min(n, lo + width);
+            size_t hi = std::min(n, lo + 2 * width);
+            if (mid < hi) {
+                std::inplace_merge(first + lo, first + mid, first + hi, comp);
+            }
+        }, 1);
+    }
+}
+
+template<class RandomIt>
+void parallel_sort(Scheduler* scheduler, RandomIt first, RandomIt last, size_t grain = 0) {
+    parallel_sort(scheduler, first, last
+            ,std::less<typename std::iterator_traits<RandomIt>::value_type>(), grain);
+}
+
+} // namespace geduo
+
+#endif
@@ -7,6 +7,7 @@
  * @Description:  协程调度器的具体实现
  */ 
 #include "scheduler.h"
+#include "clock.h"
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
@@ -108,7 +109,7 @@ void Scheduler::stop() {
         tickle();
     }
 
-    if (m_rootFiber && !stopping) {
+    if (m_rootFiber && !stopping()) {
         m_rootFiber->call();
     }
 
@@ -131,7 +132,8 @@ void Scheduler::run() {
     GEDUO_LOG_DEBUG(g_logger) << m_name << " run";
     set_hook_enable(true);
     setThis();
-    if (geduo::GetThreadId() != m_rootThread) {
+    int thread_id = geduo::GetThreadId();
+    if (thread_id != m_rootThread) {
         t_scheduler_fiber = Fiber::GetThis().get();
     }
 
@@ -140,6 +142,7 @@ void Scheduler::run() {
 
     FiberAndThread ft;
     while (true) {
+        TickClock::Update();
         ft.reset();
         bool tickle_me = false;
         bool is_active = false;
@@ -147,7 +150,7 @@ void Scheduler::run() {
             MutexType::Lock lock(m_mutex);
             auto it = m_fibers.begin();
             while (it != m_fibers.end()) {
-                if (it->thread != -1 && it->thread != geduo::GetThreadId()) {
+                if (it->thread != -1 && it->thread != thread_id) {
                     ++it;
                     tickle_me = true;
                     continue;
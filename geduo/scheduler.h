@@ -31,6 +31,9 @@ public:
     /// @brief 返回协程调度器名称
     const std::string& getName() const { return m_name; }
 
+    /// @brief 返回工作线程数, use_caller 时包含调用线程
+    size_t getThreadCount() const { return m_threadCount + (m_rootFiber ? 1 : 0); }
+
     /// @brief 返回当前协程调度器
     static Scheduler* GetThis();
 
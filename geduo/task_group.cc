@@ -0,0 +1,143 @@
+/*
+ * @file : task_group.cc
+ * @brief: 结构化并发的实现
+ */
+#include <errno.h>
+#include <algorithm>
+
+#include "task_group.h"
+#include "macro.h"
+#include "scheduler.h"
+
+namespace geduo {
+
+void WaitGroup::add(int64_t n) {
+    int64_t count = m_count.fetch_add(n, std::memory_order_acq_rel) + n;
+    GEDUO_ASSERT2(count >= 0, "WaitGroup count < 0");
+    if (count != 0) {
+        return;
+    }
+    // 持锁唤醒, 等待方被取消后从列表中移除并析构 FiberWaiter 时不会与这里交错
+    MutexType::Lock lock(m_mutex);
+    for (auto i : m_waiters) {
+        i->notify();
+    }
+    m_waiters.clear();
+}
+
+bool WaitGroup::wait() {
+    if (m_count.load(std::memory_order_acquire) == 0) {
+        return true;
+    }
+    CancelToken::ptr token = CancelToken::GetThis();
+    if (token && token->isCancelled()) {
+        errno = ECANCELED;
+        return false;
+    }
+    FiberWaiter waiter;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_count.load(std::memory_order_acquire) == 0) {
+            return true;
+        }
+        m_waiters.push_back(&waiter);
+    }
+    uint64_t cancel_id = 0;
+    if (token) {
+        cancel_id = token->addCallback([&waiter]() {
+            waiter.notify();
+        });
+    }
+    waiter.wait();
+    if (token) {
+        token->removeCallback(cancel_id);
+    }
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = std::find(m_waiters.begin(), m_waiters.end(), &waiter);
+        if (it != m_waiters.end()) {
+            m_waiters.erase(it);
+        }
+    }
+    if (m_count.load(std::memory_order_acquire) == 0) {
+        return true;
+    }
+    errno = ECANCELED;
+    return false;
+}
+
+TaskGroup::TaskGroup(Scheduler* scheduler, bool cancel_on_error)
+    :m_scheduler(scheduler ? scheduler : Scheduler::GetThis())
+    ,m_cancelOnError(cancel_on_error)
+    ,m_token(std::make_shared<CancelToken>(CancelToken::GetThis())) {
+}
+
+TaskGroup::~TaskGroup() {
+    if (!m_joined) {
+        join();
+    }
+}
+
+void TaskGroup::run(const std::function<void()>& cb) {
+    if (m_token->isCancelled()) {
+        return;
+    }
+    CancelToken::ptr old = CancelToken::SetThis(m_token);
+    try {
+        cb();
+    } catch (...) {
+        ++m_errors;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (!m_exception) {
+                m_exception = std::current_exception();
+            }
+        }
+        if (m_cancelOnError) {
+            m_token->cancel();
+        }
+    }
+    CancelToken::SetThis(old);
+}
+
+void TaskGroup::spawn(std::function<void()> cb) {
+    GEDUO_ASSERT2(!m_joined, "TaskGroup::spawn after wait");
+    if (!m_scheduler) {
+        run(cb);
+        return;
+    }
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    m_scheduler->schedule(std::function<void()>([this, cb]() {
+        run(cb);
+        finish();
+    }));
+}
+
+void TaskGroup::finish() {
+    if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_waiter.notify();
+    }
+}
+
+void TaskGroup::join() {
+    m_joined = true;
+    finish();
+    m_waiter.wait();
+}
+
+void TaskGroup::wait() {
+    if (m_joined) {
+        return;
+    }
+    join();
+    std::exception_ptr e;
+    {
+        MutexType::Lock lock(m_mutex);
+        e.swap(m_exception);
+    }
+    if (e) {
+        std::rethrow_exception(e);
+    }
+}
+
+} // namespace geduo
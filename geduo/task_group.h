@@ -0,0 +1,106 @@
+/*
+ * @file : task_group.h
+ * @brief: 结构化并发: WaitGroup 与 TaskGroup
+ * @details TaskGroup 启动的子协程共享一个 CancelToken, 其父节点是创建 TaskGroup 时当前协程的 token,
+ *          外层取消会传递到内层. 子任务抛出异常时可选择取消其余任务, wait 等所有子任务结束后
+ *          重新抛出第一个异常. 取消是协作式的: 子任务在阻塞点被唤醒并失败(errno 为 ECANCELED),
+ *          或自行检查 CancelToken::IsCancelled
+ */
+
+#ifndef __GEDUO_TASK_GROUP_H__
+#define __GEDUO_TASK_GROUP_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include "cancel.h"
+#include "fiber.h"
+#include "mutex.h"
+
+namespace geduo {
+
+class Scheduler;
+
+/**
+ * @brief 计数等待
+ * @details 与 Go 的 sync.WaitGroup 相同: add 增加计数, done 减少, wait 等待计数归零
+ */
+class WaitGroup : Noncopyable {
+public:
+    typedef Mutex MutexType;
+
+    explicit WaitGroup(int64_t count = 0)
+        :m_count(count) {
+    }
+
+    void add(int64_t n = 1);
+    void done() { add(-1); }
+
+    int64_t getCount() const { return m_count; }
+
+    /**
+     * @brief 等待计数归零, 协程中让出协程
+     * @return 当前协程被取消时返回 false, errno 为 ECANCELED
+     */
+    bool wait();
+private:
+    MutexType m_mutex;
+    std::atomic<int64_t> m_count;
+    std::vector<FiberWaiter*> m_waiters;
+};
+
+class TaskGroup : Noncopyable {
+public:
+    typedef Spinlock MutexType;
+
+    /**
+     * @param[in] scheduler 子任务所在的调度器, 为 nullptr 时使用当前线程的调度器, 都没有时 spawn 直接执行
+     * @param[in] cancel_on_error 任一子任务抛出异常时是否取消其余子任务
+     */
+    explicit TaskGroup(Scheduler* scheduler = nullptr, bool cancel_on_error = true);
+
+    /// @brief 未调用 wait 时等待所有子任务结束, 异常被丢弃
+    ~TaskGroup();
+
+    /// @brief 启动子任务, 组已取消时子任务不再执行
+    void spawn(std::function<void()> cb);
+
+    /**
+     * @brief 等待所有子任务结束, 有子任务抛出异常时重新抛出第一个
+     * @details 等待本身不会因取消而提前返回, 保证子任务不会在组之外继续运行
+     */
+    void wait();
+
+    /// @brief 取消所有子任务
+    void cancel() { m_token->cancel(); }
+
+    bool isCancelled() const { return m_token->isCancelled(); }
+
+    /// @brief 子任务共享的 token
+    const CancelToken::ptr& getToken() const { return m_token; }
+
+    /// @brief 抛出异常的子任务数
+    size_t getErrorCount() const { return m_errors; }
+private:
+    void run(const std::function<void()>& cb);
+    void finish();
+    void join();
+private:
+    Scheduler* m_scheduler;
+    bool m_cancelOnError;
+    CancelToken::ptr m_token;
+    /// 未结束的子任务数, 包括等待方
+    std::atomic<size_t> m_pending = {1};
+    std::atomic<size_t> m_errors = {0};
+    bool m_joined = false;
+    FiberWaiter m_waiter;
+    MutexType m_mutex;
+    std::exception_ptr m_exception;
+};
+
+} // namespace geduo
+
+#endif
@@ -22,6 +22,10 @@ Thread* Thread::GetThis() {
     return t_thread;
 }
 
+const std::string& Thread::GetName() {
+    return t_thread_name;
+}
+
 void Thread::SetName(const std::string& name) {
     if(name.empty()) {
         return;
@@ -33,7 +33,7 @@ public:
     /// @brief 获取当前线程指针
     static Thread* GetThis();
 
-    /// @brief 获取当前线程名称
+    /// @brief 获取当前线程名称, 返回线程本地变量的引用, 不拷贝
     static const std::string& GetName();
 
     /// @brief 设置当前线程名称
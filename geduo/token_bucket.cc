@@ -0,0 +1,111 @@
+/*
+ * @file : token_bucket.cc
+ * @brief: 令牌桶限速器的实现
+ */
+#include <algorithm>
+#include <unistd.h>
+
+#include "token_bucket.h"
+#include "clock.h"
+#include "fiber.h"
+
+namespace geduo {
+
+/// @brief n 个令牌按 rate 个/秒产生所需的纳秒数
+static uint64_t TokensToNS(uint64_t n, uint64_t rate) {
+    unsigned __int128 ns = (unsigned __int128)n * 1000000000ull / rate;
+    return ns > (uint64_t)-1 / 2 ? (uint64_t)-1 / 2 : (uint64_t)ns;
+}
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst, TokenBucket::ptr parent)
+    :m_rate(rate)
+    ,m_burst(burst ? burst : rate)
+    ,m_parent(std::move(parent)) {
+}
+
+bool TokenBucket::tryAcquire(uint64_t n) {
+    uint64_t rate = m_rate;
+    uint64_t cost = 0;
+    if (rate) {
+        cost = TokensToNS(n, rate);
+        uint64_t window = TokensToNS(m_burst, rate);
+        uint64_t now = Clock::MonotonicNS();
+        uint64_t tat = m_tat.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            next = std::max(tat, now) + cost;
+            if (next > now + window) {
+                return false;
+            }
+        } while (!m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+    }
+    if (m_parent && !m_parent->tryAcquire(n)) {
+        // 上级桶不足, 归还本桶的令牌
+        if (cost) {
+            m_tat.fetch_sub(cost, std::memory_order_relaxed);
+        }
+        return false;
+    }
+    return true;
+}
+
+uint64_t TokenBucket::reserve(uint64_t n) {
+    uint64_t wait = 0;
+    uint64_t rate = m_rate;
+    if (rate) {
+        uint64_t cost = TokensToNS(n, rate);
+        uint64_t window = TokensToNS(m_burst, rate);
+        uint64_t now = Clock::MonotonicNS();
+        uint64_t tat = m_tat.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            next = std::max(tat, now) + cost;
+        } while (!m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+        if (next > now + window) {
+            wait = next - now - window;
+        }
+    }
+    if (m_parent) {
+        wait = std::max(wait, m_parent->reserve(n));
+    }
+    return wait;
+}
+
+void TokenBucket::acquire(uint64_t n) {
+    uint64_t wait = reserve(n);
+    if (wait) {
+        Wait(wait);
+    }
+}
+
+uint64_t TokenBucket::getAvailable() const {
+    uint64_t rate = m_rate;
+    uint64_t burst = m_burst;
+    if (!rate) {
+        return burst;
+    }
+    uint64_t now = Clock::MonotonicNS() + TokensToNS(burst, rate);
+    uint64_t tat = m_tat.load(std::memory_order_relaxed);
+    if (tat >= now) {
+        return 0;
+    }
+    unsigned __int128 tokens = (unsigned __int128)(now - tat) * rate / 1000000000ull;
+    return tokens > burst ? burst : (uint64_t)tokens;
+}
+
+void TokenBucket::setRate(uint64_t rate, uint64_t burst) {
+    m_rate = rate;
+    m_burst = burst ? burst : rate;
+}
+
+void TokenBucket::Wait(uint64_t ns) {
+    if (Fiber::CanYield()) {
+        // 挂起协程, 到期由截止时间线程唤醒, 期间线程可以执行其他协程
+        FiberWaiter waiter;
+        waiter.waitUntil(Clock::MonotonicNS() + ns);
+    } else {
+        usleep((ns + 999) / 1000);
+    }
+}
+
+} // namespace geduo
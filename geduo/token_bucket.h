@@ -0,0 +1,71 @@
+/*
+ * @file : token_bucket.h
+ * @brief: 令牌桶限速器
+ * @details 令牌按 rate 个/秒匀速产生, 桶内最多积累 burst 个. 令牌计数使用 GCRA
+ *          (理论到达时间) 表示, 只需一个原子变量, 取令牌为一次 CAS, 可在多个流/连接、
+ *          多个线程间共享. 桶可以挂在上级桶下(如 租户桶 -> 全局桶), 取令牌时需同时满足
+ */
+
+#ifndef __GEDUO_TOKEN_BUCKET_H__
+#define __GEDUO_TOKEN_BUCKET_H__
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+namespace geduo {
+
+class TokenBucket : Noncopyable {
+public:
+    typedef std::shared_ptr<TokenBucket> ptr;
+
+    /**
+     * @param[in] rate 每秒产生的令牌数, 0 表示不限速
+     * @param[in] burst 桶容量(允许的最大突发), 0 表示等于 rate
+     * @param[in] parent 上级桶, 取令牌时同时从上级桶中扣除
+     */
+    TokenBucket(uint64_t rate, uint64_t burst = 0, TokenBucket::ptr parent = nullptr);
+
+    /**
+     * @brief 尝试取 n 个令牌, 不等待
+     * @return 本桶及所有上级桶都有足够令牌时返回 true; n 大于 burst 时总是失败
+     */
+    bool tryAcquire(uint64_t n = 1);
+
+    /**
+     * @brief 取 n 个令牌, 不足时等待
+     * @details 调度器的协程中让出协程直到令牌足够, 不阻塞线程上的其他协程;
+     *          其他情况下 usleep. n 大于 burst 时先透支, 再按速率等待
+     */
+    void acquire(uint64_t n = 1);
+
+    /**
+     * @brief 预定 n 个令牌, 总是成功
+     * @return 令牌可用前需要等待的纳秒数, 0 表示立即可用
+     */
+    uint64_t reserve(uint64_t n);
+
+    /// @brief 当前桶内可用的令牌数(不含上级桶)
+    uint64_t getAvailable() const;
+
+    /// @brief 修改速率与容量, 已积累的令牌按新速率折算
+    void setRate(uint64_t rate, uint64_t burst = 0);
+    uint64_t getRate() const { return m_rate; }
+    uint64_t getBurst() const { return m_burst; }
+    const TokenBucket::ptr& getParent() const { return m_parent; }
+
+    /// @brief 等待 ns 纳秒, 协程中让出协程, 否则 usleep
+    static void Wait(uint64_t ns);
+private:
+    std::atomic<uint64_t> m_rate;
+    std::atomic<uint64_t> m_burst;
+    /// 理论到达时间(单调时钟纳秒), 桶内令牌数 = (now + burst 对应时长 - m_tat) * rate
+    std::atomic<uint64_t> m_tat = {0};
+    TokenBucket::ptr m_parent;
+};
+
+} // namespace geduo
+
+#endif
@@ -10,15 +10,23 @@
 #include <ifaddrs.h>
 #include <google/protobuf/unknown_field_set.h>
 
+#include "clock.h"
 #include "log.h"
 #include "fiber.h"
+#include "macro.h"
 
 namespace geduo {
 
 static geduo::Logger::ptr g_logger = GEDUO_LOG_NAME("system");
 
+/// 线程ID的线程本地缓存, 避免每次都调用 syscall(SYS_gettid)
+static thread_local pid_t t_thread_id = 0;
+
 pid_t GetThreadId() {
-    return syscall(SYS_gettid);
+    if (GEDUO_UNLIKELY(t_thread_id == 0)) {
+        t_thread_id = syscall(SYS_gettid);
+    }
+    return t_thread_id;
 }
 
 uint32_t GetFiberId() {
@@ -31,6 +39,7 @@ static std::string demangle(const char* str) {
     std::string rt;
     rt.resize(256);
     if(1 == sscanf(str, "%*[^(]%*[^_]%255[^)+]", &rt[0])) {
+        rt.resize(strlen(rt.c_str()));
         char* v = abi::__cxa_demangle(&rt[0], nullptr, &size, &status);
         if(v) {
             std::string result(v);
@@ -38,7 +47,9 @@ static std::string demangle(const char* str) {
             return result;
         }
     }
+    rt.resize(256);
     if(1 == sscanf(str, "%255s", &rt[0])) {
+        rt.resize(strlen(rt.c_str()));
         return rt;
     }
     return str;
@@ -46,20 +57,25 @@ static std::string demangle(const char* str) {
 
 void Backtrace(std::vector<std::string>& bt, int size, int skip) {
     void** array = (void**)malloc((sizeof(void*) * size));
-    size_t s = ::backtrace(array, size);
+    int s = ::backtrace(array, size);
+    if(s > skip) {
+        SymbolizeBacktrace(array + skip, s - skip, bt);
+    }
+    free(array);
+}
 
-    char** strings = backtrace_symbols(array, s);
+void SymbolizeBacktrace(void* const* frames, int size, std::vector<std::string>& bt) {
+    char** strings = backtrace_symbols(frames, size);
     if(strings == NULL) {
         GEDUO_LOG_ERROR(g_logger) << "backtrace_synbols error";
         return;
     }
 
-    for(size_t i = skip; i < s; ++i) {
+    for(int i = 0; i < size; ++i) {
         bt.push_back(demangle(strings[i]));
     }
 
     free(strings);
-    free(array);
 }
 
 std::string BacktraceToString(int size, int skip, const std::string& prefix) {
@@ -73,15 +89,11 @@ std::string BacktraceToString(int size, int skip, const std::string& prefix) {
 }
 
 uint64_t GetCurrentMS() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000ul  + tv.tv_usec / 1000;
+    return Clock::NowMS();
 }
 
 uint64_t GetCurrentUS() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000 * 1000ul  + tv.tv_usec;
+    return Clock::NowUS();
 }
 
 std::string Time2Str(time_t ts, const std::string& format) {
@@ -116,36 +128,16 @@ std::string ToLower(const std::string& name) {
 void FSUtil::ListAllFile(std::vector<std::string>& files
                             ,const std::string& path
                             ,const std::string& subfix) {
-    if(access(path.c_str(), 0) != 0) {
-        return;
-    }
-    DIR* dir = opendir(path.c_str());
-    if(dir == nullptr) {
-        return;
+    DirWalker::Options opt;
+    if(!subfix.empty()) {
+        opt.suffixes.push_back(subfix);
     }
-    struct dirent* dp = nullptr;
-    while((dp = readdir(dir)) != nullptr) {
-        if(dp->d_type == DT_DIR) {
-            if(!strcmp(dp->d_name, ".")
-                || !strcmp(dp->d_name, "..")) {
-                continue;
-            }
-            ListAllFile(files, path + "/" + dp->d_name, subfix);
-        } else if(dp->d_type == DT_REG) {
-            std::string filename(dp->d_name);
-            if(subfix.empty()) {
-                files.push_back(path + "/" + filename);
-            } else {
-                if(filename.size() < subfix.size()) {
-                    continue;
-                }
-                if(filename.substr(filename.length() - subfix.size()) == subfix) {
-                    files.push_back(path + "/" + filename);
-                }
-            }
+    DirWalker::Walk(path, [&files](const DirWalker::Entry& entry) {
+        if(entry.type == DT_REG) {
+            files.push_back(entry.path);
         }
-    }
-    closedir(dir);
+        return true;
+    }, opt);
 }
 
 static int __lstat(const char* file, struct stat* st = nullptr) {
@@ -426,91 +418,126 @@ static const char xdigit_chars[256] = {
     (uri_chars[(unsigned char)(c)])
 
 //-.0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz~
-std::string StringUtil::UrlEncode(const std::string& str, bool space_as_plus) {
+void StringUtil::UrlEncodeAppend(boost::string_view str, std::string& out, bool space_as_plus) {
     static const char *hexdigits = "0123456789ABCDEF";
-    std::string* ss = nullptr;
-    const char* end = str.c_str() + str.length();
-    for(const char* c = str.c_str() ; c < end; ++c) {
-        if(!CHAR_IS_UNRESERVED(*c)) {
-            if(!ss) {
-                ss = new std::string;
-                ss->reserve(str.size() * 1.2);
-                ss->append(str.c_str(), c - str.c_str());
-            }
-            if(*c == ' ' && space_as_plus) {
-                ss->append(1, '+');
-            } else {
-                ss->append(1, '%');
-                ss->append(1, hexdigits[(uint8_t)*c >> 4]);
-                ss->append(1, hexdigits[*c & 0xf]);
-            }
-        } else if(ss) {
-            ss->append(1, *c);
+    const char* begin = str.data();
+    const char* end = begin + str.size();
+    const char* run = begin;
+    for(const char* c = begin; c < end; ++c) {
+        if(CHAR_IS_UNRESERVED(*c)) {
+            continue;
+        }
+        if(run == begin) {
+            out.reserve(out.size() + str.size() * 1.2);
+        }
+        out.append(run, c - run);
+        run = c + 1;
+        if(*c == ' ' && space_as_plus) {
+            out.push_back('+');
+        } else {
+            char buf[3] = {'%', hexdigits[(uint8_t)*c >> 4], hexdigits[*c & 0xf]};
+            out.append(buf, 3);
         }
     }
-    if(!ss) {
-        return str;
-    } else {
-        std::string rt = *ss;
-        delete ss;
-        return rt;
-    }
+    out.append(run, end - run);
 }
 
-std::string StringUtil::UrlDecode(const std::string& str, bool space_as_plus) {
-    std::string* ss = nullptr;
+std::string StringUtil::UrlEncode(const std::string& str, bool space_as_plus) {
     const char* end = str.c_str() + str.length();
     for(const char* c = str.c_str(); c < end; ++c) {
-        if(*c == '+' && space_as_plus) {
-            if(!ss) {
-                ss = new std::string;
-                ss->append(str.c_str(), c - str.c_str());
-            }
-            ss->append(1, ' ');
-        } else if(*c == '%' && (c + 2) < end
-                    && isxdigit(*(c + 1)) && isxdigit(*(c + 2))){
-            if(!ss) {
-                ss = new std::string;
-                ss->append(str.c_str(), c - str.c_str());
-            }
-            ss->append(1, (char)(xdigit_chars[(int)*(c + 1)] << 4 | xdigit_chars[(int)*(c + 2)]));
-            c += 2;
-        } else if(ss) {
-            ss->append(1, *c);
+        if(!CHAR_IS_UNRESERVED(*c)) {
+            std::string rt;
+            UrlEncodeAppend(str, rt, space_as_plus);
+            return rt;
         }
     }
-    if(!ss) {
-        return str;
-    } else {
-        std::string rt = *ss;
-        delete ss;
-        return rt;
+    return str;
+}
+
+/// 解码 [src, end) 到 dst, dst 可以与 src 相同(原地解码), 返回写入末尾
+static char* UrlDecodeTo(const char* src, const char* end, char* dst, bool space_as_plus) {
+    boost::string_view specials = space_as_plus ? "%+" : "%";
+    while(src < end) {
+        size_t n = find_first_of(src, end - src, specials);
+        if(dst != src) {
+            memmove(dst, src, n);
+        }
+        src += n;
+        dst += n;
+        if(src >= end) {
+            break;
+        }
+        if(*src == '+') {
+            *dst++ = ' ';
+            ++src;
+        } else if((src + 2) < end
+                    && isxdigit(*(src + 1)) && isxdigit(*(src + 2))) {
+            *dst++ = (char)(xdigit_chars[(int)*(src + 1)] << 4 | xdigit_chars[(int)*(src + 2)]);
+            src += 3;
+        } else {
+            *dst++ = *src++;
+        }
     }
+    return dst;
 }
 
-std::string StringUtil::Trim(const std::string& str, const std::string& delimit) {
-    auto begin = str.find_first_not_of(delimit);
-    if(begin == std::string::npos) {
-        return "";
+void StringUtil::UrlDecodeAppend(boost::string_view str, std::string& out, bool space_as_plus) {
+    size_t old = out.size();
+    out.resize(old + str.size());
+    char* end = UrlDecodeTo(str.data(), str.data() + str.size(), &out[old], space_as_plus);
+    out.resize(end - out.c_str());
+}
+
+size_t StringUtil::UrlDecodeInPlace(char* str, size_t len, bool space_as_plus) {
+    return UrlDecodeTo(str, str + len, str, space_as_plus) - str;
+}
+
+void StringUtil::UrlDecodeInPlace(std::string& str, bool space_as_plus) {
+    if(str.empty()) {
+        return;
     }
-    auto end = str.find_last_not_of(delimit);
-    return str.substr(begin, end - begin + 1);
+    str.resize(UrlDecodeInPlace(&str[0], str.size(), space_as_plus));
 }
 
-std::string StringUtil::TrimLeft(const std::string& str, const std::string& delimit) {
+std::string StringUtil::UrlDecode(const std::string& str, bool space_as_plus) {
+    std::string rt = str;
+    UrlDecodeInPlace(rt, space_as_plus);
+    return rt;
+}
+
+boost::string_view StringUtil::TrimView(boost::string_view str, boost::string_view delimit) {
+    return TrimRightView(TrimLeftView(str, delimit), delimit);
+}
+
+boost::string_view StringUtil::TrimLeftView(boost::string_view str, boost::string_view delimit) {
     auto begin = str.find_first_not_of(delimit);
-    if(begin == std::string::npos) {
-        return "";
+    if(begin == boost::string_view::npos) {
+        return boost::string_view();
     }
     return str.substr(begin);
 }
 
-std::string StringUtil::TrimRight(const std::string& str, const std::string& delimit) {
+boost::string_view StringUtil::TrimRightView(boost::string_view str, boost::string_view delimit) {
     auto end = str.find_last_not_of(delimit);
-    if(end == std::string::npos) {
-        return "";
+    if(end == boost::string_view::npos) {
+        return boost::string_view();
     }
-    return str.substr(0, end);
+    return str.substr(0, end + 1);
+}
+
+std::string StringUtil::Trim(const std::string& str, const std::string& delimit) {
+    auto v = TrimView(str, delimit);
+    return std::string(v.data(), v.size());
+}
+
+std::string StringUtil::TrimLeft(const std::string& str, const std::string& delimit) {
+    auto v = TrimLeftView(str, delimit);
+    return std::string(v.data(), v.size());
+}
+
+std::string StringUtil::TrimRight(const std::string& str, const std::string& delimit) {
+    auto v = TrimRightView(str, delimit);
+    return std::string(v.data(), v.size());
 }
 
 std::string StringUtil::WStringToString(const std::wstring& ws) {
@@ -796,73 +823,65 @@ std::string PBToJsonString(const google::protobuf::Message& message) {
 }
 
 SpeedLimit::SpeedLimit(uint32_t speed)
-    :m_speed(speed)
-    ,m_countPerMS(0)
-    ,m_curCount(0)
-    ,m_curSec(0) {
-    if(speed == 0) {
-        m_speed = (uint32_t)-1;
-    }
-    m_countPerMS = m_speed / 1000.0;
+    :m_bucket(speed) {
 }
 
 void SpeedLimit::add(uint32_t v) {
-    uint64_t curms = geduo::GetCurrentMS();
-    if(curms / 1000 != m_curSec) {
-        m_curSec = curms / 1000;
-        m_curCount = v;
-        return;
-    }
-
-    m_curCount += v;
-
-    int usedms = curms % 1000;
-    int limitms = m_curCount / m_countPerMS;
+    m_bucket.acquire(v);
+}
 
-    if(usedms < limitms) {
-        usleep(1000 * (limitms - usedms));
+static TokenBucket::ptr CreateSpeedLimit(uint64_t speed) {
+    if(speed == 0 || speed == (uint64_t)-1) {
+        return nullptr;
     }
+    return std::make_shared<TokenBucket>(speed);
 }
 
+/// @brief 每次读写的块大小, 不超过桶容量, 避免每块都透支
+static uint64_t GetSpeedLimitChunk(const TokenBucket::ptr& limit) {
+    uint64_t per = 1024 * 64;
+    if(limit && limit->getRate()) {
+        per = std::min(per, std::max(limit->getBurst(), (uint64_t)1));
+    }
+    return per;
+}
 
 bool ReadFixFromStreamWithSpeed(std::istream& is, char* data,
                                const uint64_t& size, const uint64_t& speed) {
-    SpeedLimit::ptr limit;
-    if(dynamic_cast<std::ifstream*>(&is)) {
-        limit.reset(new SpeedLimit(speed));
-    }
+    return ReadFixFromStreamWithSpeed(is, data, size, CreateSpeedLimit(speed));
+}
 
+bool ReadFixFromStreamWithSpeed(std::istream& is, char* data,
+                               const uint64_t& size, TokenBucket::ptr limit) {
     uint64_t offset = 0;
-    uint64_t per = std::max((uint64_t)ceil(speed / 100.0), (uint64_t)1024 * 64);
+    uint64_t per = GetSpeedLimitChunk(limit);
     while(is && (offset < size)) {
         uint64_t s = size - offset > per ? per : size - offset;
-        is.read(data + offset, s);
-        offset += is.gcount();
-
         if(limit) {
-            limit->add(is.gcount());
+            limit->acquire(s);
         }
+        is.read(data + offset, s);
+        offset += is.gcount();
     }
     return offset == size;
 }
 
 bool WriteFixToStreamWithSpeed(std::ostream& os, const char* data,
                                const uint64_t& size, const uint64_t& speed) {
-     SpeedLimit::ptr limit;
-    if(dynamic_cast<std::ofstream*>(&os)) {
-        limit.reset(new SpeedLimit(speed));
-    }
+    return WriteFixToStreamWithSpeed(os, data, size, CreateSpeedLimit(speed));
+}
 
+bool WriteFixToStreamWithSpeed(std::ostream& os, const char* data,
+                               const uint64_t& size, TokenBucket::ptr limit) {
     uint64_t offset = 0;
-    uint64_t per = std::max((uint64_t)ceil(speed / 100.0), (uint64_t)1024 * 64);
+    uint64_t per = GetSpeedLimitChunk(limit);
     while(os && (offset < size)) {
         uint64_t s = size - offset > per ? per : size - offset;
-        os.write(data + offset, s);
-        offset += s;
-
         if(limit) {
-            limit->add(s);
+            limit->acquire(s);
         }
+        os.write(data + offset, s);
+        offset += s;
     }
 
     return offset == size;
@@ -19,11 +19,13 @@
 #include "util/hash_util.h"
 #include "util/json_util.h"
 #include "util/crypto_util.h"
+#include "token_bucket.h"
+#include "util/file_util.h"
 
 namespace geduo {
 
 /**
- * @brief 返回当前线程的ID
+ * @brief 返回当前线程的ID, 首次调用后缓存在线程本地变量中
  */
 pid_t GetThreadId();
 
@@ -40,6 +42,12 @@ uint32_t GetFiberId();
  */
 void Backtrace(std::vector<std::string>& bt, int size = 64, int skip = 1);
 
+/**
+ * @brief 符号化 backtrace() 抓取的返回地址
+ * @param[out] bt 追加每一层的符号, 能解析时为 demangle 后的函数名
+ */
+void SymbolizeBacktrace(void* const* frames, int size, std::vector<std::string>& bt);
+
 /**
  * @brief 获取当前栈信息的字符串
  * @param[in] size 栈的最大层数
@@ -50,6 +58,7 @@ std::string BacktraceToString(int size = 64, int skip = 2, const std::string& pr
 
 /**
  * @brief 获取当前时间的毫秒
+ * @details 基于 clock_gettime(vDSO), 更多时钟见 clock.h
  */
 uint64_t GetCurrentMS();
 
@@ -274,10 +283,20 @@ public:
 
     static std::string UrlEncode(const std::string& str, bool space_as_plus = true);
     static std::string UrlDecode(const std::string& str, bool space_as_plus = true);
+    /// 编码/解码结果追加到 out 末尾
+    static void UrlEncodeAppend(boost::string_view str, std::string& out, bool space_as_plus = true);
+    static void UrlDecodeAppend(boost::string_view str, std::string& out, bool space_as_plus = true);
+    /// 原地解码, 解码后长度不会变长, 返回新长度
+    static size_t UrlDecodeInPlace(char* str, size_t len, bool space_as_plus = true);
+    static void UrlDecodeInPlace(std::string& str, bool space_as_plus = true);
 
     static std::string Trim(const std::string& str, const std::string& delimit = " \t\r\n");
     static std::string TrimLeft(const std::string& str, const std::string& delimit = " \t\r\n");
     static std::string TrimRight(const std::string& str, const std::string& delimit = " \t\r\n");
+    /// 不拷贝, 返回 str 的子视图
+    static boost::string_view TrimView(boost::string_view str, boost::string_view delimit = " \t\r\n");
+    static boost::string_view TrimLeftView(boost::string_view str, boost::string_view delimit = " \t\r\n");
+    static boost::string_view TrimRightView(boost::string_view str, boost::string_view delimit = " \t\r\n");
 
 
     static std::string WStringToString(const std::wstring& ws);
@@ -369,25 +388,33 @@ bool WriteToStream(std::ostream& os, const std::vector<T>& v) {
     return (bool)os;
 }
 
+/// @brief 单个流的限速器, 基于 TokenBucket, 等待时不阻塞线程上的其他协程
 class SpeedLimit {
 public:
     typedef std::shared_ptr<SpeedLimit> ptr;
+    /// @param[in] speed 每秒字节数, 0 表示不限速
     SpeedLimit(uint32_t speed);
     void add(uint32_t v);
 private:
-    uint32_t m_speed;
-    float m_countPerMS;
-
-    uint32_t m_curCount;
-    uint32_t m_curSec;
+    TokenBucket m_bucket;
 };
 
+/// @brief 限速读取, speed 为每秒字节数, 0 或 -1 表示不限速
 bool ReadFixFromStreamWithSpeed(std::istream& is, char* data,
                     const uint64_t& size, const uint64_t& speed = -1);
 
+/// @brief 使用共享的令牌桶限速读取, 多个流共用同一个桶时合计速率受限
+bool ReadFixFromStreamWithSpeed(std::istream& is, char* data,
+                    const uint64_t& size, TokenBucket::ptr limit);
+
+/// @brief 限速写入, speed 为每秒字节数, 0 或 -1 表示不限速
 bool WriteFixToStreamWithSpeed(std::ostream& os, const char* data,
                             const uint64_t& size, const uint64_t& speed = -1);
 
+/// @brief 使用共享的令牌桶限速写入
+bool WriteFixToStreamWithSpeed(std::ostream& os, const char* data,
+                            const uint64_t& size, TokenBucket::ptr limit);
+
 template<class T>
 bool WriteToStreamWithSpeed(std::ostream& os, const T& v,
                             const uint64_t& speed = -1) {
@@ -1,4 +1,5 @@
 #include "crypto_util.h"
+#include "../offload.h"
 #include <stdio.h>
 #include <iostream>
 
@@ -60,30 +61,206 @@ int32_t CryptoUtil::Crypto(const EVP_CIPHER* cipher, bool enc
                            ,const void* key, const void* iv
                            ,const void* in, int32_t in_len
                            ,void* out, int32_t* out_len) {
+    // 每个线程复用一个上下文, 避免每次调用都分配/释放 EVP_CIPHER_CTX
+    static thread_local CipherContext s_ctx;
+    if(s_ctx.init(cipher, enc, key, iv) < 0) {
+        return -1;
+    }
+    int32_t len = s_ctx.update(in, in_len, out);
+    if(len < 0) {
+        return -1;
+    }
+    *out_len = len;
+    len = s_ctx.final((uint8_t*)out + len);
+    if(len < 0) {
+        return -1;
+    }
+    *out_len += len;
+    return *out_len;
+}
+
+static int32_t AeadCrypto(const EVP_CIPHER* cipher, const void* key, const void* iv
+                          ,const void* aad, int32_t aad_len
+                          ,const void* in, int32_t in_len
+                          ,void* out, void* tag, bool encode) {
+    CipherContext ctx;
+    if(ctx.init(cipher, encode, key, iv) < 0) {
+        return -1;
+    }
+    if(aad_len > 0 && ctx.updateAAD(aad, aad_len) < 0) {
+        return -1;
+    }
+    if(!encode && ctx.setTag(tag) < 0) {
+        return -1;
+    }
+    int32_t len = ctx.update(in, in_len, out);
+    if(len < 0) {
+        return -1;
+    }
+    int32_t tmp_len = ctx.final((uint8_t*)out + len);
+    if(tmp_len < 0) {
+        return -1;
+    }
+    len += tmp_len;
+    if(encode && ctx.getTag(tag) < 0) {
+        return -1;
+    }
+    return len;
+}
+
+int32_t CryptoUtil::AES256Gcm(const void* key, const void* iv
+                              ,const void* aad, int32_t aad_len
+                              ,const void* in, int32_t in_len
+                              ,void* out, void* tag, bool encode) {
+    return AeadCrypto(EVP_aes_256_gcm(), key, iv, aad, aad_len
+                      ,in, in_len, out, tag, encode);
+}
+
+int32_t CryptoUtil::ChaCha20Poly1305(const void* key, const void* iv
+                              ,const void* aad, int32_t aad_len
+                              ,const void* in, int32_t in_len
+                              ,void* out, void* tag, bool encode) {
+    return AeadCrypto(EVP_chacha20_poly1305(), key, iv, aad, aad_len
+                      ,in, in_len, out, tag, encode);
+}
+
+CipherContext::ptr CipherContext::Create(const EVP_CIPHER* cipher, bool enc
+                                        ,const void* key, const void* iv
+                                        ,int32_t iv_len) {
+    CipherContext::ptr rt(new CipherContext);
+    if(rt->init(cipher, enc, key, iv, iv_len) < 0) {
+        return nullptr;
+    }
+    return rt;
+}
+
+CipherContext::CipherContext()
+    :m_ctx(EVP_CIPHER_CTX_new())
+    ,m_cipher(nullptr)
+    ,m_enc(true)
+    ,m_aead(false) {
+}
+
+CipherContext::~CipherContext() {
+    if(m_ctx) {
+        EVP_CIPHER_CTX_free(m_ctx);
+    }
+}
+
+int32_t CipherContext::init(const EVP_CIPHER* cipher, bool enc
+                            ,const void* key, const void* iv
+                            ,int32_t iv_len) {
+    m_cipher = nullptr;
+    if(!m_ctx || !cipher) {
+        return -1;
+    }
+    // 先设置算法, AEAD 的 iv 长度需在设置 key/iv 之前指定
+    if(EVP_CipherInit_ex(m_ctx, cipher, nullptr, nullptr, nullptr, enc) != 1) {
+        return -1;
+    }
+    m_aead = EVP_CIPHER_flags(cipher) & EVP_CIPH_FLAG_AEAD_CIPHER;
+    if(m_aead && iv_len > 0
+            && EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_SET_IVLEN, iv_len, nullptr) != 1) {
+        return -1;
+    }
+    if(EVP_CipherInit_ex(m_ctx, nullptr, nullptr, (const uint8_t*)key
+                ,(const uint8_t*)iv, enc) != 1) {
+        return -1;
+    }
+    m_cipher = cipher;
+    m_enc = enc;
+    return 0;
+}
+
+int32_t CipherContext::reset(const void* iv) {
+    // AEAD 每条消息都必须使用新的 iv
+    if(!m_cipher || (m_aead && !iv)) {
+        return -1;
+    }
+    // key 传 nullptr, 保留已展开的密钥
+    if(EVP_CipherInit_ex(m_ctx, nullptr, nullptr, nullptr
+                ,(const uint8_t*)iv, m_enc) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int32_t CipherContext::updateAAD(const void* aad, int32_t len) {
     int tmp_len = 0;
-    bool has_error = false;
-    EVP_CIPHER_CTX ctx;
-    do {
-        //static CryptoInit s_crypto_init;
-        EVP_CIPHER_CTX_init(&ctx);
-        EVP_CipherInit_ex(&ctx, cipher, nullptr, (const uint8_t*)key
-                ,(const uint8_t*)iv, enc);
-        if(EVP_CipherUpdate(&ctx, (uint8_t*)out, &tmp_len, (const uint8_t*)in, in_len) != 1) {
-            has_error = true;
-            break;
-        }
-        *out_len = tmp_len;
-        if(EVP_CipherFinal_ex(&ctx, (uint8_t*)out + tmp_len, &tmp_len) != 1) {
-            has_error = true;
-            break;
+    if(!m_aead || EVP_CipherUpdate(m_ctx, nullptr, &tmp_len
+                , (const uint8_t*)aad, len) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int32_t CipherContext::update(const void* in, int32_t in_len, void* out) {
+    int tmp_len = 0;
+    if(!m_cipher || EVP_CipherUpdate(m_ctx, (uint8_t*)out, &tmp_len
+                , (const uint8_t*)in, in_len) != 1) {
+        return -1;
+    }
+    return tmp_len;
+}
+
+int32_t CipherContext::update(const struct iovec* iov, int iovcnt, void* out) {
+    int32_t len = 0;
+    for(int i = 0; i < iovcnt; ++i) {
+        int32_t rt = update(iov[i].iov_base, iov[i].iov_len, (uint8_t*)out + len);
+        if(rt < 0) {
+            return -1;
         }
-        *out_len += tmp_len;
-    } while(0);
-    EVP_CIPHER_CTX_cleanup(&ctx);
-    if(has_error) {
+        len += rt;
+    }
+    return len;
+}
+
+int32_t CipherContext::update(const void* in, int32_t in_len, std::string& out) {
+    size_t old = out.size();
+    out.resize(old + in_len + getBlockSize());
+    int32_t rt = update(in, in_len, &out[old]);
+    out.resize(old + (rt > 0 ? rt : 0));
+    return rt;
+}
+
+int32_t CipherContext::final(void* out) {
+    int tmp_len = 0;
+    if(!m_cipher || EVP_CipherFinal_ex(m_ctx, (uint8_t*)out, &tmp_len) != 1) {
         return -1;
     }
-    return *out_len;
+    return tmp_len;
+}
+
+int32_t CipherContext::final(std::string& out) {
+    size_t old = out.size();
+    out.resize(old + getBlockSize());
+    int32_t rt = final(&out[old]);
+    out.resize(old + (rt > 0 ? rt : 0));
+    return rt;
+}
+
+int32_t CipherContext::getTag(void* tag, int32_t len) {
+    if(!m_aead || !m_enc
+            || EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_GET_TAG, len, tag) != 1) {
+        return -1;
+    }
+    return len;
+}
+
+int32_t CipherContext::setTag(const void* tag, int32_t len) {
+    if(!m_aead || m_enc
+            || EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_AEAD_SET_TAG, len, (void*)tag) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+int32_t CipherContext::getBlockSize() const {
+    return m_cipher ? EVP_CIPHER_block_size(m_cipher) : 0;
+}
+
+int32_t CipherContext::getIvLength() const {
+    return m_cipher ? EVP_CIPHER_CTX_iv_length(m_ctx) : 0;
 }
 
 int32_t RSACipher::GenerateKey(const std::string& pubkey_file
@@ -264,6 +441,26 @@ int32_t RSACipher::publicDecrypt(const void* from, int flen,
     return len;
 }
 
+int32_t RSACipher::privateEncrypt(OffloadPool* pool, const void* from, int flen,
+                       std::string& to, int padding) {
+    if(!pool) {
+        pool = OffloadPool::GetDefault();
+    }
+    return pool->run([&]() {
+        return privateEncrypt(from, flen, to, padding);
+    }, (uint64_t)(uintptr_t)m_prikey);
+}
+
+int32_t RSACipher::privateDecrypt(OffloadPool* pool, const void* from, int flen,
+                       std::string& to, int padding) {
+    if(!pool) {
+        pool = OffloadPool::GetDefault();
+    }
+    return pool->run([&]() {
+        return privateDecrypt(from, flen, to, padding);
+    }, (uint64_t)(uintptr_t)m_prikey);
+}
+
 int32_t RSACipher::getPubRSASize() {
     if(m_pubkey) {
         return RSA_size(m_pubkey);
@@ -13,11 +13,15 @@
 #include <openssl/ssl.h>
 #include <openssl/evp.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <memory>
 #include <string>
+#include "../noncopyable.h"
 
 namespace geduo {
 
+class OffloadPool;
+
 class CryptoUtil {
 public:
     //key 32字节
@@ -46,12 +50,88 @@ public:
                             ,const void* in, int32_t in_len
                             ,void* out, bool encode);
 
+    //key 32字节
+    //iv 12字节
+    //tag 16字节, 加密时输出, 解密时输入, 认证失败返回-1
+    static int32_t AES256Gcm(const void* key, const void* iv
+                            ,const void* aad, int32_t aad_len
+                            ,const void* in, int32_t in_len
+                            ,void* out, void* tag, bool encode);
+
+    //key 32字节
+    //iv 12字节
+    //tag 16字节, 加密时输出, 解密时输入, 认证失败返回-1
+    static int32_t ChaCha20Poly1305(const void* key, const void* iv
+                            ,const void* aad, int32_t aad_len
+                            ,const void* in, int32_t in_len
+                            ,void* out, void* tag, bool encode);
+
     static int32_t Crypto(const EVP_CIPHER* cipher, bool enc
                           ,const void* key, const void* iv
                           ,const void* in, int32_t in_len
                           ,void* out, int32_t* out_len);
 };
 
+/**
+ * @brief 可复用的对称加解密上下文
+ * @details init 时展开一次密钥, 之后每条消息只需 reset(iv), 不再重复密钥扩展.
+ *          数据可以分块 update, 支持 AES-GCM / ChaCha20-Poly1305 等 AEAD 模式.
+ *          一条消息的调用顺序: reset -> updateAAD* -> update* -> (setTag) -> final -> (getTag)
+ *          返回值小于0表示失败
+ */
+class CipherContext : Noncopyable {
+public:
+    typedef std::shared_ptr<CipherContext> ptr;
+
+    /// 失败返回nullptr
+    static CipherContext::ptr Create(const EVP_CIPHER* cipher, bool enc
+                                    ,const void* key, const void* iv = nullptr
+                                    ,int32_t iv_len = -1);
+
+    CipherContext();
+    ~CipherContext();
+
+    /**
+     * @brief 设置算法和密钥
+     * @param[in] iv_len AEAD 模式的 iv 长度, -1 使用算法默认值(GCM为12字节)
+     */
+    int32_t init(const EVP_CIPHER* cipher, bool enc
+                 ,const void* key, const void* iv = nullptr
+                 ,int32_t iv_len = -1);
+
+    /// 开始下一条消息, iv 为 nullptr 时沿用上次的 iv (AEAD 模式不应重复使用 iv)
+    int32_t reset(const void* iv = nullptr);
+
+    /// AEAD 附加认证数据, 需在 update 之前调用
+    int32_t updateAAD(const void* aad, int32_t len);
+
+    /// out 至少 in_len + getBlockSize() 字节, 返回写入长度
+    int32_t update(const void* in, int32_t in_len, void* out);
+    int32_t update(const struct iovec* iov, int iovcnt, void* out);
+    /// 结果追加到 out 末尾
+    int32_t update(const void* in, int32_t in_len, std::string& out);
+
+    /// out 至少 getBlockSize() 字节, 返回写入长度; AEAD 解密认证失败返回 -1
+    int32_t final(void* out);
+    int32_t final(std::string& out);
+
+    /// AEAD 加密 final 之后获取 tag
+    int32_t getTag(void* tag, int32_t len = 16);
+    /// AEAD 解密 final 之前设置期望的 tag
+    int32_t setTag(const void* tag, int32_t len = 16);
+
+    bool isAEAD() const { return m_aead;}
+    bool isEncrypt() const { return m_enc;}
+    int32_t getBlockSize() const;
+    int32_t getIvLength() const;
+    const EVP_CIPHER* getCipher() const { return m_cipher;}
+private:
+    EVP_CIPHER_CTX* m_ctx;
+    const EVP_CIPHER* m_cipher;
+    bool m_enc;
+    bool m_aead;
+};
+
 
 class RSACipher {
 public:
@@ -84,6 +164,14 @@ public:
     int32_t publicDecrypt(const void* from, int flen,
                            std::string& to, int padding = RSA_NO_PADDING);
 
+    //私钥运算耗时较长, 放到 CPU 卸载线程池中执行, 当前协程让出直到完成
+    //pool 为 nullptr 时使用 OffloadPool::GetDefault()
+    //同一密钥排队中的运算会被同一线程批量连续执行
+    int32_t privateEncrypt(OffloadPool* pool, const void* from, int flen,
+                           std::string& to, int padding = RSA_NO_PADDING);
+    int32_t privateDecrypt(OffloadPool* pool, const void* from, int flen,
+                           std::string& to, int padding = RSA_NO_PADDING);
+
 
     const std::string& getPubkeyStr() const { return m_pubkeyStr;}
     const std::string& getPrikeyStr() const { return m_prikeyStr;}
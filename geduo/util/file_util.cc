@@ -0,0 +1,651 @@
+#include "file_util.h"
+#include "../util.h"
+#include "../fiber.h"
+#include "../scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+namespace geduo {
+
+namespace {
+
+/// O_DIRECT 要求的缓冲区/偏移/长度对齐, 取常见的页大小
+static const uint64_t s_direct_align = 4096;
+
+struct FreeDeleter {
+    void operator()(char* p) const { free(p); }
+};
+
+typedef std::unique_ptr<char, FreeDeleter> AlignedBuffer;
+
+AlignedBuffer AllocAligned(uint64_t size) {
+    void* p = nullptr;
+    if (posix_memalign(&p, s_direct_align, size)) {
+        return AlignedBuffer();
+    }
+    return AlignedBuffer((char*)p);
+}
+
+/// @brief 单次搬运的字节数, 有限速时不超过桶容量, 避免每次都透支
+uint64_t GetChunkSize(const FileTransfer::Options& opt) {
+    uint64_t chunk = std::max(opt.chunkSize, (uint64_t)1);
+    if (opt.limit && opt.limit->getRate()) {
+        chunk = std::min(chunk, std::max(opt.limit->getBurst(), (uint64_t)1));
+    }
+    return chunk;
+}
+
+/// @brief 当前方式不被支持(内核版本、文件系统、fd 类型), 可以退化到下一种方式
+bool IsUnsupported(int err) {
+    return err == ENOSYS || err == EINVAL || err == EXDEV
+        || err == EOPNOTSUPP || err == ENOTSUP || err == EBADF;
+}
+
+ssize_t CopyFileRange(int in_fd, int out_fd, size_t len) {
+#ifdef __NR_copy_file_range
+    return syscall(__NR_copy_file_range, in_fd, nullptr, out_fd, nullptr, len, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+bool WriteAll(int fd, const char* data, uint64_t len) {
+    while (len) {
+        ssize_t rt = ::write(fd, data, len);
+        if (rt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += rt;
+        len -= rt;
+    }
+    return true;
+}
+
+int OpenForWrite(const std::string& path, bool& direct, mode_t mode) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = ::open(path.c_str(), flags | (direct ? O_DIRECT : 0), mode);
+    if (fd < 0 && errno == ENOENT) {
+        FSUtil::Mkdir(FSUtil::Dirname(path));
+        fd = ::open(path.c_str(), flags | (direct ? O_DIRECT : 0), mode);
+    }
+    if (fd < 0 && direct && errno == EINVAL) {
+        // tmpfs 等文件系统不支持 O_DIRECT
+        direct = false;
+        fd = ::open(path.c_str(), flags, mode);
+    }
+    return fd;
+}
+
+/// @brief 经中间管道 splice, 用于两端都不是管道的情况(如 socket -> 文件)
+class SplicePipe : Noncopyable {
+public:
+    SplicePipe(uint64_t chunk) {
+        if (pipe2(m_fds, O_CLOEXEC)) {
+            m_fds[0] = m_fds[1] = -1;
+            return;
+        }
+        // 管道默认 64K, 尽量扩大到一次搬运的大小, 超过系统上限时保持默认
+        fcntl(m_fds[1], F_SETPIPE_SZ, (int)std::min(chunk, (uint64_t)1024 * 1024));
+    }
+
+    ~SplicePipe() {
+        if (m_fds[0] >= 0) {
+            ::close(m_fds[0]);
+            ::close(m_fds[1]);
+        }
+    }
+
+    ssize_t transfer(int in_fd, int out_fd, size_t len) {
+        if (m_fds[0] < 0) {
+            return -1;
+        }
+        ssize_t rt = splice(in_fd, nullptr, m_fds[1], nullptr, len, SPLICE_F_MOVE);
+        if (rt <= 0) {
+            return rt;
+        }
+        ssize_t left = rt;
+        while (left > 0) {
+            ssize_t n = splice(m_fds[0], nullptr, out_fd, nullptr, left, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                // 已读出的数据滞留在管道中, 无法退化到其他方式
+                m_broken = true;
+                return -1;
+            }
+            left -= n;
+        }
+        return rt;
+    }
+
+    bool isBroken() const { return m_broken; }
+private:
+    int m_fds[2];
+    bool m_broken = false;
+};
+
+} // namespace
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path, bool sequential) {
+    close();
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st)) {
+        close();
+        return false;
+    }
+    m_size = st.st_size;
+    if (m_size == 0) {
+        return true;
+    }
+    void* ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (ptr == MAP_FAILED) {
+        close();
+        return false;
+    }
+    m_data = (char*)ptr;
+    if (sequential) {
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data) {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_size = 0;
+}
+
+int64_t FileTransfer::Transfer(int in_fd, int out_fd, uint64_t size
+                                ,const Options& opt, Method* used) {
+    struct stat ist, ost;
+    if (fstat(in_fd, &ist) || fstat(out_fd, &ost)) {
+        return -1;
+    }
+    bool fallback = opt.method == AUTO;
+    Method method = opt.method;
+    if (method == AUTO) {
+        if (S_ISFIFO(ist.st_mode) || S_ISFIFO(ost.st_mode)) {
+            method = SPLICE;
+        } else if (S_ISREG(ist.st_mode) && S_ISREG(ost.st_mode)) {
+            method = COPY_FILE_RANGE;
+        } else if (S_ISREG(ist.st_mode) || S_ISBLK(ist.st_mode)) {
+            method = SENDFILE;
+        } else {
+            method = SPLICE;
+        }
+    }
+    bool direct_splice = S_ISFIFO(ist.st_mode) || S_ISFIFO(ost.st_mode);
+
+    uint64_t chunk = GetChunkSize(opt);
+    std::unique_ptr<SplicePipe> pipe;
+    std::unique_ptr<char[]> buffer;
+    uint64_t done = 0;
+    uint64_t acquired = 0;
+    while (done < size) {
+        uint64_t n = std::min(chunk, size - done);
+        // 失败重试或退化时已取得的令牌继续使用
+        if (opt.limit && acquired < n) {
+            opt.limit->acquire(n - acquired);
+            acquired = n;
+        }
+        ssize_t rt = -1;
+        switch (method) {
+            case COPY_FILE_RANGE:
+                rt = CopyFileRange(in_fd, out_fd, n);
+                break;
+            case SENDFILE:
+                rt = sendfile(out_fd, in_fd, nullptr, n);
+                break;
+            case SPLICE:
+                if (direct_splice) {
+                    rt = splice(in_fd, nullptr, out_fd, nullptr, n, SPLICE_F_MOVE);
+                } else {
+                    if (!pipe) {
+                        pipe.reset(new SplicePipe(chunk));
+                    }
+                    rt = pipe->transfer(in_fd, out_fd, n);
+                }
+                break;
+            default:
+                if (!buffer) {
+                    buffer.reset(new char[chunk]);
+                }
+                rt = ::read(in_fd, buffer.get(), n);
+                if (rt > 0 && !WriteAll(out_fd, buffer.get(), rt)) {
+                    return -1;
+                }
+                break;
+        }
+        if (rt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (fallback && method != READ_WRITE && IsUnsupported(errno)
+                    && !(pipe && pipe->isBroken())) {
+                method = (Method)(method + 1);
+                continue;
+            }
+            return -1;
+        }
+        if (rt == 0) {
+            break;
+        }
+        done += rt;
+        acquired = acquired > (uint64_t)rt ? acquired - rt : 0;
+    }
+    if (used) {
+        *used = method;
+    }
+    if (opt.sync && S_ISREG(ost.st_mode)) {
+        fdatasync(out_fd);
+    }
+    return done;
+}
+
+bool FileTransfer::WriteFd(int fd, const char* data, uint64_t len, const Options& opt) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    bool direct = flags & O_DIRECT;
+    uint64_t chunk = GetChunkSize(opt);
+    AlignedBuffer buffer;
+    if (direct) {
+        chunk = std::max(s_direct_align, chunk - chunk % s_direct_align);
+    }
+
+    bool ok = true;
+    uint64_t offset = 0;
+    uint64_t acquired = 0;
+    while (offset < len) {
+        uint64_t n = std::min(chunk, len - offset);
+        if (direct) {
+            if (n < s_direct_align) {
+                // 不足一个块的结尾走页缓存
+                fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+                direct = false;
+            } else {
+                n -= n % s_direct_align;
+            }
+        }
+        // 失败重试或放弃 O_DIRECT 时已取得的令牌继续使用
+        if (opt.limit && acquired < n) {
+            opt.limit->acquire(n - acquired);
+            acquired = n;
+        }
+        const char* ptr = data + offset;
+        if (direct && (uintptr_t)ptr % s_direct_align) {
+            if (!buffer) {
+                buffer = AllocAligned(chunk);
+                if (!buffer) {
+                    ok = false;
+                    break;
+                }
+            }
+            memcpy(buffer.get(), ptr, n);
+            ptr = buffer.get();
+        }
+        ssize_t rt = ::write(fd, ptr, n);
+        if (rt < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (direct && errno == EINVAL) {
+                // 文件偏移未对齐或设备要求更大的对齐, 放弃 O_DIRECT
+                fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+                direct = false;
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        offset += rt;
+        acquired = acquired > (uint64_t)rt ? acquired - rt : 0;
+    }
+    if ((flags & O_DIRECT) && !direct) {
+        fcntl(fd, F_SETFL, flags);
+    }
+    if (ok && opt.sync) {
+        fdatasync(fd);
+    }
+    return ok;
+}
+
+bool FileTransfer::CopyFile(const std::string& from, const std::string& to
+                            ,const Options& opt) {
+    int in_fd = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(in_fd, &st)) {
+        ::close(in_fd);
+        return false;
+    }
+    bool direct = opt.direct;
+    int out_fd = OpenForWrite(to, direct, st.st_mode & 07777);
+    if (out_fd < 0) {
+        ::close(in_fd);
+        return false;
+    }
+    // 不受 umask 影响, 与源文件一致
+    fchmod(out_fd, st.st_mode & 07777);
+
+    bool ok = false;
+    if (direct) {
+        MappedFile mf;
+        if (mf.open(from)) {
+            ok = WriteFd(out_fd, mf.data(), mf.size(), opt);
+        }
+    } else {
+        ok = Transfer(in_fd, out_fd, st.st_size, opt) == (int64_t)st.st_size;
+    }
+    ::close(in_fd);
+    if (::close(out_fd)) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool FileTransfer::ReadFile(const std::string& path, std::string& out
+                            ,const Options& opt) {
+    MappedFile mf;
+    if (!mf.open(path)) {
+        return false;
+    }
+    uint64_t chunk = GetChunkSize(opt);
+    out.reserve(out.size() + mf.size());
+    for (uint64_t offset = 0; offset < mf.size(); offset += chunk) {
+        uint64_t n = std::min(chunk, mf.size() - offset);
+        if (opt.limit) {
+            opt.limit->acquire(n);
+        }
+        out.append(mf.data() + offset, n);
+    }
+    return true;
+}
+
+bool FileTransfer::WriteFile(const std::string& path, const char* data, uint64_t len
+                            ,const Options& opt) {
+    bool direct = opt.direct;
+    int fd = OpenForWrite(path, direct, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = WriteFd(fd, data, len, opt);
+    if (::close(fd)) {
+        ok = false;
+    }
+    return ok;
+}
+
+const char* FileTransfer::MethodToString(Method m) {
+    switch (m) {
+#define XX(name) \
+        case name: \
+            return #name;
+        XX(AUTO);
+        XX(COPY_FILE_RANGE);
+        XX(SENDFILE);
+        XX(SPLICE);
+        XX(READ_WRITE);
+#undef XX
+        default:
+            return "UNKNOW";
+    }
+}
+
+namespace {
+
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/// @brief 优先使用 statx, 内核或 glibc 不支持时使用 fstatat
+int StatAt(int dirfd, const char* name, struct stat* st) {
+#ifdef STATX_BASIC_STATS
+    // 多个线程可能同时遍历, 首次失败后所有线程都改用 fstatat
+    static std::atomic<bool> s_has_statx(true);
+    if (s_has_statx.load(std::memory_order_relaxed)) {
+        struct statx stx;
+        if (statx(dirfd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC
+                    ,STATX_BASIC_STATS, &stx) == 0) {
+            memset(st, 0, sizeof(*st));
+            st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            st->st_ino = stx.stx_ino;
+            st->st_mode = stx.stx_mode;
+            st->st_nlink = stx.stx_nlink;
+            st->st_uid = stx.stx_uid;
+            st->st_gid = stx.stx_gid;
+            st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+            st->st_size = stx.stx_size;
+            st->st_blksize = stx.stx_blksize;
+            st->st_blocks = stx.stx_blocks;
+            st->st_atim.tv_sec = stx.stx_atime.tv_sec;
+            st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+            st->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+            st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+            st->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+            st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+            return 0;
+        }
+        if (errno != ENOSYS) {
+            return -1;
+        }
+        s_has_statx.store(false, std::memory_order_relaxed);
+    }
+#endif
+    return fstatat(dirfd, name, st, AT_SYMLINK_NOFOLLOW);
+}
+
+unsigned char ModeToType(mode_t mode) {
+    switch (mode & S_IFMT) {
+        case S_IFREG: return DT_REG;
+        case S_IFDIR: return DT_DIR;
+        case S_IFLNK: return DT_LNK;
+        case S_IFIFO: return DT_FIFO;
+        case S_IFSOCK: return DT_SOCK;
+        case S_IFCHR: return DT_CHR;
+        case S_IFBLK: return DT_BLK;
+        default: return DT_UNKNOWN;
+    }
+}
+
+/// @brief 一次遍历的共享状态
+class DirWalkContext {
+public:
+    DirWalkContext(const DirWalker::Visitor& cb, const DirWalker::Options& opt
+                    ,Scheduler* scheduler)
+        :m_cb(cb)
+        ,m_opt(opt)
+        ,m_scheduler(scheduler) {
+    }
+
+    /// @brief 深度优先遍历 path, 子目录在排队数未满时分发给调度器
+    void walk(const std::string& path, int depth, int fd);
+
+    /// @brief 分发给调度器的任务结束
+    void done() {
+        if (--m_pending == 0) {
+            m_waiter.notify();
+        }
+    }
+
+    void wait() { m_waiter.wait(); }
+private:
+    struct Frame {
+        int fd;
+        size_t pathLen;
+        int depth;
+        int pos;
+        int len;
+        std::unique_ptr<char[]> buf;
+    };
+
+    bool match(const char* name) const;
+    /// @brief 把已打开的子目录 fd 交给调度器遍历
+    void spawn(const std::string& path, int depth, int fd);
+private:
+    static const int s_buf_size = 32 * 1024;
+    const DirWalker::Visitor& m_cb;
+    const DirWalker::Options& m_opt;
+    Scheduler* m_scheduler;
+    /// 未完成的目录任务数, 包括调用方自身
+    std::atomic<uint32_t> m_pending = {1};
+    std::atomic<bool> m_stop = {false};
+    FiberWaiter m_waiter;
+};
+
+bool DirWalkContext::match(const char* name) const {
+    if (m_opt.suffixes.empty() && m_opt.globs.empty()) {
+        return true;
+    }
+    size_t len = strlen(name);
+    for (auto& i : m_opt.suffixes) {
+        if (len >= i.size() && memcmp(name + len - i.size(), i.c_str(), i.size()) == 0) {
+            return true;
+        }
+    }
+    for (auto& i : m_opt.globs) {
+        if (fnmatch(i.c_str(), name, 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirWalkContext::spawn(const std::string& path, int depth, int fd) {
+    ++m_pending;
+    m_scheduler->schedule([this, path, depth, fd]() {
+        walk(path, depth, fd);
+        done();
+    });
+}
+
+void DirWalkContext::walk(const std::string& path, int depth, int fd) {
+    DirWalker::Entry entry;
+    entry.path = path;
+    std::vector<Frame> stack;
+    stack.push_back(Frame{fd, path.size(), depth, 0, 0
+                    ,std::unique_ptr<char[]>(new char[s_buf_size])});
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (m_stop) {
+            ::close(frame.fd);
+            stack.pop_back();
+            continue;
+        }
+        if (frame.pos >= frame.len) {
+            long rt = syscall(SYS_getdents64, frame.fd, frame.buf.get(), s_buf_size);
+            if (rt <= 0) {
+                ::close(frame.fd);
+                stack.pop_back();
+                continue;
+            }
+            frame.pos = 0;
+            frame.len = rt;
+        }
+        LinuxDirent64* dp = (LinuxDirent64*)(frame.buf.get() + frame.pos);
+        frame.pos += dp->d_reclen;
+        const char* name = dp->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        entry.path.resize(frame.pathLen);
+        entry.path.push_back('/');
+        entry.path.append(name);
+        entry.name = entry.path.c_str() + frame.pathLen + 1;
+        entry.type = dp->d_type;
+        entry.dirfd = frame.fd;
+        bool has_stat = false;
+        if (entry.type == DT_UNKNOWN) {
+            // 部分文件系统(如 xfs 旧版本)的 d_type 为 DT_UNKNOWN
+            if (StatAt(frame.fd, name, &entry.st)) {
+                continue;
+            }
+            entry.type = ModeToType(entry.st.st_mode);
+            has_stat = true;
+        }
+
+        bool is_dir = entry.type == DT_DIR;
+        if ((!is_dir || m_opt.includeDirs) && match(entry.name)) {
+            // 只对需要回调的文件取 stat
+            if (m_opt.withStat && !has_stat && StatAt(frame.fd, name, &entry.st)) {
+                continue;
+            }
+            if (!m_cb(entry)) {
+                m_stop = true;
+                continue;
+            }
+        }
+        if (!is_dir || (m_opt.maxDepth >= 0 && frame.depth >= m_opt.maxDepth)) {
+            continue;
+        }
+        // 相对父目录打开且不跟随符号链接, 遍历期间目录被替换为链接时不会逃出根目录
+        int child = openat(frame.fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child < 0) {
+            continue;
+        }
+        int child_depth = frame.depth + 1;
+        if (m_scheduler && m_pending < m_opt.maxPendingDirs) {
+            spawn(entry.path, child_depth, child);
+            continue;
+        }
+        stack.push_back(Frame{child, entry.path.size(), child_depth, 0, 0
+                        ,std::unique_ptr<char[]>(new char[s_buf_size])});
+    }
+}
+
+} // namespace
+
+bool DirWalker::Walk(const std::string& path, const Visitor& cb
+                    ,const Options& opt, Scheduler* scheduler) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    DirWalkContext ctx(cb, opt, scheduler);
+    ctx.walk(path, 0, fd);
+    ctx.done();
+    ctx.wait();
+    return true;
+}
+
+} // namespace geduo
@@ -0,0 +1,167 @@
+/*
+ * @file: file_util.h
+ * @brief: 文件传输引擎
+ * @details 大文件在 fd 之间搬运时优先使用零拷贝系统调用:
+ *          copy_file_range(文件 -> 文件) / sendfile(文件 -> socket 等) / splice(一端为管道,
+ *          或 socket -> 文件时经中间管道), 都不可用时退化为 read/write.
+ *          读文件使用 mmap + madvise(MADV_SEQUENTIAL), 大文件顺序写入可使用 O_DIRECT.
+ *          所有路径都可以通过 TokenBucket 限速.
+ *          DirWalker 基于 openat/getdents64 遍历目录树, 可将子目录分发到协程调度器并行读取
+ */
+#ifndef __GEDUO_UTIL_FILE_UTIL_H__
+#define __GEDUO_UTIL_FILE_UTIL_H__
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../noncopyable.h"
+#include "../token_bucket.h"
+
+namespace geduo {
+
+class Scheduler;
+
+/// @brief 只读映射的文件
+class MappedFile : Noncopyable {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    /**
+     * @brief 映射整个文件
+     * @param[in] sequential 是否 madvise(MADV_SEQUENTIAL), 让内核加大预读并尽早回收已读页
+     */
+    bool open(const std::string& path, bool sequential = true);
+    void close();
+
+    const char* data() const { return m_data; }
+    uint64_t size() const { return m_size; }
+    bool isOpen() const { return m_fd >= 0; }
+private:
+    int m_fd = -1;
+    char* m_data = nullptr;
+    uint64_t m_size = 0;
+};
+
+class FileTransfer {
+public:
+    /// @brief 传输使用的方式
+    enum Method {
+        /// 根据 fd 类型自动选择, 失败时依次退化
+        AUTO = 0,
+        COPY_FILE_RANGE,
+        SENDFILE,
+        SPLICE,
+        READ_WRITE
+    };
+
+    struct Options {
+        Options()
+            :chunkSize(1024 * 1024)
+            ,direct(false)
+            ,sync(false)
+            ,method(AUTO) {
+        }
+
+        /// 限速器, 可在多个传输间共享, nullptr 表示不限速
+        TokenBucket::ptr limit;
+        /// 单次系统调用最多传输的字节数, 有限速时不超过桶容量
+        uint64_t chunkSize;
+        /// 写文件时使用 O_DIRECT(文件系统不支持时自动关闭)
+        bool direct;
+        /// 写完后 fdatasync
+        bool sync;
+        /// 指定传输方式, 失败时不退化
+        Method method;
+    };
+
+    /**
+     * @brief 从 in_fd 的当前偏移读取 size 字节写入 out_fd 的当前偏移, 两端偏移都会前移
+     * @param[out] used 实际使用的传输方式
+     * @return 传输的字节数, 读到文件结尾时小于 size; 出错返回 -1, 错误码见 errno
+     */
+    static int64_t Transfer(int in_fd, int out_fd, uint64_t size
+                            ,const Options& opt = Options(), Method* used = nullptr);
+
+    /**
+     * @brief 复制文件, 目标文件所在目录不存在时创建, 保留源文件权限
+     * @details opt.direct 为 true 时以 mmap 读取源文件, 对齐缓冲区 O_DIRECT 写入目标文件,
+     *          否则使用 Transfer
+     */
+    static bool CopyFile(const std::string& from, const std::string& to
+                        ,const Options& opt = Options());
+
+    /// @brief 以 mmap 读取整个文件追加到 out
+    static bool ReadFile(const std::string& path, std::string& out
+                        ,const Options& opt = Options());
+
+    /// @brief 写入(覆盖)整个文件, opt.direct 时使用 O_DIRECT
+    static bool WriteFile(const std::string& path, const char* data, uint64_t len
+                        ,const Options& opt = Options());
+
+    /**
+     * @brief 向 fd 的当前偏移写入 len 字节
+     * @details fd 带 O_DIRECT 时未对齐的数据经对齐缓冲区写入, 不足一个块的结尾去掉 O_DIRECT 后写入
+     */
+    static bool WriteFd(int fd, const char* data, uint64_t len
+                        ,const Options& opt = Options());
+
+    static const char* MethodToString(Method m);
+};
+
+/// @brief 目录树遍历
+class DirWalker {
+public:
+    struct Entry {
+        /// 完整路径, 以遍历的根路径开头
+        std::string path;
+        /// 文件名, 指向 path 内部
+        const char* name = nullptr;
+        /// 文件类型 DT_REG/DT_DIR/DT_LNK 等
+        unsigned char type = 0;
+        /// 所在目录的 fd, 回调期间有效, 可用于 openat 等
+        int dirfd = -1;
+        /// Options::withStat 为 true 时有效, 不跟随符号链接
+        struct stat st;
+    };
+
+    /// @brief 访问回调, 返回 false 停止遍历
+    typedef std::function<bool(const Entry&)> Visitor;
+
+    struct Options {
+        Options()
+            :maxDepth(-1)
+            ,includeDirs(false)
+            ,withStat(false)
+            ,maxPendingDirs(64) {
+        }
+
+        /// 文件名后缀过滤, 与 globs 满足任意一个即可, 都为空时不过滤
+        std::vector<std::string> suffixes;
+        /// 文件名通配符过滤(fnmatch)
+        std::vector<std::string> globs;
+        /// 最大深度, 根目录下的文件深度为 0, -1 不限制
+        int maxDepth;
+        /// 是否对目录也调用回调(同样经过过滤)
+        bool includeDirs;
+        /// 是否填充 Entry::st, 使用 statx(dirfd, name) 只请求基本字段, 不重新解析路径
+        bool withStat;
+        /// 并行遍历时最多排队的目录数, 超过后在当前协程中深度优先继续读取
+        uint32_t maxPendingDirs;
+    };
+
+    /**
+     * @brief 遍历 path 下的所有文件(不跟随符号链接), 无法读取的子目录被跳过
+     * @param[in] scheduler 非空时子目录分发到调度器并行读取, cb 会在多个线程中并发调用;
+     *            调用方在调度器的协程中时让出等待, 否则阻塞等待遍历结束
+     * @return path 无法打开时返回 false
+     */
+    static bool Walk(const std::string& path, const Visitor& cb
+                    ,const Options& opt = Options(), Scheduler* scheduler = nullptr);
+};
+
+} // namespace geduo
+
+#endif
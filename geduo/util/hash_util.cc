@@ -4,6 +4,11 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <string.h>
+#include <ctype.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 
@@ -130,111 +135,1167 @@ uint64_t murmur3_hash64(const char * str, const uint32_t & seed, const uint32_t&
     return (((uint64_t)murmur3_hash(str, seed)) << 32 | murmur3_hash(str, seed2));
 }
 
-std::string base64decode(const std::string &src) {
-    std::string result;
-    result.resize(src.size() * 3 / 4);
-    char *writeBuf = &result[0];
-
-    const char* ptr = src.c_str();
-    const char* end = ptr + src.size();
-
-    while(ptr < end) {
-        int i = 0;
-        int padding = 0;
-        int packed = 0;
-        for(; i < 4 && ptr < end; ++i, ++ptr) {
-            if(*ptr == '=') {
-                ++padding;
-                packed <<= 6;
-                continue;
-            }
+static const uint64_t s_wyp[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+                                  0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+
+static inline void wymum(uint64_t* a, uint64_t* b) {
+    __uint128_t r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wyr8(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wyr4(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t wyr3(const uint8_t* p, size_t k) {
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+static inline uint64_t wyseed(uint64_t seed) {
+    return seed ^ wymix(seed ^ s_wyp[0], s_wyp[1]);
+}
+
+static inline uint64_t wyfinal(uint64_t a, uint64_t b, uint64_t seed, uint64_t len) {
+    a ^= s_wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    return wymix(a ^ s_wyp[0] ^ len, b ^ s_wyp[1]);
+}
+
+/// len <= 16
+static inline uint64_t wyhash_short(const uint8_t* p, size_t len, uint64_t seed) {
+    uint64_t a = 0, b = 0;
+    if (len >= 4) {
+        a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+        b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+        a = wyr3(p, len);
+    }
+    return wyfinal(a, b, seed, len);
+}
+
+/// 处理最后 i(1~48) 字节, i < 16 时会回读 p 之前的字节
+static inline uint64_t wyhash_tail(const uint8_t* p, size_t i, uint64_t seed, uint64_t len) {
+    while (i > 16) {
+        seed = wymix(wyr8(p) ^ s_wyp[1], wyr8(p + 8) ^ seed);
+        i -= 16;
+        p += 16;
+    }
+    return wyfinal(wyr8(p + i - 16), wyr8(p + i - 8), seed, len);
+}
+
+uint64_t wyhash64(const void* data, size_t len, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)data;
+    seed = wyseed(seed);
+    if (len <= 16) {
+        return wyhash_short(p, len, seed);
+    }
+    size_t i = len;
+    if (i > 48) {
+        uint64_t see1 = seed, see2 = seed;
+        do {
+            seed = wymix(wyr8(p) ^ s_wyp[1], wyr8(p + 8) ^ seed);
+            see1 = wymix(wyr8(p + 16) ^ s_wyp[2], wyr8(p + 24) ^ see1);
+            see2 = wymix(wyr8(p + 32) ^ s_wyp[3], wyr8(p + 40) ^ see2);
+            p += 48;
+            i -= 48;
+        } while (i > 48);
+        seed ^= see1 ^ see2;
+    }
+    return wyhash_tail(p, i, seed, len);
+}
+
+uint64_t wyhash64(const std::string& data, uint64_t seed) {
+    return wyhash64(data.c_str(), data.size(), seed);
+}
+
+WyHasher::WyHasher(uint64_t seed) {
+    reset(seed);
+}
+
+void WyHasher::reset(uint64_t seed) {
+    m_seed = wyseed(seed);
+    m_see1 = m_see2 = m_seed;
+    m_total = 0;
+    m_blocks = false;
+    m_bufLen = 0;
+}
+
+void WyHasher::block(const uint8_t* p) {
+    if (!m_blocks) {
+        m_see1 = m_see2 = m_seed;
+        m_blocks = true;
+    }
+    m_seed = wymix(wyr8(p) ^ s_wyp[1], wyr8(p + 8) ^ m_seed);
+    m_see1 = wymix(wyr8(p + 16) ^ s_wyp[2], wyr8(p + 24) ^ m_see1);
+    m_see2 = wymix(wyr8(p + 32) ^ s_wyp[3], wyr8(p + 40) ^ m_see2);
+    memcpy(m_tail, p + 32, 16);
+}
+
+void WyHasher::update(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    m_total += len;
+    if (m_bufLen + len <= sizeof(m_buf)) {
+        memcpy(m_buf + m_bufLen, p, len);
+        m_bufLen += len;
+        return;
+    }
+    // 只有确定后面还有数据时才能处理一个完整的块
+    if (m_bufLen) {
+        size_t n = sizeof(m_buf) - m_bufLen;
+        memcpy(m_buf + m_bufLen, p, n);
+        p += n;
+        len -= n;
+        block(m_buf);
+    }
+    while (len > sizeof(m_buf)) {
+        block(p);
+        p += sizeof(m_buf);
+        len -= sizeof(m_buf);
+    }
+    memcpy(m_buf, p, len);
+    m_bufLen = len;
+}
+
+uint64_t WyHasher::digest() const {
+    if (!m_blocks) {
+        if (m_total <= 16) {
+            return wyhash_short(m_buf, m_total, m_seed);
+        }
+        return wyhash_tail(m_buf, m_total, m_seed, m_total);
+    }
+    uint8_t tmp[16 + sizeof(m_buf)];
+    memcpy(tmp, m_tail, 16);
+    memcpy(tmp + 16, m_buf, m_bufLen);
+    return wyhash_tail(tmp + 16, m_bufLen, m_seed ^ m_see1 ^ m_see2, m_total);
+}
+
+static const uint64_t XXH_PRIME32_1 = 0x9E3779B1U;
+static const uint64_t XXH_PRIME32_2 = 0x85EBCA77U;
+static const uint64_t XXH_PRIME32_3 = 0xC2B2AE3DU;
+static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+static const uint64_t XXH_PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t XXH_PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+/// 长输入按 64 字节的 stripe 累加, 每个 stripe 使用的密钥向后移动 8 字节
+static const size_t XXH_STRIPE_LEN = 64;
+static const size_t XXH_SECRET_SIZE = 192;
+static const size_t XXH_SECRET_LIMIT = XXH_SECRET_SIZE - XXH_STRIPE_LEN;
+static const size_t XXH_STRIPES_PER_BLOCK = XXH_SECRET_LIMIT / 8;
+static const size_t XXH_SECRET_LASTACC_START = 7;
+static const size_t XXH_SECRET_MERGEACCS_START = 11;
+static const size_t XXH_MIDSIZE_MAX = 240;
 
-            // padding with "=" only
-            if (padding > 0) {
-                return "";
+/// xxHash 的默认密钥
+static const uint8_t s_xxh3_secret[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint64_t xxh_mul128_fold64(uint64_t a, uint64_t b) {
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t xxh_rotl64(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= xxh_rotl64(h, 49) ^ xxh_rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+static inline uint64_t xxh3_mix16(const uint8_t* p, const uint8_t* secret, uint64_t seed) {
+    return xxh_mul128_fold64(wyr8(p) ^ (wyr8(secret) + seed)
+                            ,wyr8(p + 8) ^ (wyr8(secret + 8) - seed));
+}
+
+static uint64_t xxh3_64_short(const uint8_t* p, size_t len, const uint8_t* secret, uint64_t seed) {
+    if (len > 8) {
+        uint64_t lo = wyr8(p) ^ ((wyr8(secret + 24) ^ wyr8(secret + 32)) + seed);
+        uint64_t hi = wyr8(p + len - 8) ^ ((wyr8(secret + 40) ^ wyr8(secret + 48)) - seed);
+        return xxh3_avalanche(len + __builtin_bswap64(lo) + hi + xxh_mul128_fold64(lo, hi));
+    }
+    if (len >= 4) {
+        seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+        uint64_t v = wyr4(p + len - 4) + (wyr4(p) << 32);
+        return xxh3_rrmxmx(v ^ ((wyr8(secret + 8) ^ wyr8(secret + 16)) - seed), len);
+    }
+    if (len > 0) {
+        uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24)
+                   | p[len - 1] | ((uint32_t)len << 8);
+        return xxh64_avalanche(v ^ ((wyr4(secret) ^ wyr4(secret + 4)) + seed));
+    }
+    return xxh64_avalanche(seed ^ wyr8(secret + 56) ^ wyr8(secret + 64));
+}
+
+static uint64_t xxh3_64_medium(const uint8_t* p, size_t len, const uint8_t* secret, uint64_t seed) {
+    uint64_t acc = len * XXH_PRIME64_1;
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc += xxh3_mix16(p + 48, secret + 96, seed);
+                    acc += xxh3_mix16(p + len - 64, secret + 112, seed);
+                }
+                acc += xxh3_mix16(p + 32, secret + 64, seed);
+                acc += xxh3_mix16(p + len - 48, secret + 80, seed);
             }
+            acc += xxh3_mix16(p + 16, secret + 32, seed);
+            acc += xxh3_mix16(p + len - 32, secret + 48, seed);
+        }
+        acc += xxh3_mix16(p, secret, seed);
+        acc += xxh3_mix16(p + len - 16, secret + 16, seed);
+        return xxh3_avalanche(acc);
+    }
+    for (size_t i = 0; i < 8; ++i) {
+        acc += xxh3_mix16(p + 16 * i, secret + 16 * i, seed);
+    }
+    acc = xxh3_avalanche(acc);
+    uint64_t acc_end = xxh3_mix16(p + len - 16, secret + 136 - 17, seed);
+    for (size_t i = 8; i < len / 16; ++i) {
+        acc_end += xxh3_mix16(p + 16 * i, secret + 16 * (i - 8) + 3, seed);
+    }
+    return xxh3_avalanche(acc + acc_end);
+}
+
+static Hash128 xxh3_128_short(const uint8_t* p, size_t len, const uint8_t* secret, uint64_t seed) {
+    Hash128 h;
+    if (len > 8) {
+        uint64_t lo = wyr8(p);
+        uint64_t hi = wyr8(p + len - 8);
+        __uint128_t m = (__uint128_t)(lo ^ hi ^ ((wyr8(secret + 32) ^ wyr8(secret + 40)) - seed))
+                      * XXH_PRIME64_1;
+        uint64_t mlo = (uint64_t)m + ((uint64_t)(len - 1) << 54);
+        uint64_t mhi = (uint64_t)(m >> 64);
+        hi ^= (wyr8(secret + 48) ^ wyr8(secret + 56)) + seed;
+        mhi += hi + (uint64_t)(uint32_t)hi * (XXH_PRIME32_2 - 1);
+        mlo ^= __builtin_bswap64(mhi);
+        __uint128_t r = (__uint128_t)mlo * XXH_PRIME64_2;
+        h.low64 = xxh3_avalanche((uint64_t)r);
+        h.high64 = xxh3_avalanche((uint64_t)(r >> 64) + mhi * XXH_PRIME64_2);
+        return h;
+    }
+    if (len >= 4) {
+        seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+        uint64_t v = wyr4(p) + (wyr4(p + len - 4) << 32);
+        uint64_t keyed = v ^ ((wyr8(secret + 16) ^ wyr8(secret + 24)) + seed);
+        __uint128_t m = (__uint128_t)keyed * (XXH_PRIME64_1 + (len << 2));
+        uint64_t mlo = (uint64_t)m;
+        uint64_t mhi = (uint64_t)(m >> 64);
+        mhi += mlo << 1;
+        mlo ^= mhi >> 3;
+        mlo ^= mlo >> 35;
+        mlo *= XXH_PRIME_MX2;
+        mlo ^= mlo >> 28;
+        h.low64 = mlo;
+        h.high64 = xxh3_avalanche(mhi);
+        return h;
+    }
+    if (len > 0) {
+        uint32_t lo = ((uint32_t)p[0] << 16) | ((uint32_t)p[len >> 1] << 24)
+                    | p[len - 1] | ((uint32_t)len << 8);
+        uint32_t hi = __builtin_bswap32(lo);
+        hi = (hi << 13) | (hi >> 19);
+        h.low64 = xxh64_avalanche(lo ^ ((wyr4(secret) ^ wyr4(secret + 4)) + seed));
+        h.high64 = xxh64_avalanche(hi ^ ((wyr4(secret + 8) ^ wyr4(secret + 12)) - seed));
+        return h;
+    }
+    h.low64 = xxh64_avalanche(seed ^ wyr8(secret + 64) ^ wyr8(secret + 72));
+    h.high64 = xxh64_avalanche(seed ^ wyr8(secret + 80) ^ wyr8(secret + 88));
+    return h;
+}
 
-            int val = 0;
-            if(*ptr >= 'A' && *ptr <= 'Z') {
-                val = *ptr - 'A';
-            } else if(*ptr >= 'a' && *ptr <= 'z') {
-                val = *ptr - 'a' + 26;
-            } else if(*ptr >= '0' && *ptr <= '9') {
-                val = *ptr - '0' + 52;
-            } else if(*ptr == '+') {
-                val = 62;
-            } else if(*ptr == '/') {
-                val = 63;
-            } else {
-                return ""; // invalid character
+static inline void xxh3_mix32(Hash128& acc, const uint8_t* p1, const uint8_t* p2
+                             ,const uint8_t* secret, uint64_t seed) {
+    acc.low64 += xxh3_mix16(p1, secret, seed);
+    acc.low64 ^= wyr8(p2) + wyr8(p2 + 8);
+    acc.high64 += xxh3_mix16(p2, secret + 16, seed);
+    acc.high64 ^= wyr8(p1) + wyr8(p1 + 8);
+}
+
+static Hash128 xxh3_128_medium(const uint8_t* p, size_t len, const uint8_t* secret, uint64_t seed) {
+    Hash128 acc;
+    acc.low64 = len * XXH_PRIME64_1;
+    acc.high64 = 0;
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    xxh3_mix32(acc, p + 48, p + len - 64, secret + 96, seed);
+                }
+                xxh3_mix32(acc, p + 32, p + len - 48, secret + 64, seed);
             }
+            xxh3_mix32(acc, p + 16, p + len - 32, secret + 32, seed);
+        }
+        xxh3_mix32(acc, p, p + len - 16, secret, seed);
+    } else {
+        for (size_t i = 32; i < 160; i += 32) {
+            xxh3_mix32(acc, p + i - 32, p + i - 16, secret + i - 32, seed);
+        }
+        acc.low64 = xxh3_avalanche(acc.low64);
+        acc.high64 = xxh3_avalanche(acc.high64);
+        for (size_t i = 160; i <= len; i += 32) {
+            xxh3_mix32(acc, p + i - 32, p + i - 16, secret + 3 + i - 160, seed);
+        }
+        xxh3_mix32(acc, p + len - 16, p + len - 32, secret + 136 - 17 - 16, 0 - seed);
+    }
+    Hash128 h;
+    h.low64 = xxh3_avalanche(acc.low64 + acc.high64);
+    h.high64 = 0 - xxh3_avalanche(acc.low64 * XXH_PRIME64_1 + acc.high64 * XXH_PRIME64_4
+                                  + (len - seed) * XXH_PRIME64_2);
+    return h;
+}
+
+/// 累加 nb_stripes 个 stripe, 第 n 个 stripe 使用 secret + n * 8
+typedef void (*xxh3_accumulate_fun)(uint64_t* acc, const uint8_t* input
+                                    ,const uint8_t* secret, size_t nb_stripes);
+/// 每处理完一个 block 打散累加器
+typedef void (*xxh3_scramble_fun)(uint64_t* acc, const uint8_t* secret);
+
+static void xxh3_accumulate_scalar(uint64_t* acc, const uint8_t* input
+                                   ,const uint8_t* secret, size_t nb_stripes) {
+    for (size_t n = 0; n < nb_stripes; ++n) {
+        const uint8_t* in = input + n * XXH_STRIPE_LEN;
+        const uint8_t* key = secret + n * 8;
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t data = wyr8(in + 8 * i);
+            uint64_t data_key = data ^ wyr8(key + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += (data_key & 0xffffffff) * (data_key >> 32);
+        }
+    }
+}
+
+static void xxh3_scramble_scalar(uint64_t* acc, const uint8_t* secret) {
+    for (size_t i = 0; i < 8; ++i) {
+        uint64_t v = acc[i];
+        v ^= v >> 47;
+        v ^= wyr8(secret + 8 * i);
+        acc[i] = v * XXH_PRIME32_1;
+    }
+}
 
-            packed = (packed << 6) | val;
+#if defined(__x86_64__)
+static void xxh3_accumulate_sse2(uint64_t* acc, const uint8_t* input
+                                 ,const uint8_t* secret, size_t nb_stripes) {
+    __m128i a[4];
+    for (int i = 0; i < 4; ++i) {
+        a[i] = _mm_loadu_si128((const __m128i*)acc + i);
+    }
+    for (size_t n = 0; n < nb_stripes; ++n) {
+        const __m128i* in = (const __m128i*)(input + n * XXH_STRIPE_LEN);
+        const __m128i* key = (const __m128i*)(secret + n * 8);
+        for (int i = 0; i < 4; ++i) {
+            __m128i data = _mm_loadu_si128(in + i);
+            __m128i data_key = _mm_xor_si128(data, _mm_loadu_si128(key + i));
+            // 每个 64 位通道的低 32 位乘高 32 位
+            __m128i product = _mm_mul_epu32(data_key
+                    ,_mm_shuffle_epi32(data_key, _MM_SHUFFLE(0, 3, 0, 1)));
+            // 相邻通道交换后相加
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(_mm_add_epi64(a[i], swapped), product);
         }
-        if (i != 4) {
-            return "";
+    }
+    for (int i = 0; i < 4; ++i) {
+        _mm_storeu_si128((__m128i*)acc + i, a[i]);
+    }
+}
+
+static void xxh3_scramble_sse2(uint64_t* acc, const uint8_t* secret) {
+    const __m128i prime = _mm_set1_epi32((int)XXH_PRIME32_1);
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128((const __m128i*)acc + i);
+        v = _mm_xor_si128(v, _mm_srli_epi64(v, 47));
+        v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)secret + i));
+        // 64 位乘 32 位常数: 低 32 位乘积 + (高 32 位乘积 << 32)
+        __m128i lo = _mm_mul_epu32(v, prime);
+        __m128i hi = _mm_mul_epu32(_mm_shuffle_epi32(v, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+        _mm_storeu_si128((__m128i*)acc + i, _mm_add_epi64(lo, _mm_slli_epi64(hi, 32)));
+    }
+}
+
+__attribute__((target("avx2")))
+static void xxh3_accumulate_avx2(uint64_t* acc, const uint8_t* input
+                                 ,const uint8_t* secret, size_t nb_stripes) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)acc + 1);
+    for (size_t n = 0; n < nb_stripes; ++n) {
+        const __m256i* in = (const __m256i*)(input + n * XXH_STRIPE_LEN);
+        const __m256i* key = (const __m256i*)(secret + n * 8);
+        __m256i d0 = _mm256_loadu_si256(in);
+        __m256i d1 = _mm256_loadu_si256(in + 1);
+        __m256i k0 = _mm256_xor_si256(d0, _mm256_loadu_si256(key));
+        __m256i k1 = _mm256_xor_si256(d1, _mm256_loadu_si256(key + 1));
+        __m256i p0 = _mm256_mul_epu32(k0, _mm256_srli_epi64(k0, 32));
+        __m256i p1 = _mm256_mul_epu32(k1, _mm256_srli_epi64(k1, 32));
+        a0 = _mm256_add_epi64(_mm256_add_epi64(a0
+                    ,_mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))), p0);
+        a1 = _mm256_add_epi64(_mm256_add_epi64(a1
+                    ,_mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))), p1);
+    }
+    _mm256_storeu_si256((__m256i*)acc, a0);
+    _mm256_storeu_si256((__m256i*)acc + 1, a1);
+}
+
+__attribute__((target("avx2")))
+static void xxh3_scramble_avx2(uint64_t* acc, const uint8_t* secret) {
+    const __m256i prime = _mm256_set1_epi32((int)XXH_PRIME32_1);
+    for (int i = 0; i < 2; ++i) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)acc + i);
+        v = _mm256_xor_si256(v, _mm256_srli_epi64(v, 47));
+        v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i*)secret + i));
+        __m256i lo = _mm256_mul_epu32(v, prime);
+        __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), prime);
+        _mm256_storeu_si256((__m256i*)acc + i, _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32)));
+    }
+}
+#endif
+
+static xxh3_accumulate_fun s_xxh3_accumulate = xxh3_accumulate_scalar;
+static xxh3_scramble_fun s_xxh3_scramble = xxh3_scramble_scalar;
+static const char* s_xxh3_level = "scalar";
+
+struct Xxh3Initer {
+    Xxh3Initer() {
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+            s_xxh3_accumulate = xxh3_accumulate_avx2;
+            s_xxh3_scramble = xxh3_scramble_avx2;
+            s_xxh3_level = "avx2";
+        } else {
+            // x86_64 必定支持 SSE2
+            s_xxh3_accumulate = xxh3_accumulate_sse2;
+            s_xxh3_scramble = xxh3_scramble_sse2;
+            s_xxh3_level = "sse2";
         }
-        if (padding > 0 && ptr != end) {
-            return "";
+#endif
+    }
+};
+
+static Xxh3Initer __xxh3_init;
+
+static inline void xxh3_init_acc(uint64_t* acc) {
+    acc[0] = XXH_PRIME32_3;
+    acc[1] = XXH_PRIME64_1;
+    acc[2] = XXH_PRIME64_2;
+    acc[3] = XXH_PRIME64_3;
+    acc[4] = XXH_PRIME64_4;
+    acc[5] = XXH_PRIME32_2;
+    acc[6] = XXH_PRIME64_5;
+    acc[7] = XXH_PRIME32_1;
+}
+
+/// 由种子派生密钥, seed 为 0 时就是默认密钥
+static void xxh3_init_secret(uint8_t* secret, uint64_t seed) {
+    for (size_t i = 0; i < XXH_SECRET_SIZE; i += 16) {
+        uint64_t lo = wyr8(s_xxh3_secret + i) + seed;
+        uint64_t hi = wyr8(s_xxh3_secret + i + 8) - seed;
+        memcpy(secret + i, &lo, 8);
+        memcpy(secret + i + 8, &hi, 8);
+    }
+}
+
+static uint64_t xxh3_merge_accs(const uint64_t* acc, const uint8_t* secret, uint64_t start) {
+    for (size_t i = 0; i < 4; ++i) {
+        start += xxh_mul128_fold64(acc[2 * i] ^ wyr8(secret + 16 * i)
+                                  ,acc[2 * i + 1] ^ wyr8(secret + 16 * i + 8));
+    }
+    return xxh3_avalanche(start);
+}
+
+/// 按 block 累加 nb_stripes 个 stripe, so_far 为当前 block 已处理的 stripe 数, 返回处理后的位置
+static const uint8_t* xxh3_consume_stripes(uint64_t* acc, size_t& so_far, const uint8_t* input
+                                           ,size_t nb_stripes, const uint8_t* secret) {
+    while (nb_stripes >= XXH_STRIPES_PER_BLOCK - so_far) {
+        size_t n = XXH_STRIPES_PER_BLOCK - so_far;
+        s_xxh3_accumulate(acc, input, secret + so_far * 8, n);
+        s_xxh3_scramble(acc, secret + XXH_SECRET_LIMIT);
+        input += n * XXH_STRIPE_LEN;
+        nb_stripes -= n;
+        so_far = 0;
+    }
+    if (nb_stripes) {
+        s_xxh3_accumulate(acc, input, secret + so_far * 8, nb_stripes);
+        input += nb_stripes * XXH_STRIPE_LEN;
+        so_far += nb_stripes;
+    }
+    return input;
+}
+
+/// len > 240, 最后一个 stripe 总是与输入末尾对齐
+static void xxh3_hash_long(uint64_t* acc, const uint8_t* p, size_t len, const uint8_t* secret) {
+    xxh3_init_acc(acc);
+    size_t so_far = 0;
+    xxh3_consume_stripes(acc, so_far, p, (len - 1) / XXH_STRIPE_LEN, secret);
+    s_xxh3_accumulate(acc, p + len - XXH_STRIPE_LEN
+                      ,secret + XXH_SECRET_LIMIT - XXH_SECRET_LASTACC_START, 1);
+}
+
+static inline Hash128 xxh3_128_merge(const uint64_t* acc, const uint8_t* secret, uint64_t len) {
+    Hash128 h;
+    h.low64 = xxh3_merge_accs(acc, secret + XXH_SECRET_MERGEACCS_START, len * XXH_PRIME64_1);
+    h.high64 = xxh3_merge_accs(acc, secret + XXH_SECRET_SIZE - 64 - XXH_SECRET_MERGEACCS_START
+                               ,~(len * XXH_PRIME64_2));
+    return h;
+}
+
+uint64_t xxh3_64(const void* data, size_t len, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)data;
+    if (len <= 16) {
+        return xxh3_64_short(p, len, s_xxh3_secret, seed);
+    }
+    if (len <= XXH_MIDSIZE_MAX) {
+        return xxh3_64_medium(p, len, s_xxh3_secret, seed);
+    }
+    uint8_t custom[XXH_SECRET_SIZE];
+    const uint8_t* secret = s_xxh3_secret;
+    if (seed) {
+        xxh3_init_secret(custom, seed);
+        secret = custom;
+    }
+    uint64_t acc[8];
+    xxh3_hash_long(acc, p, len, secret);
+    return xxh3_merge_accs(acc, secret + XXH_SECRET_MERGEACCS_START, len * XXH_PRIME64_1);
+}
+
+uint64_t xxh3_64(const std::string& data, uint64_t seed) {
+    return xxh3_64(data.c_str(), data.size(), seed);
+}
+
+Hash128 xxh3_128(const void* data, size_t len, uint64_t seed) {
+    const uint8_t* p = (const uint8_t*)data;
+    if (len <= 16) {
+        return xxh3_128_short(p, len, s_xxh3_secret, seed);
+    }
+    if (len <= XXH_MIDSIZE_MAX) {
+        return xxh3_128_medium(p, len, s_xxh3_secret, seed);
+    }
+    uint8_t custom[XXH_SECRET_SIZE];
+    const uint8_t* secret = s_xxh3_secret;
+    if (seed) {
+        xxh3_init_secret(custom, seed);
+        secret = custom;
+    }
+    uint64_t acc[8];
+    xxh3_hash_long(acc, p, len, secret);
+    return xxh3_128_merge(acc, secret, len);
+}
+
+Hash128 xxh3_128(const std::string& data, uint64_t seed) {
+    return xxh3_128(data.c_str(), data.size(), seed);
+}
+
+const char* xxh3_simd_level() {
+    return s_xxh3_level;
+}
+
+Xxh3Hasher::Xxh3Hasher(uint64_t seed) {
+    reset(seed);
+}
+
+void Xxh3Hasher::reset(uint64_t seed) {
+    if (seed != m_seed || !m_hasSecret) {
+        xxh3_init_secret(m_secret, seed);
+        m_hasSecret = true;
+    }
+    m_seed = seed;
+    xxh3_init_acc(m_acc);
+    m_total = 0;
+    m_stripes = 0;
+    m_bufLen = 0;
+}
+
+void Xxh3Hasher::update(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    m_total += len;
+    if (len <= sizeof(m_buf) - m_bufLen) {
+        memcpy(m_buf + m_bufLen, p, len);
+        m_bufLen += len;
+        return;
+    }
+    // 缓冲区满且后面还有数据时才处理, 保证最后一个 stripe 留到 digest
+    if (m_bufLen) {
+        size_t n = sizeof(m_buf) - m_bufLen;
+        memcpy(m_buf + m_bufLen, p, n);
+        p += n;
+        len -= n;
+        xxh3_consume_stripes(m_acc, m_stripes, m_buf, sizeof(m_buf) / XXH_STRIPE_LEN, m_secret);
+        m_bufLen = 0;
+    }
+    if (len > sizeof(m_buf)) {
+        size_t nb = (len - 1) / XXH_STRIPE_LEN;
+        p = xxh3_consume_stripes(m_acc, m_stripes, p, nb, m_secret);
+        len -= nb * XXH_STRIPE_LEN;
+        // digest 时剩余数据不足一个 stripe 需要回读
+        memcpy(m_buf + sizeof(m_buf) - XXH_STRIPE_LEN, p - XXH_STRIPE_LEN, XXH_STRIPE_LEN);
+    }
+    memcpy(m_buf, p, len);
+    m_bufLen = len;
+}
+
+void Xxh3Hasher::digestLong(uint64_t* acc) const {
+    memcpy(acc, m_acc, sizeof(m_acc));
+    uint8_t last[XXH_STRIPE_LEN];
+    const uint8_t* p = last;
+    if (m_bufLen >= XXH_STRIPE_LEN) {
+        size_t so_far = m_stripes;
+        xxh3_consume_stripes(acc, so_far, m_buf, (m_bufLen - 1) / XXH_STRIPE_LEN, m_secret);
+        p = m_buf + m_bufLen - XXH_STRIPE_LEN;
+    } else {
+        size_t n = XXH_STRIPE_LEN - m_bufLen;
+        memcpy(last, m_buf + sizeof(m_buf) - n, n);
+        memcpy(last + n, m_buf, m_bufLen);
+    }
+    s_xxh3_accumulate(acc, p, m_secret + XXH_SECRET_LIMIT - XXH_SECRET_LASTACC_START, 1);
+}
+
+uint64_t Xxh3Hasher::digest() const {
+    if (m_total <= XXH_MIDSIZE_MAX) {
+        return xxh3_64(m_buf, m_total, m_seed);
+    }
+    uint64_t acc[8];
+    digestLong(acc);
+    return xxh3_merge_accs(acc, m_secret + XXH_SECRET_MERGEACCS_START, m_total * XXH_PRIME64_1);
+}
+
+Hash128 Xxh3Hasher::digest128() const {
+    if (m_total <= XXH_MIDSIZE_MAX) {
+        return xxh3_128(m_buf, m_total, m_seed);
+    }
+    uint64_t acc[8];
+    digestLong(acc);
+    return xxh3_128_merge(acc, m_secret, m_total);
+}
+
+static uint32_t s_crc32c_table[8][256];
+
+static uint32_t crc32c_sw(const void* data, size_t len, uint32_t crc) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    // slice-by-8, 每次处理8字节
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= crc;
+        crc = s_crc32c_table[7][v & 0xff]
+            ^ s_crc32c_table[6][(v >> 8) & 0xff]
+            ^ s_crc32c_table[5][(v >> 16) & 0xff]
+            ^ s_crc32c_table[4][(v >> 24) & 0xff]
+            ^ s_crc32c_table[3][(v >> 32) & 0xff]
+            ^ s_crc32c_table[2][(v >> 40) & 0xff]
+            ^ s_crc32c_table[1][(v >> 48) & 0xff]
+            ^ s_crc32c_table[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = s_crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(const void* data, size_t len, uint32_t crc) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t c = ~crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __builtin_ia32_crc32di(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len--) {
+        c32 = __builtin_ia32_crc32qi(c32, *p++);
+    }
+    return ~c32;
+}
+#endif
+
+typedef uint32_t (*crc32c_fun)(const void* data, size_t len, uint32_t crc);
+
+static crc32c_fun s_crc32c = crc32c_sw;
+
+struct Crc32cIniter {
+    Crc32cIniter() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+            }
+            s_crc32c_table[0][i] = crc;
         }
-        if (padding > 2) {
-            return "";
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int t = 1; t < 8; ++t) {
+                uint32_t prev = s_crc32c_table[t - 1][i];
+                s_crc32c_table[t][i] = (prev >> 8) ^ s_crc32c_table[0][prev & 0xff];
+            }
+        }
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("sse4.2")) {
+            s_crc32c = crc32c_hw;
         }
+#endif
+    }
+};
+
+static Crc32cIniter __crc32c_init;
 
-        *writeBuf++ = (char)((packed >> 16) & 0xff);
-        if(padding != 2) {
-            *writeBuf++ = (char)((packed >> 8) & 0xff);
+uint32_t crc32c(const void* data, size_t len, uint32_t crc) {
+    return s_crc32c(data, len, crc);
+}
+
+uint32_t crc32c(const std::string& data, uint32_t crc) {
+    return crc32c(data.c_str(), data.size(), crc);
+}
+
+bool crc32c_hardware() {
+    return s_crc32c != crc32c_sw;
+}
+
+static const char s_base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char s_hex_chars[] = "0123456789abcdef";
+
+/// 字符 -> 数值, 非法字符为 0xff
+static uint8_t s_base64_values[256];
+static uint8_t s_hex_values[256];
+
+/// SIMD 内核: 处理尽可能多的完整块, 返回已消耗的输入长度, 剩余部分由标量代码处理
+/// 解码内核遇到非法字符时提前返回, 由标量代码报错
+typedef size_t (*base64_encode_kernel)(const uint8_t* src, size_t len, char* out);
+typedef size_t (*base64_decode_kernel)(const char* src, size_t len, uint8_t* out);
+typedef size_t (*hex_encode_kernel)(const uint8_t* src, size_t len, char* out);
+typedef size_t (*hex_decode_kernel)(const char* src, size_t len, uint8_t* out);
+
+static size_t base64_encode_none(const uint8_t*, size_t, char*) { return 0; }
+static size_t base64_decode_none(const char*, size_t, uint8_t*) { return 0; }
+static size_t hex_encode_none(const uint8_t*, size_t, char*) { return 0; }
+static size_t hex_decode_none(const char*, size_t, uint8_t*) { return 0; }
+
+#if defined(__x86_64__)
+/// lo <= x <= hi (有符号比较, >= 0x80 的字节总是不匹配)
+__attribute__((target("ssse3")))
+static inline __m128i in_range_ssse3(__m128i x, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(lo - 1))
+                        ,_mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), x));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i in_range_avx2(__m256i x, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(lo - 1))
+                           ,_mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), x));
+}
+
+/// 每12字节输入 -> 16个6位索引 -> 16个base64字符
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(const uint8_t* src, size_t len, char* out) {
+    const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52
+            ,'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52
+            ,'+' - 62, '/' - 63, 'A', 0, 0);
+    size_t i = 0;
+    // 每次读取16字节, 只使用前12字节
+    for (; i + 16 <= len; i += 12, out += 16) {
+        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), shuf);
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00))
+                                    ,_mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0))
+                                    ,_mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(t0, t1);
+        __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx)
+                                         ,_mm_set1_epi8(13)));
+        r = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, r), idx);
+        _mm_storeu_si128((__m128i*)out, r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_encode_avx2(const uint8_t* src, size_t len, char* out) {
+    const __m256i shuf = _mm256_broadcastsi128_si256(
+            _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m256i shift_lut = _mm256_broadcastsi128_si256(
+            _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52
+            ,'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52
+            ,'+' - 62, '/' - 63, 'A', 0, 0));
+    size_t i = 0;
+    for (; i + 28 <= len; i += 24, out += 32) {
+        __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i*)(src + i)))
+                ,_mm_loadu_si128((const __m128i*)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00))
+                                       ,_mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0))
+                                       ,_mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t0, t1);
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx)
+                                               ,_mm256_set1_epi8(13)));
+        r = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, r), idx);
+        _mm256_storeu_si256((__m256i*)out, r);
+    }
+    return i + base64_encode_ssse3(src + i, len - i, out);
+}
+
+/// 16个base64字符 -> 12字节, 含非法字符(包括'=')时返回 false
+__attribute__((target("ssse3")))
+static inline bool base64_decode_block_ssse3(__m128i in, __m128i* out) {
+    __m128i upper = in_range_ssse3(in, 'A', 'Z');
+    __m128i lower = in_range_ssse3(in, 'a', 'z');
+    __m128i digit = in_range_ssse3(in, '0', '9');
+    __m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+    __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower)
+                                ,_mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    if (_mm_movemask_epi8(valid) != 0xffff) {
+        return false;
+    }
+    __m128i shift = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65))
+                        ,_mm_and_si128(lower, _mm_set1_epi8(-71)))
+            ,_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4))
+                         ,_mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19))
+                                      ,_mm_and_si128(slash, _mm_set1_epi8(16)))));
+    __m128i v = _mm_add_epi8(in, shift);
+    v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+    *out = _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12
+                                            ,-1, -1, -1, -1));
+    return true;
+}
+
+/// 每次写16字节(有效12字节), 保证输出有余量且不处理最后4个字符(可能含'=')
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(const char* src, size_t len, uint8_t* out) {
+    size_t i = 0;
+    __m128i r;
+    for (; i + 24 <= len; i += 16, out += 12) {
+        if (!base64_decode_block_ssse3(_mm_loadu_si128((const __m128i*)(src + i)), &r)) {
+            break;
         }
-        if(padding == 0) {
-            *writeBuf++ = (char)(packed & 0xff);
+        _mm_storeu_si128((__m128i*)out, r);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(const char* src, size_t len, uint8_t* out) {
+    size_t i = 0;
+    for (; i + 40 <= len; i += 32, out += 24) {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i upper = in_range_avx2(in, 'A', 'Z');
+        __m256i lower = in_range_avx2(in, 'a', 'z');
+        __m256i digit = in_range_avx2(in, '0', '9');
+        __m256i plus = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+'));
+        __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(upper, lower)
+                ,_mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+        if ((uint32_t)_mm256_movemask_epi8(valid) != 0xffffffffu) {
+            break;
         }
+        __m256i shift = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65))
+                               ,_mm256_and_si256(lower, _mm256_set1_epi8(-71)))
+                ,_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(4))
+                                ,_mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(19))
+                                                ,_mm256_and_si256(slash, _mm256_set1_epi8(16)))));
+        __m256i v = _mm256_add_epi8(in, shift);
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, _mm256_broadcastsi128_si256(
+                    _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+        _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i*)(out + 12), _mm256_extracti128_si256(v, 1));
     }
+    return i + base64_decode_ssse3(src + i, len - i, out);
+}
 
-    result.resize(writeBuf - result.c_str());
-    return result;
+__attribute__((target("ssse3")))
+static size_t hex_encode_ssse3(const uint8_t* src, size_t len, char* out) {
+    const __m128i lut = _mm_loadu_si128((const __m128i*)s_hex_chars);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16, out += 32) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(in, mask));
+        _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
 }
 
-std::string base64encode(const std::string& data) {
-    return base64encode(data.c_str(), data.size());
+__attribute__((target("avx2")))
+static size_t hex_encode_avx2(const uint8_t* src, size_t len, char* out) {
+    const __m256i lut = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i*)s_hex_chars));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32, out += 64) {
+        // 交换中间两个64位, 使按128位通道的 unpack 结果保持字节顺序
+        __m256i in = _mm256_permute4x64_epi64(
+                _mm256_loadu_si256((const __m256i*)(src + i)), 0xd8);
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(in, mask));
+        _mm256_storeu_si256((__m256i*)out, _mm256_unpacklo_epi8(hi, lo));
+        _mm256_storeu_si256((__m256i*)(out + 32), _mm256_unpackhi_epi8(hi, lo));
+    }
+    return i + hex_encode_ssse3(src + i, len - i, out);
 }
 
-std::string base64encode(const void* data, size_t len) {
-    const char* base64 =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+/// 16个hex字符 -> 16个4位数值, 含非法字符时返回 false
+__attribute__((target("ssse3")))
+static inline bool hex_values_ssse3(__m128i in, __m128i* out) {
+    __m128i digit = in_range_ssse3(in, '0', '9');
+    __m128i lc = _mm_or_si128(in, _mm_set1_epi8(0x20));
+    __m128i alpha = in_range_ssse3(lc, 'a', 'f');
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff) {
+        return false;
+    }
+    *out = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(in, _mm_set1_epi8('0')))
+                       ,_mm_and_si128(alpha, _mm_sub_epi8(lc, _mm_set1_epi8('a' - 10))));
+    return true;
+}
 
-    std::string ret;
-    ret.reserve(len * 4 / 3 + 2);
+__attribute__((target("ssse3")))
+static size_t hex_decode_ssse3(const char* src, size_t len, uint8_t* out) {
+    const __m128i weight = _mm_set1_epi16(0x0110);
+    size_t i = 0;
+    __m128i a, b;
+    for (; i + 32 <= len; i += 32, out += 16) {
+        if (!hex_values_ssse3(_mm_loadu_si128((const __m128i*)(src + i)), &a)
+                || !hex_values_ssse3(_mm_loadu_si128((const __m128i*)(src + i + 16)), &b)) {
+            break;
+        }
+        a = _mm_maddubs_epi16(a, weight);
+        b = _mm_maddubs_epi16(b, weight);
+        _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static inline bool hex_values_avx2(__m256i in, __m256i* out) {
+    __m256i digit = in_range_avx2(in, '0', '9');
+    __m256i lc = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+    __m256i alpha = in_range_avx2(lc, 'a', 'f');
+    if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != 0xffffffffu) {
+        return false;
+    }
+    *out = _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(in, _mm256_set1_epi8('0')))
+            ,_mm256_and_si256(alpha, _mm256_sub_epi8(lc, _mm256_set1_epi8('a' - 10))));
+    return true;
+}
+
+__attribute__((target("avx2")))
+static size_t hex_decode_avx2(const char* src, size_t len, uint8_t* out) {
+    const __m256i weight = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+    __m256i a, b;
+    for (; i + 64 <= len; i += 64, out += 32) {
+        if (!hex_values_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), &a)
+                || !hex_values_avx2(_mm256_loadu_si256((const __m256i*)(src + i + 32)), &b)) {
+            break;
+        }
+        a = _mm256_maddubs_epi16(a, weight);
+        b = _mm256_maddubs_epi16(b, weight);
+        // packus 按128位通道交错, 需要再调整64位的顺序
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i*)out, r);
+    }
+    return i + hex_decode_ssse3(src + i, len - i, out);
+}
+#endif
 
-    const unsigned char* ptr = (const unsigned char*)data;
-    const unsigned char* end = ptr + len;
+static base64_encode_kernel s_base64_encode = base64_encode_none;
+static base64_decode_kernel s_base64_decode = base64_decode_none;
+static hex_encode_kernel s_hex_encode = hex_encode_none;
+static hex_decode_kernel s_hex_decode = hex_decode_none;
+static const char* s_codec_level = "scalar";
 
-    while(ptr < end) {
-        unsigned int packed = 0;
-        int i = 0;
-        int padding = 0;
-        for(; i < 3 && ptr < end; ++i, ++ptr) {
-            packed = (packed << 8) | *ptr;
+struct CodecIniter {
+    CodecIniter() {
+        memset(s_base64_values, 0xff, sizeof(s_base64_values));
+        for (int i = 0; i < 64; ++i) {
+            s_base64_values[(uint8_t)s_base64_chars[i]] = i;
         }
-        if(i == 2) {
-            padding = 1;
-        } else if (i == 1) {
-            padding = 2;
+        memset(s_hex_values, 0xff, sizeof(s_hex_values));
+        for (int i = 0; i < 16; ++i) {
+            s_hex_values[(uint8_t)s_hex_chars[i]] = i;
+            s_hex_values[(uint8_t)toupper(s_hex_chars[i])] = i;
         }
-        for(; i < 3; ++i) {
-            packed <<= 8;
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+            s_base64_encode = base64_encode_avx2;
+            s_base64_decode = base64_decode_avx2;
+            s_hex_encode = hex_encode_avx2;
+            s_hex_decode = hex_decode_avx2;
+            s_codec_level = "avx2";
+        } else if (__builtin_cpu_supports("ssse3")) {
+            s_base64_encode = base64_encode_ssse3;
+            s_base64_decode = base64_decode_ssse3;
+            s_hex_encode = hex_encode_ssse3;
+            s_hex_decode = hex_decode_ssse3;
+            s_codec_level = "ssse3";
         }
+#endif
+    }
+};
+
+static CodecIniter __codec_init;
 
-        ret.append(1, base64[packed >> 18]);
-        ret.append(1, base64[(packed >> 12) & 0x3f]);
-        if(padding != 2) {
-            ret.append(1, base64[(packed >> 6) & 0x3f]);
+const char* codec_simd_level() {
+    return s_codec_level;
+}
+
+int64_t base64decode(const char *src, size_t len, void *output) {
+    if (len % 4 != 0) {
+        return -1;
+    }
+    uint8_t* out = (uint8_t*)output;
+    size_t i = s_base64_decode(src, len, out);
+    out += i / 4 * 3;
+    for (; i < len; i += 4) {
+        const uint8_t* p = (const uint8_t*)src + i;
+        uint32_t a = s_base64_values[p[0]];
+        uint32_t b = s_base64_values[p[1]];
+        uint32_t c = s_base64_values[p[2]];
+        uint32_t d = s_base64_values[p[3]];
+        if ((a | b | c | d) < 64) {
+            uint32_t packed = (a << 18) | (b << 12) | (c << 6) | d;
+            *out++ = (uint8_t)(packed >> 16);
+            *out++ = (uint8_t)(packed >> 8);
+            *out++ = (uint8_t)packed;
+            continue;
         }
-        if(padding == 0) {
-            ret.append(1, base64[packed & 0x3f]);
+        // padding with "=" only, and only in the last group
+        if (i + 4 != len || a >= 64 || b >= 64 || p[3] != '=') {
+            return -1;
         }
-        ret.append(padding, '=');
+        uint32_t packed = (a << 18) | (b << 12);
+        *out++ = (uint8_t)(packed >> 16);
+        if (p[2] != '=') {
+            if (c >= 64) {
+                return -1;
+            }
+            packed |= c << 6;
+            *out++ = (uint8_t)(packed >> 8);
+        }
+    }
+    return out - (uint8_t*)output;
+}
+
+bool base64decode_append(const char *src, size_t len, std::string &output) {
+    size_t old = output.size();
+    output.resize(old + len / 4 * 3);
+    int64_t n = base64decode(src, len, &output[old]);
+    if (n < 0) {
+        output.resize(old);
+        return false;
     }
+    output.resize(old + n);
+    return true;
+}
+
+std::string base64decode(const std::string &src) {
+    std::string result;
+    base64decode_append(src.c_str(), src.size(), result);
+    return result;
+}
+
+size_t base64encode(const void *data, size_t len, char *output) {
+    const uint8_t* ptr = (const uint8_t*)data;
+    char* out = output;
+    size_t i = s_base64_encode(ptr, len, out);
+    out += i / 3 * 4;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t packed = (ptr[i] << 16) | (ptr[i + 1] << 8) | ptr[i + 2];
+        *out++ = s_base64_chars[packed >> 18];
+        *out++ = s_base64_chars[(packed >> 12) & 0x3f];
+        *out++ = s_base64_chars[(packed >> 6) & 0x3f];
+        *out++ = s_base64_chars[packed & 0x3f];
+    }
+    if (i < len) {
+        uint32_t packed = ptr[i] << 16;
+        if (i + 1 < len) {
+            packed |= ptr[i + 1] << 8;
+        }
+        *out++ = s_base64_chars[packed >> 18];
+        *out++ = s_base64_chars[(packed >> 12) & 0x3f];
+        *out++ = (i + 1 < len) ? s_base64_chars[(packed >> 6) & 0x3f] : '=';
+        *out++ = '=';
+    }
+    return out - output;
+}
+
+void base64encode_append(const void *data, size_t len, std::string &output) {
+    size_t old = output.size();
+    output.resize(old + base64encode_size(len));
+    base64encode(data, len, &output[old]);
+}
+
+std::string base64encode(const std::string& data) {
+    return base64encode(data.c_str(), data.size());
+}
 
+std::string base64encode(const void* data, size_t len) {
+    std::string ret;
+    base64encode_append(data, len, ret);
     return ret;
 }
 
@@ -247,13 +1308,9 @@ std::string sha1(const std::string &data) {
 }
 
 std::string md5sum(const void *data, size_t len) {
-    MD5_CTX ctx;
-    MD5_Init(&ctx);
-    MD5_Update(&ctx, data, len);
-    std::string result;
-    result.resize(MD5_DIGEST_LENGTH);
-    MD5_Final((unsigned char*)&result[0], &ctx);
-    return result;
+    MD5Context ctx;
+    ctx.update(data, len);
+    return ctx.final();
 }
 
 std::string md5sum(const std::string &data) {
@@ -275,107 +1332,150 @@ std::string sha0sum(const std::string & data) {
 }
 
 std::string sha1sum(const void *data, size_t len) {
-    SHA_CTX ctx;
-    SHA1_Init(&ctx);
-    SHA1_Update(&ctx, data, len);
-    std::string result;
-    result.resize(SHA_DIGEST_LENGTH);
-    SHA1_Final((unsigned char*)&result[0], &ctx);
-    return result;
+    SHA1Context ctx;
+    ctx.update(data, len);
+    return ctx.final();
 }
 
 std::string sha1sum(const std::string &data) {
     return sha1sum(data.c_str(), data.size());
 }
 
-struct xorStruct {
-    xorStruct(char value) : m_value(value) {}
-    char m_value;
-    char operator()(char in) const { return in ^ m_value; }
-};
+static const EVP_MD* GetEvpMD(DigestContext::Algorithm alg) {
+    switch (alg) {
+        case DigestContext::MD5:
+            return EVP_md5();
+        case DigestContext::SHA1:
+            return EVP_sha1();
+        case DigestContext::SHA256:
+            return EVP_sha256();
+    }
+    return nullptr;
+}
 
-template <class CTX,
-    int (*Init)(CTX *),
-    int (*Update)(CTX *, const void *, size_t),
-    int (*Final)(unsigned char *, CTX *),
-    unsigned int B, unsigned int L>
-std::string hmac(const std::string &text, const std::string &key) {
-    std::string keyLocal = key;
-    CTX ctx;
-    if (keyLocal.size() > B) {
-        Init(&ctx);
-        Update(&ctx, keyLocal.c_str(), keyLocal.size());
-        keyLocal.resize(L);
-        Final((unsigned char *)&keyLocal[0], &ctx);
-    }
-    keyLocal.append(B - keyLocal.size(), '\0');
-    std::string ipad = keyLocal, opad = keyLocal;
-    std::transform(ipad.begin(), ipad.end(), ipad.begin(), xorStruct(0x36));
-    std::transform(opad.begin(), opad.end(), opad.begin(), xorStruct(0x5c));
-    Init(&ctx);
-    Update(&ctx, ipad.c_str(), B);
-    Update(&ctx, text.c_str(), text.size());
+static void CheckEvp(int rt, const char* what) {
+    if (rt != 1) {
+        throw std::runtime_error(what);
+    }
+}
+
+DigestContext::DigestContext(Algorithm alg)
+    :m_alg(alg)
+    ,m_ctx(EVP_MD_CTX_new()) {
+    if (!m_ctx) {
+        throw std::bad_alloc();
+    }
+    reset();
+}
+
+DigestContext::DigestContext(const DigestContext& rhs)
+    :m_alg(rhs.m_alg)
+    ,m_ctx(EVP_MD_CTX_new()) {
+    if (!m_ctx) {
+        throw std::bad_alloc();
+    }
+    CheckEvp(EVP_MD_CTX_copy_ex(m_ctx, rhs.m_ctx), "EVP_MD_CTX_copy_ex error");
+}
+
+DigestContext& DigestContext::operator=(const DigestContext& rhs) {
+    if (this != &rhs) {
+        // 复用已分配的 EVP_MD_CTX, 只拷贝中间状态
+        CheckEvp(EVP_MD_CTX_copy_ex(m_ctx, rhs.m_ctx), "EVP_MD_CTX_copy_ex error");
+        m_alg = rhs.m_alg;
+    }
+    return *this;
+}
+
+DigestContext::~DigestContext() {
+    EVP_MD_CTX_free(m_ctx);
+}
+
+void DigestContext::reset() {
+    CheckEvp(EVP_DigestInit_ex(m_ctx, GetEvpMD(m_alg), nullptr), "EVP_DigestInit_ex error");
+}
+
+void DigestContext::update(const void* data, size_t len) {
+    CheckEvp(EVP_DigestUpdate(m_ctx, data, len), "EVP_DigestUpdate error");
+}
+
+void DigestContext::final(void* output) {
+    CheckEvp(EVP_DigestFinal_ex(m_ctx, (unsigned char*)output, nullptr), "EVP_DigestFinal_ex error");
+}
+
+std::string DigestContext::final() {
     std::string result;
-    result.resize(L);
-    Final((unsigned char *)&result[0], &ctx);
-    Init(&ctx);
-    Update(&ctx, opad.c_str(), B);
-    Update(&ctx, result.c_str(), L);
-    Final((unsigned char *)&result[0], &ctx);
+    result.resize(DigestLength(m_alg));
+    final(&result[0]);
+    return result;
+}
+
+size_t DigestContext::DigestLength(Algorithm alg) {
+    return EVP_MD_size(GetEvpMD(alg));
+}
+
+size_t DigestContext::BlockSize(Algorithm alg) {
+    return EVP_MD_block_size(GetEvpMD(alg));
+}
+
+void DigestContext::Batch(Algorithm alg, const struct iovec* msgs, size_t count, void* output) {
+    unsigned char* out = (unsigned char*)output;
+    size_t len = DigestLength(alg);
+    DigestContext ctx(alg);
+    for (size_t i = 0; i < count; ++i, out += len) {
+        if (i) {
+            ctx.reset();
+        }
+        ctx.update(msgs[i].iov_base, msgs[i].iov_len);
+        ctx.final(out);
+    }
+}
+
+std::vector<std::string> DigestContext::Batch(Algorithm alg, const std::vector<std::string>& msgs) {
+    std::vector<std::string> result(msgs.size());
+    DigestContext ctx(alg);
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        if (i) {
+            ctx.reset();
+        }
+        ctx.update(msgs[i]);
+        result[i] = ctx.final();
+    }
     return result;
 }
 
 std::string hmac_md5(const std::string &text, const std::string &key) {
-    return hmac<MD5_CTX,
-        &MD5_Init,
-        &MD5_Update,
-        &MD5_Final,
-        MD5_CBLOCK, MD5_DIGEST_LENGTH>
-        (text, key);
+    return HmacMD5Context(key).sign(text);
 }
 
 std::string hmac_sha1(const std::string &text, const std::string &key) {
-    return hmac<SHA_CTX,
-        &SHA1_Init,
-        &SHA1_Update,
-        &SHA1_Final,
-        SHA_CBLOCK, SHA_DIGEST_LENGTH>
-        (text, key);
+    return HmacSHA1Context(key).sign(text);
 }
 
 std::string
 hmac_sha256(const std::string &text, const std::string &key) {
-    return hmac<SHA256_CTX,
-        &SHA256_Init,
-        &SHA256_Update,
-        &SHA256_Final,
-        SHA256_CBLOCK, SHA256_DIGEST_LENGTH>
-        (text, key);
+    return HmacSHA256Context(key).sign(text);
 }
 
 void
 hexstring_from_data(const void *data, size_t len, char *output) {
     const unsigned char *buf = (const unsigned char *)data;
-    size_t i, j;
-    for (i = j = 0; i < len; ++i) {
-        char c;
-        c = (buf[i] >> 4) & 0xf;
-        c = (c > 9) ? c + 'a' - 10 : c + '0';
-        output[j++] = c;
-        c = (buf[i] & 0xf);
-        c = (c > 9) ? c + 'a' - 10 : c + '0';
-        output[j++] = c;
+    size_t i = s_hex_encode(buf, len, output);
+    for (output += i * 2; i < len; ++i) {
+        *output++ = s_hex_chars[buf[i] >> 4];
+        *output++ = s_hex_chars[buf[i] & 0xf];
     }
 }
 
+void hexstring_from_data_append(const void *data, size_t len, std::string &output) {
+    size_t old = output.size();
+    output.resize(old + len * 2);
+    hexstring_from_data(data, len, &output[old]);
+}
+
 std::string
 hexstring_from_data(const void *data, size_t len) {
-    if (len == 0) {
-        return std::string();
-    }
     std::string result;
-    result.resize(len * 2);
-    hexstring_from_data(data, len, &result[0]);
+    hexstring_from_data_append(data, len, result);
     return result;
 }
 
@@ -384,91 +1484,38 @@ std::string hexstring_from_data(const std::string &data) {
 }
 
 void data_from_hexstring(const char *hexstring, size_t length, void *output) {
-    unsigned char *buf = (unsigned char *)output;
-    unsigned char byte;
     if (length % 2 != 0) {
         throw std::invalid_argument("data_from_hexstring length % 2 != 0");
     }
-    for (size_t i = 0; i < length; ++i) {
-        switch (hexstring[i]) {
-            case 'a':
-            case 'b':
-            case 'c':
-            case 'd':
-            case 'e':
-            case 'f':
-                byte = (hexstring[i] - 'a' + 10) << 4;
-                break;
-            case 'A':
-            case 'B':
-            case 'C':
-            case 'D':
-            case 'E':
-            case 'F':
-                byte = (hexstring[i] - 'A' + 10) << 4;
-                break;
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                byte = (hexstring[i] - '0') << 4;
-                break;
-            default:
-                throw std::invalid_argument("data_from_hexstring invalid hexstring");
-        }
-        ++i;
-        switch (hexstring[i]) {
-            case 'a':
-            case 'b':
-            case 'c':
-            case 'd':
-            case 'e':
-            case 'f':
-                byte |= hexstring[i] - 'a' + 10;
-                break;
-            case 'A':
-            case 'B':
-            case 'C':
-            case 'D':
-            case 'E':
-            case 'F':
-                byte |= hexstring[i] - 'A' + 10;
-                break;
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                byte |= hexstring[i] - '0';
-                break;
-            default:
-                throw std::invalid_argument("data_from_hexstring invalid hexstring");
-        }
-        *buf++ = byte;
+    unsigned char *buf = (unsigned char *)output;
+    size_t i = s_hex_decode(hexstring, length, buf);
+    for (buf += i / 2; i < length; i += 2) {
+        uint8_t hi = s_hex_values[(uint8_t)hexstring[i]];
+        uint8_t lo = s_hex_values[(uint8_t)hexstring[i + 1]];
+        if ((hi | lo) > 0xf) {
+            throw std::invalid_argument("data_from_hexstring invalid hexstring");
+        }
+        *buf++ = (hi << 4) | lo;
     }
 }
 
-std::string data_from_hexstring(const char *hexstring, size_t length) {
+void data_from_hexstring_append(const char *hexstring, size_t length, std::string &output) {
     if (length % 2 != 0) {
         throw std::invalid_argument("data_from_hexstring length % 2 != 0");
     }
-    if (length == 0) {
-        return std::string();
+    size_t old = output.size();
+    output.resize(old + length / 2);
+    try {
+        data_from_hexstring(hexstring, length, &output[old]);
+    } catch (...) {
+        output.resize(old);
+        throw;
     }
+}
+
+std::string data_from_hexstring(const char *hexstring, size_t length) {
     std::string result;
-    result.resize(length / 2);
-    data_from_hexstring(hexstring, length, &result[0]);
+    data_from_hexstring_append(hexstring, length, result);
     return result;
 }
 
@@ -476,71 +1523,204 @@ std::string data_from_hexstring(const std::string &hexstring) {
     return data_from_hexstring(hexstring.c_str(), hexstring.size());
 }
 
-std::string replace(const std::string &str1, char find, char replaceWith) {
-    auto str = str1;
-    size_t index = str.find(find);
-    while (index != std::string::npos) {
-        str[index] = replaceWith;
-        index = str.find(find, index + 1);
+#if defined(__x86_64__)
+static size_t find_first_of_sse2(const char* data, size_t len, const char* delims, size_t n) {
+    __m128i d[8];
+    for (size_t k = 0; k < n; ++k) {
+        d[k] = _mm_set1_epi8(delims[k]);
+    }
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i m = _mm_cmpeq_epi8(v, d[0]);
+        for (size_t k = 1; k < n; ++k) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, d[k]));
+        }
+        int mask = _mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
     }
-    return str;
+    for (; i < len; ++i) {
+        if (memchr(delims, data[i], n)) {
+            return i;
+        }
+    }
+    return len;
 }
 
-std::string replace(const std::string &str1, char find, const std::string &replaceWith) {
-    auto str = str1;
-    size_t index = str.find(find);
-    while (index != std::string::npos) {
-        str = str.substr(0, index) + replaceWith + str.substr(index + 1);
-        index = str.find(find, index + replaceWith.size());
+__attribute__((target("avx2")))
+static size_t find_first_of_avx2(const char* data, size_t len, const char* delims, size_t n) {
+    __m256i d[8];
+    for (size_t k = 0; k < n; ++k) {
+        d[k] = _mm256_set1_epi8(delims[k]);
+    }
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i m = _mm256_cmpeq_epi8(v, d[0]);
+        for (size_t k = 1; k < n; ++k) {
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, d[k]));
+        }
+        uint32_t mask = _mm256_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
     }
-    return str;
+    return i + find_first_of_sse2(data + i, len - i, delims, n);
 }
+#endif
 
-std::string replace(const std::string &str1, const std::string &find, const std::string &replaceWith) {
-    auto str = str1;
-    size_t index = str.find(find);
-    while (index != std::string::npos) {
-        str = str.substr(0, index) + replaceWith + str.substr(index + find.size());
-        index = str.find(find, index + replaceWith.size());
+static size_t find_first_of_table(const char* data, size_t len, const char* delims, size_t n) {
+    bool table[256] = {false};
+    for (size_t k = 0; k < n; ++k) {
+        table[(uint8_t)delims[k]] = true;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (table[(uint8_t)data[i]]) {
+            return i;
+        }
     }
-    return str;
+    return len;
 }
 
-std::vector<std::string> split(const std::string &str, char delim, size_t max) {
-    std::vector<std::string> result;
-    if (str.empty()) {
-        return result;
+typedef size_t (*find_first_of_fun)(const char* data, size_t len, const char* delims, size_t n);
+
+#if defined(__x86_64__)
+static find_first_of_fun s_find_first_of = find_first_of_sse2;
+#else
+static find_first_of_fun s_find_first_of = find_first_of_table;
+#endif
+
+struct FindFirstOfIniter {
+    FindFirstOfIniter() {
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+            s_find_first_of = find_first_of_avx2;
+        }
+#endif
     }
+};
+
+static FindFirstOfIniter __find_first_of_init;
+
+size_t find_first_of(const char *data, size_t len, boost::string_view delims) {
+    switch (delims.size()) {
+        case 0:
+            return len;
+        case 1: {
+            const char* p = (const char*)memchr(data, delims[0], len);
+            return p ? p - data : len;
+        }
+        default:
+            if (delims.size() <= 8) {
+                return s_find_first_of(data, len, delims.data(), delims.size());
+            }
+            return find_first_of_table(data, len, delims.data(), delims.size());
+    }
+}
+
+bool StringSplitter::next(boost::string_view& part) {
+    if (m_done) {
+        return false;
+    }
+    size_t pos = m_rest.size();
+    if (m_max > 1) {
+        if (m_delims.empty()) {
+            const char* p = (const char*)memchr(m_rest.data(), m_delim, m_rest.size());
+            pos = p ? p - m_rest.data() : m_rest.size();
+        } else {
+            pos = find_first_of(m_rest.data(), m_rest.size(), m_delims);
+        }
+    }
+    if (pos == m_rest.size()) {
+        part = m_rest;
+        m_done = true;
+        return true;
+    }
+    part = m_rest.substr(0, pos);
+    m_rest.remove_prefix(pos + 1);
+    --m_max;
+    return true;
+}
+
+std::string replace(boost::string_view str, char find, char replaceWith) {
+    std::string rt(str.data(), str.size());
+    char* p = &rt[0];
+    char* end = p + rt.size();
+    while ((p = (char*)memchr(p, find, end - p))) {
+        *p++ = replaceWith;
+    }
+    return rt;
+}
+
+std::string replace(boost::string_view str, char find, boost::string_view replaceWith) {
+    return replace(str, boost::string_view(&find, 1), replaceWith);
+}
+
+std::string replace(boost::string_view str, boost::string_view find, boost::string_view replaceWith) {
+    std::string rt;
+    replace_append(rt, str, find, replaceWith);
+    return rt;
+}
 
+void replace_append(std::string &out, boost::string_view str, boost::string_view find, boost::string_view replaceWith) {
+    if (find.empty()) {
+        out.append(str.data(), str.size());
+        return;
+    }
     size_t last = 0;
-    size_t pos = str.find(delim);
-    while (pos != std::string::npos) {
-        result.push_back(str.substr(last, pos - last));
-        last = pos + 1;
-        if (--max == 1)
-            break;
-        pos = str.find(delim, last);
+    size_t index = str.find(find);
+    if (index != boost::string_view::npos) {
+        out.reserve(out.size() + str.size() + (replaceWith.size() > find.size()
+                    ? replaceWith.size() - find.size() : 0) * 4);
+    }
+    while (index != boost::string_view::npos) {
+        out.append(str.data() + last, index - last);
+        out.append(replaceWith.data(), replaceWith.size());
+        last = index + find.size();
+        index = str.find(find, last);
+    }
+    out.append(str.data() + last, str.size() - last);
+}
+
+std::vector<std::string> split(boost::string_view str, char delim, size_t max) {
+    std::vector<std::string> result;
+    StringSplitter splitter(str, delim, max);
+    boost::string_view part;
+    while (splitter.next(part)) {
+        result.emplace_back(part.data(), part.size());
     }
-    result.push_back(str.substr(last));
     return result;
 }
 
-std::vector<std::string> split(const std::string &str, const char *delims, size_t max) {
+std::vector<std::string> split(boost::string_view str, const char *delims, size_t max) {
     std::vector<std::string> result;
-    if (str.empty()) {
-        return result;
+    StringSplitter splitter(str, boost::string_view(delims), max);
+    boost::string_view part;
+    while (splitter.next(part)) {
+        result.emplace_back(part.data(), part.size());
     }
+    return result;
+}
 
-    size_t last = 0;
-    size_t pos = str.find_first_of(delims);
-    while (pos != std::string::npos) {
-        result.push_back(str.substr(last, pos - last));
-        last = pos + 1;
-        if (--max == 1)
-            break;
-        pos = str.find_first_of(delims, last);
+std::vector<boost::string_view> split_view(boost::string_view str, char delim, size_t max) {
+    std::vector<boost::string_view> result;
+    StringSplitter splitter(str, delim, max);
+    boost::string_view part;
+    while (splitter.next(part)) {
+        result.push_back(part);
+    }
+    return result;
+}
+
+std::vector<boost::string_view> split_view(boost::string_view str, boost::string_view delims, size_t max) {
+    std::vector<boost::string_view> result;
+    StringSplitter splitter(str, delims, max);
+    boost::string_view part;
+    while (splitter.next(part)) {
+        result.push_back(part);
     }
-    result.push_back(str.substr(last));
     return result;
 }
 
@@ -11,8 +11,14 @@
 #define __GEDUO_UTIL_HASH_UTIL_H__
 
 #include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <string>
 #include <vector>
+#include <boost/utility/string_view.hpp>
+
+/// OpenSSL 的 EVP_MD_CTX, 避免在头文件中引入 OpenSSL
+struct evp_md_ctx_st;
 
 namespace geduo {
 
@@ -23,10 +29,112 @@ uint64_t murmur3_hash64(const void* str, const uint32_t& size,  const uint32_t &
 uint32_t quick_hash(const char * str);
 uint32_t quick_hash(const void* str, uint32_t size);
 
+/// wyhash(final v4, 默认密钥) 64位哈希, 每次处理48字节, 基于64x64->128位乘法, 短key非常快
+uint64_t wyhash64(const void* data, size_t len, uint64_t seed = 0);
+uint64_t wyhash64(const std::string& data, uint64_t seed = 0);
+
+/// 128位哈希值
+struct Hash128 {
+    uint64_t low64;
+    uint64_t high64;
+
+    bool operator==(const Hash128& rhs) const { return low64 == rhs.low64 && high64 == rhs.high64; }
+    bool operator!=(const Hash128& rhs) const { return !(*this == rhs); }
+};
+
+/// XXH3(xxHash 0.8) 64位哈希, 与 XXH3_64bits_withSeed 结果相同
+/// 超过240字节的输入按64字节累加, 运行时按CPU选择 AVX2/SSE2/标量实现
+uint64_t xxh3_64(const void* data, size_t len, uint64_t seed = 0);
+uint64_t xxh3_64(const std::string& data, uint64_t seed = 0);
+/// XXH3 128位哈希, 与 XXH3_128bits_withSeed 结果相同
+Hash128 xxh3_128(const void* data, size_t len, uint64_t seed = 0);
+Hash128 xxh3_128(const std::string& data, uint64_t seed = 0);
+/// 当前 xxh3 使用的指令集: "avx2", "sse2" 或 "scalar"
+const char* xxh3_simd_level();
+
+/// CRC32C(Castagnoli), CPU支持SSE4.2时使用crc32指令, 否则查表, 运行时自动选择
+/// crc 为之前数据的结果, 可分段计算: crc32c(b, crc32c(a)) == crc32c(a + b)
+uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0);
+uint32_t crc32c(const std::string& data, uint32_t crc = 0);
+/// 当前 crc32c 是否使用了SSE4.2硬件指令
+bool crc32c_hardware();
+
+/// 增量计算 wyhash64, 结果与一次性计算相同
+class WyHasher {
+public:
+    WyHasher(uint64_t seed = 0);
+    void reset(uint64_t seed = 0);
+    void update(const void* data, size_t len);
+    void update(const std::string& data) { update(data.c_str(), data.size()); }
+    uint64_t digest() const;
+private:
+    void block(const uint8_t* p);
+private:
+    uint64_t m_seed;
+    uint64_t m_see1;
+    uint64_t m_see2;
+    uint64_t m_total;
+    /// 是否已处理过48字节的块
+    bool m_blocks;
+    uint32_t m_bufLen;
+    uint8_t m_buf[48];
+    /// 最后一个已处理块的末尾16字节, 尾部不足16字节时需要回读
+    uint8_t m_tail[16];
+};
+
+/// 增量计算 xxh3, digest / digest128 的结果分别与 xxh3_64 / xxh3_128 一次性计算相同
+class Xxh3Hasher {
+public:
+    Xxh3Hasher(uint64_t seed = 0);
+    void reset(uint64_t seed = 0);
+    void update(const void* data, size_t len);
+    void update(const std::string& data) { update(data.c_str(), data.size()); }
+    uint64_t digest() const;
+    Hash128 digest128() const;
+private:
+    /// 累加缓冲区剩余的 stripe, 总长度超过240字节时使用
+    void digestLong(uint64_t* acc) const;
+private:
+    uint64_t m_acc[8];
+    uint64_t m_seed = 0;
+    uint64_t m_total;
+    /// 当前 block 已累加的 stripe 数
+    size_t m_stripes;
+    size_t m_bufLen;
+    bool m_hasSecret = false;
+    /// 由种子派生的密钥
+    uint8_t m_secret[192];
+    uint8_t m_buf[256];
+};
+
+/// 增量计算 crc32c
+class Crc32cHasher {
+public:
+    Crc32cHasher(uint32_t crc = 0) : m_crc(crc) {}
+    void reset(uint32_t crc = 0) { m_crc = crc; }
+    void update(const void* data, size_t len) { m_crc = crc32c(data, len, m_crc); }
+    void update(const std::string& data) { update(data.c_str(), data.size()); }
+    uint32_t digest() const { return m_crc; }
+private:
+    uint32_t m_crc;
+};
+
 std::string base64decode(const std::string &src);
 std::string base64encode(const std::string &data);
 std::string base64encode(const void *data, size_t len);
 
+/// base64 编码后的长度(含'='填充)
+inline size_t base64encode_size(size_t len) { return (len + 2) / 3 * 4; }
+/// Output must be of size base64encode_size(len), and will *not* be null-terminated
+/// 返回写入的字节数
+size_t base64encode(const void *data, size_t len, char *output);
+/// 编码结果追加到 output 末尾
+void base64encode_append(const void *data, size_t len, std::string &output);
+/// Output must be of size len / 4 * 3, 返回写入的字节数, 输入非法返回 -1
+int64_t base64decode(const char *src, size_t len, void *output);
+/// 解码结果追加到 output 末尾, 输入非法时返回 false 且 output 不变
+bool base64decode_append(const char *src, size_t len, std::string &output);
+
 // Returns result in hex
 std::string md5(const std::string &data);
 std::string sha1(const std::string &data);
@@ -41,23 +149,271 @@ std::string hmac_md5(const std::string &text, const std::string &key);
 std::string hmac_sha1(const std::string &text, const std::string &key);
 std::string hmac_sha256(const std::string &text, const std::string &key);
 
+/**
+ * @brief 增量摘要上下文, 数据可分多次 update (分块读取/iovec), 不必整体放入内存
+ * @details 基于 OpenSSL EVP 接口, 实现放在 hash_util.cc, 头文件不依赖 OpenSSL 的旧摘要接口.
+ *          final 之后需要 reset 才能计算下一条消息
+ */
+class DigestContext {
+public:
+    enum Algorithm {
+        MD5,
+        SHA1,
+        SHA256
+    };
+
+    explicit DigestContext(Algorithm alg);
+    /// 拷贝当前的中间状态(EVP_MD_CTX_copy_ex)
+    DigestContext(const DigestContext& rhs);
+    DigestContext& operator=(const DigestContext& rhs);
+    ~DigestContext();
+
+    Algorithm getAlgorithm() const { return m_alg; }
+
+    void reset();
+
+    void update(const void* data, size_t len);
+    void update(const std::string& data) { update(data.c_str(), data.size()); }
+    void update(const struct iovec* iov, size_t iovcnt) {
+        for (size_t i = 0; i < iovcnt; ++i) {
+            update(iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+
+    /// Output must be of size DigestLength(alg)
+    void final(void* output);
+    std::string final();
+
+    static size_t DigestLength(Algorithm alg);
+    static size_t BlockSize(Algorithm alg);
+
+    /**
+     * @brief 批量计算多条短消息的摘要, 复用同一个 EVP 上下文
+     * @param[in] msgs 每个 iovec 为一条消息
+     * @param[out] output 大小为 count * DigestLength(alg), 依次存放每条消息的摘要
+     */
+    static void Batch(Algorithm alg, const struct iovec* msgs, size_t count, void* output);
+    static std::vector<std::string> Batch(Algorithm alg, const std::vector<std::string>& msgs);
+private:
+    Algorithm m_alg;
+    ::evp_md_ctx_st* m_ctx;
+};
+
+/// @brief 固定算法的摘要上下文, 提供编译期的块大小与摘要长度
+template <DigestContext::Algorithm A, unsigned int B, unsigned int L>
+class FixedDigestContext : public DigestContext {
+public:
+    enum {
+        BLOCK_SIZE = B,
+        DIGEST_LENGTH = L
+    };
+
+    FixedDigestContext() : DigestContext(A) {}
+
+    static void Batch(const struct iovec* msgs, size_t count, void* output) {
+        DigestContext::Batch(A, msgs, count, output);
+    }
+
+    static std::vector<std::string> Batch(const std::vector<std::string>& msgs) {
+        return DigestContext::Batch(A, msgs);
+    }
+};
+
+typedef FixedDigestContext<DigestContext::MD5, 64, 16> MD5Context;
+typedef FixedDigestContext<DigestContext::SHA1, 64, 20> SHA1Context;
+typedef FixedDigestContext<DigestContext::SHA256, 64, 32> SHA256Context;
+
+/**
+ * @brief 预置密钥的 HMAC 上下文
+ * @details 构造时计算一次 ipad/opad 后的摘要状态, 之后每条消息只需拷贝状态(EVP_MD_CTX_copy_ex),
+ *          同一个密钥签名多条消息时不再重复处理密钥
+ */
+template <class Digest>
+class HmacContext {
+public:
+    enum {
+        DIGEST_LENGTH = Digest::DIGEST_LENGTH
+    };
+
+    HmacContext(const void* key, size_t len) { setKey(key, len); }
+    HmacContext(const std::string& key) { setKey(key.c_str(), key.size()); }
+
+    void setKey(const void* key, size_t len) {
+        unsigned char pad[Digest::BLOCK_SIZE];
+        memset(pad, 0, sizeof(pad));
+        if (len > Digest::BLOCK_SIZE) {
+            Digest d;
+            d.update(key, len);
+            d.final(pad);
+        } else {
+            memcpy(pad, key, len);
+        }
+        for (size_t i = 0; i < sizeof(pad); ++i) {
+            pad[i] ^= 0x36;
+        }
+        m_inner.reset();
+        m_inner.update(pad, sizeof(pad));
+        for (size_t i = 0; i < sizeof(pad); ++i) {
+            pad[i] ^= 0x36 ^ 0x5c;
+        }
+        m_outer.reset();
+        m_outer.update(pad, sizeof(pad));
+        m_ctx = m_inner;
+    }
+
+    /// 开始新的消息, 密钥不变
+    void reset() { m_ctx = m_inner; }
+
+    void update(const void* data, size_t len) { m_ctx.update(data, len); }
+    void update(const std::string& data) { m_ctx.update(data); }
+    void update(const struct iovec* iov, size_t iovcnt) { m_ctx.update(iov, iovcnt); }
+
+    /// Output must be of size DIGEST_LENGTH, 之后需 reset 才能计算下一条消息
+    void final(void* output) {
+        unsigned char inner[DIGEST_LENGTH];
+        m_ctx.final(inner);
+        Digest outer = m_outer;
+        outer.update(inner, sizeof(inner));
+        outer.final(output);
+    }
+    std::string final() {
+        std::string result;
+        result.resize(DIGEST_LENGTH);
+        final(&result[0]);
+        return result;
+    }
+
+    /// 一次性计算一条消息的 HMAC, 不影响 update 的状态
+    void sign(const void* data, size_t len, void* output) const {
+        Digest ctx = m_inner;
+        unsigned char inner[DIGEST_LENGTH];
+        ctx.update(data, len);
+        ctx.final(inner);
+        ctx = m_outer;
+        ctx.update(inner, sizeof(inner));
+        ctx.final(output);
+    }
+    std::string sign(const std::string& data) const {
+        std::string result;
+        result.resize(DIGEST_LENGTH);
+        sign(data.c_str(), data.size(), &result[0]);
+        return result;
+    }
+
+    /// 批量签名, output 大小为 count * DIGEST_LENGTH
+    void batch(const struct iovec* msgs, size_t count, void* output) const {
+        unsigned char* out = (unsigned char*)output;
+        // 复用同一个上下文, 每条消息只拷贝状态, 不再分配
+        Digest ctx = m_inner;
+        unsigned char inner[DIGEST_LENGTH];
+        for (size_t i = 0; i < count; ++i, out += DIGEST_LENGTH) {
+            ctx = m_inner;
+            ctx.update(msgs[i].iov_base, msgs[i].iov_len);
+            ctx.final(inner);
+            ctx = m_outer;
+            ctx.update(inner, sizeof(inner));
+            ctx.final(out);
+        }
+    }
+    std::vector<std::string> batch(const std::vector<std::string>& msgs) const {
+        std::vector<struct iovec> iov(msgs.size());
+        for (size_t i = 0; i < msgs.size(); ++i) {
+            iov[i].iov_base = (void*)msgs[i].c_str();
+            iov[i].iov_len = msgs[i].size();
+        }
+        std::string out;
+        out.resize(msgs.size() * DIGEST_LENGTH);
+        batch(iov.data(), iov.size(), &out[0]);
+        std::vector<std::string> result(msgs.size());
+        for (size_t i = 0; i < msgs.size(); ++i) {
+            result[i] = out.substr(i * DIGEST_LENGTH, DIGEST_LENGTH);
+        }
+        return result;
+    }
+private:
+    Digest m_inner;
+    Digest m_outer;
+    Digest m_ctx;
+};
+
+typedef HmacContext<MD5Context> HmacMD5Context;
+typedef HmacContext<SHA1Context> HmacSHA1Context;
+typedef HmacContext<SHA256Context> HmacSHA256Context;
+
 /// Output must be of size len * 2, and will *not* be null-terminated
 void hexstring_from_data(const void *data, size_t len, char *output);
 std::string hexstring_from_data(const void *data, size_t len);
 std::string hexstring_from_data(const std::string &data);
+void hexstring_from_data_append(const void *data, size_t len, std::string &output);
 
 /// Output must be of size length / 2, and will *not* be null-terminated
 /// std::invalid_argument will be thrown if hexstring is not hex
 void data_from_hexstring(const char *hexstring, size_t length, void *output);
 std::string data_from_hexstring(const char *hexstring, size_t length);
 std::string data_from_hexstring(const std::string &data);
+void data_from_hexstring_append(const char *hexstring, size_t length, std::string &output);
+
+/// base64/hex 编解码当前使用的指令集: "avx2", "ssse3" 或 "scalar"
+const char* codec_simd_level();
+
+std::string replace(boost::string_view str, char find, char replaceWith);
+std::string replace(boost::string_view str, char find, boost::string_view replaceWith);
+std::string replace(boost::string_view str, boost::string_view find, boost::string_view replaceWith);
+/// 替换结果追加到 out 末尾, 只做一次线性扫描
+void replace_append(std::string &out, boost::string_view str, boost::string_view find, boost::string_view replaceWith);
+
+/// 返回 [data, data + len) 中第一个属于 delims 的字符位置, 找不到返回 len
+/// delims 不超过8个字符时使用 SIMD 每次比较16/32字节, 否则查表
+size_t find_first_of(const char *data, size_t len, boost::string_view delims);
+
+/**
+ * @brief 不分配内存的字符串切分, 依次产出指向原字符串的 string_view
+ * @details 切分规则与 split 相同, 最多切分为 max 段, 最后一段为剩余的全部内容
+ *          for(auto part : StringSplitter(path, '/')) { ... }
+ */
+class StringSplitter {
+public:
+    class Iterator {
+    public:
+        Iterator(StringSplitter* splitter) : m_splitter(splitter) { ++*this; }
+        boost::string_view operator*() const { return m_part; }
+        const boost::string_view* operator->() const { return &m_part; }
+        Iterator& operator++() {
+            if (m_splitter && !m_splitter->next(m_part)) {
+                m_splitter = nullptr;
+            }
+            return *this;
+        }
+        bool operator==(const Iterator& o) const { return m_splitter == o.m_splitter; }
+        bool operator!=(const Iterator& o) const { return m_splitter != o.m_splitter; }
+    private:
+        StringSplitter* m_splitter;
+        boost::string_view m_part;
+    };
+
+    StringSplitter(boost::string_view str, char delim, size_t max = ~0)
+        :m_rest(str), m_delim(delim), m_max(max ? max : ~0), m_done(str.empty()) {}
+    StringSplitter(boost::string_view str, boost::string_view delims, size_t max = ~0)
+        :m_rest(str), m_delims(delims), m_max(delims.empty() ? 1 : (max ? max : ~0))
+        ,m_done(str.empty()) {}
+
+    /// 取下一段, 没有更多时返回 false
+    bool next(boost::string_view& part);
 
-std::string replace(const std::string &str, char find, char replaceWith);
-std::string replace(const std::string &str, char find, const std::string &replaceWith);
-std::string replace(const std::string &str, const std::string &find, const std::string &replaceWith);
+    Iterator begin() { return Iterator(this); }
+    Iterator end() { return Iterator(nullptr); }
+private:
+    boost::string_view m_rest;
+    boost::string_view m_delims;
+    char m_delim = 0;
+    size_t m_max;
+    bool m_done;
+};
 
-std::vector<std::string> split(const std::string &str, char delim, size_t max = ~0);
-std::vector<std::string> split(const std::string &str, const char *delims, size_t max = ~0);
+std::vector<std::string> split(boost::string_view str, char delim, size_t max = ~0);
+std::vector<std::string> split(boost::string_view str, const char *delims, size_t max = ~0);
+std::vector<boost::string_view> split_view(boost::string_view str, char delim, size_t max = ~0);
+std::vector<boost::string_view> split_view(boost::string_view str, boost::string_view delims, size_t max = ~0);
 
 std::string random_string(size_t len
         ,const std::string& chars = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ");
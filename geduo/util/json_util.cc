@@ -1,82 +1,160 @@
 #include "json_util.h"
+#include <limits>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
 #include "../util.h"
 
 namespace geduo {
 
-bool JsonUtil::NeedEscape(const std::string& v) {
-    for(auto& c : v) {
-        switch(c) {
-            case '\f':
-            case '\t':
-            case '\r':
-            case '\n':
-            case '\b':
-            case '"':
-            case '\\':
-                return true;
-            default:
-                break;
+/// Strict 为 false 时是 JsonUtil::Escape 处理的字符: \b \t \n \f \r " '\\'
+/// Strict 为 true 时按 JSON 规范: 所有小于 0x20 的控制字符以及 " '\\'
+template<bool Strict>
+static inline bool IsEscapeChar(unsigned char c) {
+    if(Strict) {
+        return c < 0x20 || c == '"' || c == '\\';
+    }
+    return (c >= '\b' && c <= '\r' && c != '\v') || c == '"' || c == '\\';
+}
+
+template<bool Strict>
+static size_t FindEscapeScalar(const char* p, size_t len) {
+    for(size_t i = 0; i < len; ++i) {
+        if(IsEscapeChar<Strict>(p[i])) {
+            return i;
         }
     }
-    return false;
+    return len;
 }
 
-std::string JsonUtil::Escape(const std::string& v) {
-    size_t size = 0;
-    for(auto& c : v) {
-        switch(c) {
-            case '\f':
-            case '\t':
-            case '\r':
-            case '\n':
-            case '\b':
-            case '"':
-            case '\\':
-                size += 2;
-                break;
-            default:
-                size += 1;
-                break;
+#if defined(__x86_64__)
+/// SSE2 是 x86_64 的基础指令集, 无需运行时检测
+template<bool Strict>
+static size_t FindEscapeSse2(const char* p, size_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+        if(Strict) {
+            // 无符号 v <= 0x1f
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v));
+        } else {
+            // 无符号 v - 8 <= 5, 且不是 \v
+            __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\b'));
+            __m128i r = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(5)), t);
+            m = _mm_or_si128(m, _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\v')), r));
+        }
+        int mask = _mm_movemask_epi8(m);
+        if(mask) {
+            return i + __builtin_ctz(mask);
         }
     }
-    if(size == v.size()) {
-        return v;
+    return i + FindEscapeScalar<Strict>(p + i, len - i);
+}
+
+template<bool Strict>
+__attribute__((target("avx2")))
+static size_t FindEscapeAvx2(const char* p, size_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash));
+        if(Strict) {
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x1f)), v));
+        } else {
+            __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\b'));
+            __m256i r = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(5)), t);
+            m = _mm256_or_si256(m, _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\v')), r));
+        }
+        uint32_t mask = _mm256_movemask_epi8(m);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
     }
+    return i + FindEscapeSse2<Strict>(p + i, len - i);
+}
+#endif
 
-    std::string rt;
-    rt.resize(size);
-    for(auto& c : v) {
-        switch(c) {
-            case '\f':
-                rt.append("\\f");
-                break;
-            case '\t':
-                rt.append("\\t");
-                break;
-            case '\r':
-                rt.append("\\r");
-                break;
-            case '\n':
-                rt.append("\\n");
-                break;
-            case '\b':
-                rt.append("\\b");
-                break;
-            case '"':
-                rt.append("\\\"");
-                break;
-            case '\\':
-                rt.append("\\\\");
-                break;
-            default:
-                rt.append(1, c);
-                break;
+typedef size_t (*find_escape_fun)(const char* p, size_t len);
+
+#if defined(__x86_64__)
+static find_escape_fun s_find_escape = FindEscapeSse2<false>;
+static find_escape_fun s_find_escape_strict = FindEscapeSse2<true>;
+#else
+static find_escape_fun s_find_escape = FindEscapeScalar<false>;
+static find_escape_fun s_find_escape_strict = FindEscapeScalar<true>;
+#endif
 
+struct JsonEscapeIniter {
+    JsonEscapeIniter() {
+#if defined(__x86_64__)
+        if(__builtin_cpu_supports("avx2")) {
+            s_find_escape = FindEscapeAvx2<false>;
+            s_find_escape_strict = FindEscapeAvx2<true>;
         }
+#endif
     }
+};
+
+static JsonEscapeIniter __json_escape_init;
+
+bool JsonUtil::NeedEscape(boost::string_view v) {
+    return s_find_escape(v.data(), v.size()) != v.size();
+}
+
+void JsonUtil::EscapeAppend(boost::string_view v, std::string& out) {
+    const char* p = v.data();
+    size_t len = v.size();
+    while(true) {
+        size_t pos = s_find_escape(p, len);
+        out.append(p, pos);
+        if(pos == len) {
+            break;
+        }
+        switch(p[pos]) {
+            case '\f': out.append("\\f", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+        }
+        p += pos + 1;
+        len -= pos + 1;
+    }
+}
+
+std::string JsonUtil::Escape(const std::string& v) {
+    size_t pos = s_find_escape(v.c_str(), v.size());
+    if(pos == v.size()) {
+        return v;
+    }
+    std::string rt;
+    // 转义字符通常很少, 预留少量余量
+    rt.reserve(v.size() + v.size() / 8 + 8);
+    rt.append(v.c_str(), pos);
+    EscapeAppend(boost::string_view(v.c_str() + pos, v.size() - pos), rt);
     return rt;
 }
 
+boost::string_view JsonUtil::EscapeView(boost::string_view v, std::string& buf) {
+    size_t pos = s_find_escape(v.data(), v.size());
+    if(pos == v.size()) {
+        return v;
+    }
+    buf.clear();
+    buf.append(v.data(), pos);
+    EscapeAppend(v.substr(pos), buf);
+    return buf;
+}
+
 std::string JsonUtil::GetString(const Json::Value& json
                       ,const std::string& name
                       ,const std::string& default_value) {
@@ -175,4 +253,716 @@ std::string JsonUtil::ToString(const Json::Value& json) {
     return w.write(json);
 }
 
+/// 嵌套深度上限, 防止恶意输入导致协程栈溢出
+static const int kMaxJsonDepth = 256;
+
+static bool ParseUint64(boost::string_view v, uint64_t& out) {
+    if(v.empty()) {
+        return false;
+    }
+    uint64_t r = 0;
+    for(char ch : v) {
+        unsigned d = (unsigned char)ch - '0';
+        if(d > 9 || r > (std::numeric_limits<uint64_t>::max() - d) / 10) {
+            return false;
+        }
+        r = r * 10 + d;
+    }
+    out = r;
+    return true;
+}
+
+static bool ParseInt64(boost::string_view v, int64_t& out) {
+    bool neg = !v.empty() && v.front() == '-';
+    if(neg) {
+        v.remove_prefix(1);
+    }
+    uint64_t r = 0;
+    if(!ParseUint64(v, r)) {
+        return false;
+    }
+    if(neg) {
+        if(r > (uint64_t)std::numeric_limits<int64_t>::max() + 1) {
+            return false;
+        }
+        out = (int64_t)(0 - r);
+    } else {
+        if(r > (uint64_t)std::numeric_limits<int64_t>::max()) {
+            return false;
+        }
+        out = (int64_t)r;
+    }
+    return true;
+}
+
+static bool ParseDouble(boost::string_view v, double& out) {
+    if(v.empty()) {
+        return false;
+    }
+    // strtod 需要以'\0'结尾
+    char buf[64];
+    std::string tmp;
+    const char* str = buf;
+    if(v.size() < sizeof(buf)) {
+        memcpy(buf, v.data(), v.size());
+        buf[v.size()] = '\0';
+    } else {
+        tmp.assign(v.data(), v.size());
+        str = tmp.c_str();
+    }
+    char* end = nullptr;
+    out = strtod(str, &end);
+    return end == str + v.size();
+}
+
+static void AppendUtf8(std::string& out, uint32_t cp) {
+    if(cp < 0x80) {
+        out.push_back((char)cp);
+    } else if(cp < 0x800) {
+        out.push_back((char)(0xc0 | (cp >> 6)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    } else if(cp < 0x10000) {
+        out.push_back((char)(0xe0 | (cp >> 12)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    } else {
+        out.push_back((char)(0xf0 | (cp >> 18)));
+        out.push_back((char)(0x80 | ((cp >> 12) & 0x3f)));
+        out.push_back((char)(0x80 | ((cp >> 6) & 0x3f)));
+        out.push_back((char)(0x80 | (cp & 0x3f)));
+    }
+}
+
+static bool ParseHex4(const char* p, const char* end, uint32_t& cp) {
+    if(end - p < 4) {
+        return false;
+    }
+    cp = 0;
+    for(int i = 0; i < 4; ++i) {
+        char c = p[i];
+        cp <<= 4;
+        if(c >= '0' && c <= '9') {
+            cp |= c - '0';
+        } else if(c >= 'a' && c <= 'f') {
+            cp |= c - 'a' + 10;
+        } else if(c >= 'A' && c <= 'F') {
+            cp |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonTape::Unescape(boost::string_view v, std::string& out) {
+    const char* p = v.data();
+    const char* end = p + v.size();
+    while(p < end) {
+        const char* q = (const char*)memchr(p, '\\', end - p);
+        if(!q) {
+            out.append(p, end - p);
+            break;
+        }
+        out.append(p, q - p);
+        p = q + 1;
+        if(p >= end) {
+            return false;
+        }
+        switch(*p++) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t cp = 0;
+                if(!ParseHex4(p, end, cp)) {
+                    return false;
+                }
+                p += 4;
+                if(cp >= 0xd800 && cp <= 0xdbff) {
+                    uint32_t low = 0;
+                    if(end - p < 6 || p[0] != '\\' || p[1] != 'u'
+                            || !ParseHex4(p + 2, end, low)
+                            || low < 0xdc00 || low > 0xdfff) {
+                        return false;
+                    }
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                } else if(cp >= 0xdc00 && cp <= 0xdfff) {
+                    return false;
+                }
+                AppendUtf8(out, cp);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool JsonTape::parse(const char* data, size_t len) {
+    m_tokens.clear();
+    m_begin = m_cur = data;
+    m_end = data + len;
+    m_errorOffset = 0;
+    if(parseValue(0)) {
+        skipSpace();
+        if(m_cur == m_end) {
+            return true;
+        }
+    }
+    m_errorOffset = m_cur - m_begin;
+    m_tokens.clear();
+    return false;
+}
+
+void JsonTape::skipSpace() {
+    while(m_cur < m_end && (*m_cur == ' ' || *m_cur == '\n'
+                || *m_cur == '\r' || *m_cur == '\t')) {
+        ++m_cur;
+    }
+}
+
+uint32_t JsonTape::push(Type type, bool flag, const char* begin, const char* end) {
+    uint32_t idx = m_tokens.size();
+    m_tokens.push_back(Token{type, flag, idx + 1, 0
+                        ,boost::string_view(begin, end - begin)});
+    return idx;
+}
+
+bool JsonTape::parseString(bool& escaped) {
+    escaped = false;
+    ++m_cur;
+    while(m_cur < m_end) {
+        unsigned char c = *m_cur;
+        if(c == '"') {
+            ++m_cur;
+            return true;
+        }
+        if(c == '\\') {
+            // 转义内容在访问时才校验
+            if(m_end - m_cur < 2) {
+                return false;
+            }
+            escaped = true;
+            m_cur += 2;
+            continue;
+        }
+        if(c < 0x20) {
+            return false;
+        }
+        ++m_cur;
+    }
+    return false;
+}
+
+bool JsonTape::parseNumber(bool& integer) {
+    const char* p = m_cur;
+    integer = true;
+    if(*p == '-') {
+        ++p;
+    }
+    if(p >= m_end) {
+        return false;
+    }
+    if(*p == '0') {
+        ++p;
+    } else if(*p >= '1' && *p <= '9') {
+        while(p < m_end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+    } else {
+        return false;
+    }
+    if(p < m_end && *p == '.') {
+        integer = false;
+        ++p;
+        if(p >= m_end || *p < '0' || *p > '9') {
+            return false;
+        }
+        while(p < m_end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+    if(p < m_end && (*p == 'e' || *p == 'E')) {
+        integer = false;
+        ++p;
+        if(p < m_end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+        if(p >= m_end || *p < '0' || *p > '9') {
+            return false;
+        }
+        while(p < m_end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+    }
+    push(numberValue, integer, m_cur, p);
+    m_cur = p;
+    return true;
+}
+
+bool JsonTape::parseLiteral(const char* literal, size_t len, Type type) {
+    if((size_t)(m_end - m_cur) < len || memcmp(m_cur, literal, len)) {
+        return false;
+    }
+    push(type, false, m_cur, m_cur + len);
+    m_cur += len;
+    return true;
+}
+
+bool JsonTape::parseValue(int depth) {
+    if(depth > kMaxJsonDepth) {
+        return false;
+    }
+    skipSpace();
+    if(m_cur >= m_end) {
+        return false;
+    }
+    switch(*m_cur) {
+        case '{':
+        case '[': {
+            bool object = *m_cur == '{';
+            char close = object ? '}' : ']';
+            const char* begin = m_cur;
+            uint32_t idx = push(object ? objectValue : arrayValue, false, m_cur, m_cur);
+            uint32_t count = 0;
+            ++m_cur;
+            skipSpace();
+            if(m_cur < m_end && *m_cur == close) {
+                ++m_cur;
+            } else {
+                while(true) {
+                    if(object) {
+                        skipSpace();
+                        if(m_cur >= m_end || *m_cur != '"') {
+                            return false;
+                        }
+                        const char* key = m_cur + 1;
+                        bool escaped = false;
+                        if(!parseString(escaped)) {
+                            return false;
+                        }
+                        push(stringValue, escaped, key, m_cur - 1);
+                        skipSpace();
+                        if(m_cur >= m_end || *m_cur != ':') {
+                            return false;
+                        }
+                        ++m_cur;
+                    }
+                    if(!parseValue(depth + 1)) {
+                        return false;
+                    }
+                    ++count;
+                    skipSpace();
+                    if(m_cur >= m_end) {
+                        return false;
+                    }
+                    if(*m_cur == ',') {
+                        ++m_cur;
+                        continue;
+                    }
+                    if(*m_cur == close) {
+                        ++m_cur;
+                        break;
+                    }
+                    return false;
+                }
+            }
+            Token& t = m_tokens[idx];
+            t.next = m_tokens.size();
+            t.count = count;
+            t.text = boost::string_view(begin, m_cur - begin);
+            return true;
+        }
+        case '"': {
+            const char* begin = m_cur + 1;
+            bool escaped = false;
+            if(!parseString(escaped)) {
+                return false;
+            }
+            push(stringValue, escaped, begin, m_cur - 1);
+            return true;
+        }
+        case 't':
+            return parseLiteral("true", 4, trueValue);
+        case 'f':
+            return parseLiteral("false", 5, falseValue);
+        case 'n':
+            return parseLiteral("null", 4, nullValue);
+        default: {
+            bool integer = false;
+            return parseNumber(integer);
+        }
+    }
+}
+
+uint32_t JsonTape::Value::size() const {
+    if(isArray() || isObject()) {
+        return token().count;
+    }
+    return 0;
+}
+
+JsonTape::Value JsonTape::Value::operator[](uint32_t i) const {
+    if(!isArray() || i >= token().count) {
+        return Value();
+    }
+    uint32_t idx = m_idx + 1;
+    while(i--) {
+        idx = m_tape->m_tokens[idx].next;
+    }
+    return Value(m_tape, idx);
+}
+
+JsonTape::Value JsonTape::Value::get(boost::string_view name) const {
+    if(!isObject()) {
+        return Value();
+    }
+    const std::vector<Token>& tokens = m_tape->m_tokens;
+    uint32_t idx = m_idx + 1;
+    std::string tmp;
+    for(uint32_t i = 0; i < token().count; ++i) {
+        const Token& key = tokens[idx];
+        if(!key.flag) {
+            if(key.text == name) {
+                return Value(m_tape, idx + 1);
+            }
+        } else {
+            tmp.clear();
+            if(Unescape(key.text, tmp) && tmp == name) {
+                return Value(m_tape, idx + 1);
+            }
+        }
+        idx = tokens[idx + 1].next;
+    }
+    return Value();
+}
+
+JsonTape::Iterator JsonTape::Value::begin() const {
+    if(!isValid()) {
+        return Iterator(nullptr, 0, false);
+    }
+    return Iterator(m_tape, m_idx + 1, isObject());
+}
+
+JsonTape::Iterator JsonTape::Value::end() const {
+    if(!isValid()) {
+        return Iterator(nullptr, 0, false);
+    }
+    return Iterator(m_tape, token().next, isObject());
+}
+
+JsonTape::Iterator& JsonTape::Iterator::operator++() {
+    m_idx = m_tape->m_tokens[m_object ? m_idx + 1 : m_idx].next;
+    return *this;
+}
+
+bool JsonTape::Value::appendString(std::string& out) const {
+    if(!isString()) {
+        return false;
+    }
+    const Token& t = token();
+    if(!t.flag) {
+        out.append(t.text.data(), t.text.size());
+        return true;
+    }
+    size_t old = out.size();
+    if(!Unescape(t.text, out)) {
+        out.resize(old);
+        return false;
+    }
+    return true;
+}
+
+std::string JsonTape::Value::asString(const std::string& default_value) const {
+    if(!isValid()) {
+        return default_value;
+    }
+    switch(getType()) {
+        case stringValue: {
+            std::string rt;
+            if(!appendString(rt)) {
+                return default_value;
+            }
+            return rt;
+        }
+        case numberValue:
+        case trueValue:
+        case falseValue:
+            return std::string(token().text.data(), token().text.size());
+        default:
+            return default_value;
+    }
+}
+
+int64_t JsonTape::Value::asInt64(int64_t default_value) const {
+    if(!isNumber() && !isString()) {
+        return default_value;
+    }
+    std::string tmp;
+    boost::string_view v = token().text;
+    if(isString() && token().flag) {
+        if(!appendString(tmp)) {
+            return default_value;
+        }
+        v = tmp;
+    }
+    int64_t rt = 0;
+    if(ParseInt64(v, rt)) {
+        return rt;
+    }
+    double d = 0;
+    // 超出 int64 范围或 NaN 时转换是未定义行为; 2^63 可以用 double 精确表示
+    if(ParseDouble(v, d) && d >= -9223372036854775808.0 && d < 9223372036854775808.0) {
+        return (int64_t)d;
+    }
+    return default_value;
+}
+
+uint64_t JsonTape::Value::asUint64(uint64_t default_value) const {
+    if(!isNumber() && !isString()) {
+        return default_value;
+    }
+    std::string tmp;
+    boost::string_view v = token().text;
+    if(isString() && token().flag) {
+        if(!appendString(tmp)) {
+            return default_value;
+        }
+        v = tmp;
+    }
+    uint64_t rt = 0;
+    if(ParseUint64(v, rt)) {
+        return rt;
+    }
+    double d = 0;
+    if(ParseDouble(v, d) && d >= 0 && d < 18446744073709551616.0) {
+        return (uint64_t)d;
+    }
+    return default_value;
+}
+
+double JsonTape::Value::asDouble(double default_value) const {
+    if(!isNumber() && !isString()) {
+        return default_value;
+    }
+    std::string tmp;
+    boost::string_view v = token().text;
+    if(isString() && token().flag) {
+        if(!appendString(tmp)) {
+            return default_value;
+        }
+        v = tmp;
+    }
+    double rt = 0;
+    if(ParseDouble(v, rt)) {
+        return rt;
+    }
+    return default_value;
+}
+
+bool JsonTape::Value::asBool(bool default_value) const {
+    if(!isValid()) {
+        return default_value;
+    }
+    switch(getType()) {
+        case trueValue:
+            return true;
+        case falseValue:
+            return false;
+        case numberValue:
+            return asDouble(0) != 0;
+        default:
+            return default_value;
+    }
+}
+
+std::string JsonTape::Value::getString(boost::string_view name
+                            ,const std::string& default_value) const {
+    Value v = get(name);
+    if(!v.isString()) {
+        return default_value;
+    }
+    return v.asString(default_value);
+}
+
+int32_t JsonTape::Value::getInt32(boost::string_view name, int32_t default_value) const {
+    return get(name).asInt64(default_value);
+}
+
+uint32_t JsonTape::Value::getUint32(boost::string_view name, uint32_t default_value) const {
+    return get(name).asUint64(default_value);
+}
+
+int64_t JsonTape::Value::getInt64(boost::string_view name, int64_t default_value) const {
+    return get(name).asInt64(default_value);
+}
+
+uint64_t JsonTape::Value::getUint64(boost::string_view name, uint64_t default_value) const {
+    return get(name).asUint64(default_value);
+}
+
+double JsonTape::Value::getDouble(boost::string_view name, double default_value) const {
+    return get(name).asDouble(default_value);
+}
+
+bool JsonTape::Value::getBool(boost::string_view name, bool default_value) const {
+    return get(name).asBool(default_value);
+}
+
+void JsonWriter::AppendEscaped(std::string& out, boost::string_view v) {
+    static const char* s_hex = "0123456789abcdef";
+    const char* p = v.data();
+    size_t len = v.size();
+    while(true) {
+        size_t pos = s_find_escape_strict(p, len);
+        out.append(p, pos);
+        if(pos == len) {
+            break;
+        }
+        unsigned char c = p[pos];
+        switch(c) {
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '\f': out.append("\\f", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            default: {
+                char buf[6] = {'\\', 'u', '0', '0', s_hex[c >> 4], s_hex[c & 0xf]};
+                out.append(buf, 6);
+                break;
+            }
+        }
+        p += pos + 1;
+        len -= pos + 1;
+    }
+}
+
+void JsonWriter::separator() {
+    if(m_afterKey) {
+        m_afterKey = false;
+        return;
+    }
+    if(!m_hasElem.empty()) {
+        if(m_hasElem.back()) {
+            m_out.push_back(',');
+        } else {
+            m_hasElem.back() = true;
+        }
+    }
+}
+
+JsonWriter& JsonWriter::startObject() {
+    separator();
+    m_out.push_back('{');
+    m_hasElem.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+    m_hasElem.pop_back();
+    m_out.push_back('}');
+    return *this;
+}
+
+JsonWriter& JsonWriter::startArray() {
+    separator();
+    m_out.push_back('[');
+    m_hasElem.push_back(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+    m_hasElem.pop_back();
+    m_out.push_back(']');
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(boost::string_view name) {
+    separator();
+    m_out.push_back('"');
+    AppendEscaped(m_out, name);
+    m_out.append("\":", 2);
+    m_afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+    separator();
+    m_out.append("null", 4);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(boost::string_view v) {
+    separator();
+    m_out.push_back('"');
+    AppendEscaped(m_out, v);
+    m_out.push_back('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool v) {
+    separator();
+    if(v) {
+        m_out.append("true", 4);
+    } else {
+        m_out.append("false", 5);
+    }
+    return *this;
+}
+
+static void AppendUint64(std::string& out, unsigned long long v) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while(v);
+    out.append(p, buf + sizeof(buf) - p);
+}
+
+JsonWriter& JsonWriter::value(unsigned long long v) {
+    separator();
+    AppendUint64(m_out, v);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(long long v) {
+    separator();
+    if(v < 0) {
+        m_out.push_back('-');
+        AppendUint64(m_out, 0ULL - (unsigned long long)v);
+    } else {
+        AppendUint64(m_out, v);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double v) {
+    // JSON 不支持 NaN/Inf
+    if(v != v || v == std::numeric_limits<double>::infinity()
+            || v == -std::numeric_limits<double>::infinity()) {
+        return null();
+    }
+    separator();
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.17g", v);
+    m_out.append(buf, len);
+    return *this;
+}
+
+JsonWriter& JsonWriter::raw(boost::string_view json) {
+    separator();
+    m_out.append(json.data(), json.size());
+    return *this;
+}
+
 }
@@ -10,16 +10,24 @@
 #ifndef __GEDUO_UTIL_JSON_UTIL_H__
 #define __GEDUO_UTIL_JSON_UTIL_H__
 
+#include <stdint.h>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <json/json.h>
+#include <boost/utility/string_view.hpp>
 
 namespace geduo {
 
 class JsonUtil {
 public:
-    static bool NeedEscape(const std::string& v);
+    /// 是否含有需要转义的字符(\f \t \r \n \b " \\), 使用 SIMD 每次检查16/32字节
+    static bool NeedEscape(boost::string_view v);
     static std::string Escape(const std::string& v);
+    /// 转义后追加到 out
+    static void EscapeAppend(boost::string_view v, std::string& out);
+    /// 无需转义时直接返回 v, 否则转义到 buf 并返回 buf 的视图
+    static boost::string_view EscapeView(boost::string_view v, std::string& buf);
     static std::string GetString(const Json::Value& json
                           ,const std::string& name
                           ,const std::string& default_value = "");
@@ -42,6 +50,193 @@ public:
     static std::string ToString(const Json::Value& json);
 };
 
+/**
+ * @brief 就地解析的 JSON 读取器
+ * @details 不构建 Json::Value, 解析结果是一条扁平的 tape: 每个值占一项, 字符串/数字
+ *          直接引用输入缓冲区(string_view), 对象/数组记录其后继位置以便整体跳过.
+ *          类型转换和字符串反转义都在访问字段时才进行.
+ *          输入缓冲区在 JsonTape 及其 Value 使用期间必须保持有效
+ */
+class JsonTape {
+public:
+    enum Type : uint8_t {
+        nullValue = 0,
+        falseValue,
+        trueValue,
+        numberValue,
+        stringValue,
+        arrayValue,
+        objectValue
+    };
+
+    struct Token {
+        Type type;
+        /// stringValue: 含有转义字符; numberValue: 是整数(无小数点和指数)
+        bool flag;
+        /// 下一个兄弟值在 tape 中的位置
+        uint32_t next;
+        /// 数组元素个数, 对象成员个数
+        uint32_t count;
+        /// 原始文本, 字符串不含引号且未反转义
+        boost::string_view text;
+    };
+
+    class Iterator;
+
+    /// @brief tape 中一个值的只读视图, 拷贝开销很小, 不存在的值 isValid() 为 false
+    class Value {
+    public:
+        Value() : m_tape(nullptr), m_idx(0) {}
+        Value(const JsonTape* tape, uint32_t idx) : m_tape(tape), m_idx(idx) {}
+
+        bool isValid() const { return m_tape != nullptr; }
+        Type getType() const { return token().type; }
+        bool isNull() const { return !isValid() || getType() == nullValue; }
+        bool isBool() const { return isValid() && (getType() == trueValue || getType() == falseValue); }
+        bool isNumber() const { return isValid() && getType() == numberValue; }
+        bool isInteger() const { return isNumber() && token().flag; }
+        bool isString() const { return isValid() && getType() == stringValue; }
+        bool isArray() const { return isValid() && getType() == arrayValue; }
+        bool isObject() const { return isValid() && getType() == objectValue; }
+
+        /// 数组元素个数或对象成员个数, 其他类型返回0
+        uint32_t size() const;
+        /// 原始文本, 对字符串是引号内未反转义的内容
+        boost::string_view raw() const { return isValid() ? token().text : boost::string_view(); }
+
+        /// 数组下标访问, 越界返回无效值
+        Value operator[](uint32_t i) const;
+        /// 对象成员查找, 不存在返回无效值
+        Value operator[](boost::string_view name) const { return get(name); }
+        Value get(boost::string_view name) const;
+        bool hasMember(boost::string_view name) const { return get(name).isValid(); }
+
+        Iterator begin() const;
+        Iterator end() const;
+
+        /// 字符串反转义后的值, 数字/布尔返回原始文本, 其他返回 default_value
+        std::string asString(const std::string& default_value = "") const;
+        /// 反转义后追加到 out, 不是字符串返回 false
+        bool appendString(std::string& out) const;
+        /// 数字或数字字符串转换, 失败返回 default_value
+        int64_t asInt64(int64_t default_value = 0) const;
+        uint64_t asUint64(uint64_t default_value = 0) const;
+        double asDouble(double default_value = 0) const;
+        bool asBool(bool default_value = false) const;
+
+        /// 与 JsonUtil::GetXXX 语义相同的成员访问
+        std::string getString(boost::string_view name, const std::string& default_value = "") const;
+        int32_t getInt32(boost::string_view name, int32_t default_value = 0) const;
+        uint32_t getUint32(boost::string_view name, uint32_t default_value = 0) const;
+        int64_t getInt64(boost::string_view name, int64_t default_value = 0) const;
+        uint64_t getUint64(boost::string_view name, uint64_t default_value = 0) const;
+        double getDouble(boost::string_view name, double default_value = 0) const;
+        bool getBool(boost::string_view name, bool default_value = false) const;
+    private:
+        const Token& token() const { return m_tape->m_tokens[m_idx]; }
+    private:
+        const JsonTape* m_tape;
+        uint32_t m_idx;
+    };
+
+    /// @brief 遍历数组元素或对象成员, 对象时 key() 为成员名
+    class Iterator {
+    public:
+        Iterator(const JsonTape* tape, uint32_t idx, bool object)
+            :m_tape(tape), m_idx(idx), m_object(object) {}
+
+        Value key() const { return m_object ? Value(m_tape, m_idx) : Value(); }
+        Value value() const { return Value(m_tape, m_object ? m_idx + 1 : m_idx); }
+        Value operator*() const { return value(); }
+        Iterator& operator++();
+        bool operator==(const Iterator& o) const { return m_idx == o.m_idx; }
+        bool operator!=(const Iterator& o) const { return m_idx != o.m_idx; }
+    private:
+        const JsonTape* m_tape;
+        uint32_t m_idx;
+        bool m_object;
+    };
+
+    JsonTape() {}
+
+    /**
+     * @brief 解析 JSON 文本, 可重复调用, tape 的内存会复用
+     * @return 语法错误返回 false, 出错位置由 getErrorOffset() 获取
+     */
+    bool parse(const char* data, size_t len);
+    bool parse(boost::string_view v) { return parse(v.data(), v.size()); }
+
+    /// @brief 根节点, 解析失败时为无效值
+    Value root() const { return m_tokens.empty() ? Value() : Value(this, 0); }
+    size_t getErrorOffset() const { return m_errorOffset; }
+    const std::vector<Token>& getTokens() const { return m_tokens; }
+
+    /// @brief 反转义 JSON 字符串内容(不含引号)并追加到 out, 非法转义返回 false
+    static bool Unescape(boost::string_view v, std::string& out);
+private:
+    bool parseValue(int depth);
+    bool parseString(bool& escaped);
+    bool parseNumber(bool& integer);
+    bool parseLiteral(const char* literal, size_t len, Type type);
+    void skipSpace();
+    uint32_t push(Type type, bool flag, const char* begin, const char* end);
+private:
+    std::vector<Token> m_tokens;
+    const char* m_begin = nullptr;
+    const char* m_cur = nullptr;
+    const char* m_end = nullptr;
+    size_t m_errorOffset = 0;
+};
+
+/**
+ * @brief 流式 JSON 写入, 直接追加到外部的缓冲区, 不构建 Json::Value
+ * @details 逗号/冒号自动处理, 调用方负责 start/end 配对
+ *          JsonWriter w(buf);
+ *          w.startObject().member("id", 1).key("tags").startArray().value("a").endArray().endObject();
+ */
+class JsonWriter {
+public:
+    JsonWriter(std::string& out) : m_out(out) {}
+
+    JsonWriter& startObject();
+    JsonWriter& endObject();
+    JsonWriter& startArray();
+    JsonWriter& endArray();
+    JsonWriter& key(boost::string_view name);
+
+    JsonWriter& null();
+    JsonWriter& value(boost::string_view v);
+    JsonWriter& value(const char* v) { return value(boost::string_view(v)); }
+    JsonWriter& value(const std::string& v) { return value(boost::string_view(v)); }
+    JsonWriter& value(bool v);
+    JsonWriter& value(int v) { return value((long long)v); }
+    JsonWriter& value(unsigned int v) { return value((unsigned long long)v); }
+    JsonWriter& value(long v) { return value((long long)v); }
+    JsonWriter& value(unsigned long v) { return value((unsigned long long)v); }
+    JsonWriter& value(long long v);
+    JsonWriter& value(unsigned long long v);
+    JsonWriter& value(double v);
+    /// 写入已编码好的 JSON 片段
+    JsonWriter& raw(boost::string_view json);
+
+    template<class T>
+    JsonWriter& member(boost::string_view name, const T& v) {
+        return key(name).value(v);
+    }
+
+    /// @brief 按 JSON 规则转义字符串并追加到 out (不含引号)
+    static void AppendEscaped(std::string& out, boost::string_view v);
+
+    std::string& getBuffer() { return m_out; }
+private:
+    void separator();
+private:
+    std::string& m_out;
+    /// 每层容器是否已有元素
+    std::vector<bool> m_hasElem;
+    bool m_afterKey = false;
+};
+
 }
 
 #endif